@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+// Heap buffer aligned for SIMD loads, meant to be allocated once and reused for every frame
+class AlignedBuffer {
+    static constexpr size_t alignment = 64;
+    uint8_t* ptr = nullptr;
+    size_t length = 0;
+
+    static uint8_t* allocate(size_t length) {
+        // aligned_alloc requires the size to be a multiple of the alignment
+        auto* p = static_cast<uint8_t*>(std::aligned_alloc(alignment, (length + alignment - 1) / alignment * alignment));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+public:
+    AlignedBuffer() = default;
+    explicit AlignedBuffer(size_t length) : ptr(allocate(length)), length(length) {}
+    ~AlignedBuffer() { std::free(ptr); }
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept : ptr(other.ptr), length(other.length) {
+        other.ptr = nullptr;
+        other.length = 0;
+    }
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept {
+        if (this != &other) {
+            std::free(ptr);
+            ptr = other.ptr;
+            length = other.length;
+            other.ptr = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    // Grow the buffer to at least newLength bytes, keeping the first keep bytes
+    void grow(size_t newLength, size_t keep = 0) {
+        if (newLength <= length) {
+            return;
+        }
+        uint8_t* p = allocate(newLength);
+        if (keep > 0) {
+            std::memcpy(p, ptr, keep);
+        }
+        std::free(ptr);
+        ptr = p;
+        length = newLength;
+    }
+
+    uint8_t* get() const { return ptr; }
+    size_t size() const { return length; }
+};
@@ -0,0 +1,40 @@
+# ambilight_core: color extraction, averaging, color correction and LED framing, shared by the server and client_app
+if(NOT TARGET ambilight_core)
+    add_library(ambilight_core STATIC
+            ${CMAKE_CURRENT_LIST_DIR}/ColorOfBlock.hpp
+            ${CMAKE_CURRENT_LIST_DIR}/ColorOfBlock.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ColorOfBlockYUV.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ColorOfBlockReducers.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/Frame.h
+            ${CMAKE_CURRENT_LIST_DIR}/AlignedBuffer.h
+            ${CMAKE_CURRENT_LIST_DIR}/LedLayout.h
+            ${CMAKE_CURRENT_LIST_DIR}/LedLayout.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ZoneExtractor.h
+            ${CMAKE_CURRENT_LIST_DIR}/ZoneExtractor.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ExtractionPool.h
+            ${CMAKE_CURRENT_LIST_DIR}/ExtractionPool.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/Realtime.h
+            ${CMAKE_CURRENT_LIST_DIR}/Realtime.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/LatencyTracker.h
+            ${CMAKE_CURRENT_LIST_DIR}/LatencyTracker.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/FlightRecorder.h
+            ${CMAKE_CURRENT_LIST_DIR}/FlightRecorder.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/BarDetector.h
+            ${CMAKE_CURRENT_LIST_DIR}/BarDetector.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ColorCorrection.h
+            ${CMAKE_CURRENT_LIST_DIR}/ColorCorrection.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/LedFraming.h
+            ${CMAKE_CURRENT_LIST_DIR}/LedFraming.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/LedInterpolation.h
+            ${CMAKE_CURRENT_LIST_DIR}/LedInterpolation.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/Averager.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/Averager.h
+            ${CMAKE_CURRENT_LIST_DIR}/ArrayAverager.cpp
+            ${CMAKE_CURRENT_LIST_DIR}/ArrayAverager.h
+    )
+    target_include_directories(ambilight_core PUBLIC ${CMAKE_CURRENT_LIST_DIR})
+    find_package(Threads REQUIRED)
+    target_link_libraries(ambilight_core PUBLIC Threads::Threads)
+    # The kernels are selected at compile time, so the library is always built for the host CPU
+    target_compile_options(ambilight_core PRIVATE -O3 -march=native)
+endif()
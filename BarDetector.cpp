@@ -0,0 +1,223 @@
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include "ColorOfBlock.hpp"
+#include "BarDetector.h"
+
+// Bytes of a pixel that carry brightness. The rest (X of BGRX, chroma of YUYV) is masked out before comparing.
+struct ScanLayout {
+    int bytesPerPixel;
+    uint32_t mask; // Repeated every 4 bytes
+    uint8_t threshold;
+};
+
+template <typename SIMDType>
+struct BrightScanImpl {
+    // Index of the first byte in [from, len) of the row that is above the threshold, or -1
+    static int first(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        for (int i = from; i < len; i++) {
+            if (((layout.mask >> (i % 4 * 8)) & 0xff) && row[i] > layout.threshold) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Index of the last byte in [from, len) of the row that is above the threshold, or -1
+    static int last(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        for (int i = len - 1; i >= from; i--) {
+            if (((layout.mask >> (i % 4 * 8)) & 0xff) && row[i] > layout.threshold) {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+// Specialization for AVX2
+template <>
+struct BrightScanImpl<AVX2> {
+    // Bitmask of the bytes above the threshold: subtracting it with unsigned saturation leaves 0 for every byte at or below it
+    static uint32_t brightBytes(const uint8_t* p, __m256i mask, __m256i threshold) {
+        __m256i v = _mm256_subs_epu8(_mm256_and_si256(_mm256_loadu_si256((const __m256i*)p), mask), threshold);
+        return ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+    }
+
+    static int first(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>(layout.mask));
+        const __m256i threshold = _mm256_set1_epi8(static_cast<char>(layout.threshold));
+        int i = from;
+        for (; i + 32 <= len; i += 32) {
+            uint32_t bright = brightBytes(row + i, mask, threshold);
+            if (bright) {
+                return i + __builtin_ctz(bright);
+            }
+        }
+        return BrightScanImpl<void>::first(row, i, len, layout);
+    }
+
+    static int last(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        const __m256i mask = _mm256_set1_epi32(static_cast<int>(layout.mask));
+        const __m256i threshold = _mm256_set1_epi8(static_cast<char>(layout.threshold));
+        int i = len;
+        for (; i - 32 >= from; i -= 32) {
+            uint32_t bright = brightBytes(row + i - 32, mask, threshold);
+            if (bright) {
+                return i - 32 + 31 - __builtin_clz(bright);
+            }
+        }
+        return BrightScanImpl<void>::last(row, from, i, layout);
+    }
+};
+
+// Specialization for SSE2
+template <>
+struct BrightScanImpl<SSE2> {
+    static uint32_t brightBytes(const uint8_t* p, __m128i mask, __m128i threshold) {
+        __m128i v = _mm_subs_epu8(_mm_and_si128(_mm_loadu_si128((const __m128i*)p), mask), threshold);
+        return ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()))) & 0xffffu;
+    }
+
+    static int first(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(layout.mask));
+        const __m128i threshold = _mm_set1_epi8(static_cast<char>(layout.threshold));
+        int i = from;
+        for (; i + 16 <= len; i += 16) {
+            uint32_t bright = brightBytes(row + i, mask, threshold);
+            if (bright) {
+                return i + __builtin_ctz(bright);
+            }
+        }
+        return BrightScanImpl<void>::first(row, i, len, layout);
+    }
+
+    static int last(const uint8_t* row, int from, int len, const ScanLayout& layout) {
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(layout.mask));
+        const __m128i threshold = _mm_set1_epi8(static_cast<char>(layout.threshold));
+        int i = len;
+        for (; i - 16 >= from; i -= 16) {
+            uint32_t bright = brightBytes(row + i - 16, mask, threshold);
+            if (bright) {
+                return i - 16 + 31 - __builtin_clz(bright);
+            }
+        }
+        return BrightScanImpl<void>::last(row, from, i, layout);
+    }
+};
+
+BarDetector::BarDetector(int interval, int threshold) : interval(std::max(1, interval)), threshold(std::clamp(threshold, 0, 254)) {}
+
+bool BarDetector::update(const Frame& frame) {
+    // Start over with the whole frame when the size changes
+    if (frame.width != frameWidth || frame.height != frameHeight) {
+        frameWidth = frame.width;
+        frameHeight = frame.height;
+        frameCounter = 0;
+        confirmations = 0;
+        active = Zone{0, 0, frame.width, frame.height};
+        return true;
+    }
+    if (++frameCounter < interval) {
+        return false;
+    }
+    frameCounter = 0;
+
+    Zone area{};
+    if (!detect(frame, area)) {
+        return false;
+    }
+    if (area.x == active.x && area.y == active.y && area.width == active.width && area.height == active.height) {
+        confirmations = 0;
+        return false;
+    }
+    if (confirmations > 0 && area.x == candidate.x && area.y == candidate.y && area.width == candidate.width && area.height == candidate.height) {
+        confirmations++;
+    } else {
+        candidate = area;
+        confirmations = 1;
+    }
+    if (confirmations < 3) {
+        return false;
+    }
+    active = candidate;
+    confirmations = 0;
+    return true;
+}
+
+bool BarDetector::detect(const Frame& frame, Zone& area) const {
+    // Only the luma of YUV formats is looked at, where black starts at 16 unless it's full range
+    ScanLayout layout{3, 0xffffffffu, static_cast<uint8_t>(threshold)};
+    switch (frame.format) {
+        case PixelFormat::RGB24:
+            break;
+        case PixelFormat::BGRX32:
+            layout.bytesPerPixel = 4;
+            layout.mask = 0x00ffffffu;
+            break;
+        case PixelFormat::NV12:
+            layout.bytesPerPixel = 1;
+            layout.threshold = static_cast<uint8_t>(std::min(255, threshold + 16));
+            break;
+        case PixelFormat::YUYV:
+            layout.bytesPerPixel = 2;
+            layout.mask = 0x00ff00ffu;
+            layout.threshold = static_cast<uint8_t>(std::min(255, threshold + 16));
+            break;
+        case PixelFormat::YCbCrPlanar:
+            layout.bytesPerPixel = 1; // Full range, black is 0 like in RGB
+            break;
+    }
+    auto row = [&](int y) { return frame.data + static_cast<size_t>(y) * frame.stride; };
+    const int rowBytes = frame.width * layout.bytesPerPixel;
+
+    // Bars are at most a third of the frame. Probing every step-th row bounds the cost to about 60 rows per edge.
+    const int maxBar = frame.height / 3;
+    const int rowStep = std::max(1, frame.height / 180);
+    int top = -1, bottom = -1;
+    for (int y = 0; y < maxBar; y += rowStep) {
+        if (BrightScanImpl<BestSIMD>::first(row(y), 0, rowBytes, layout) != -1) {
+            top = std::max(0, y - rowStep + 1);
+            break;
+        }
+    }
+    for (int y = frame.height - 1; y >= frame.height - maxBar; y -= rowStep) {
+        if (BrightScanImpl<BestSIMD>::first(row(y), 0, rowBytes, layout) != -1) {
+            bottom = std::max(0, frame.height - 1 - y - rowStep + 1);
+            break;
+        }
+    }
+    if (top == -1 || bottom == -1) {
+        return false; // Dark scene, nothing to go by
+    }
+
+    // Pillarbox bars from a few sample rows within the picture
+    const int maxSide = frame.width / 3;
+    int left = maxSide, right = maxSide;
+    bool found = false;
+    const int sampleRows = 16;
+    for (int i = 0; i < sampleRows; i++) {
+        int y = top + (frame.height - top - bottom) * (2 * i + 1) / (2 * sampleRows);
+        int first = BrightScanImpl<BestSIMD>::first(row(y), 0, rowBytes, layout);
+        if (first == -1) {
+            continue;
+        }
+        int last = BrightScanImpl<BestSIMD>::last(row(y), first, rowBytes, layout);
+        left = std::min(left, first / layout.bytesPerPixel);
+        right = std::min(right, frame.width - 1 - last / layout.bytesPerPixel);
+        found = true;
+    }
+    if (!found) {
+        return false;
+    }
+
+    // Bars are symmetric, the smaller side wins (subtitles in the bottom bar, a logo in a side bar). Tiny bars are ignored, and
+    // sizes are kept even for the subsampled chroma of YUV formats.
+    int vertical = std::min(top, bottom);
+    int horizontal = std::min(left, right);
+    if (vertical < frame.height / 50) vertical = 0;
+    if (horizontal < frame.width / 50) horizontal = 0;
+    vertical &= ~1;
+    horizontal &= ~1;
+    area = Zone{horizontal, vertical, frame.width - 2 * horizontal, frame.height - 2 * vertical};
+    return true;
+}
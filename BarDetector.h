@@ -0,0 +1,29 @@
+#pragma once
+#include "Frame.h"
+#include "LedLayout.h"
+
+// Finds letterbox and pillarbox bars, so the zones can be placed along the edges of the actual picture instead of on black.
+// Every interval frames a bounded number of rows are scanned inward from the edges: probe rows from the top and bottom, and a few
+// sample rows for the left and right. A new area only becomes active after it was detected several times in a row, and dark scenes
+// (no picture found anywhere near an edge) never change it.
+class BarDetector {
+    int interval;
+    int threshold; // Pixels with no channel brighter than this count as black
+
+    int frameWidth = 0;
+    int frameHeight = 0;
+    int frameCounter = 0;
+    Zone active{0, 0, 0, 0};
+    Zone candidate{0, 0, 0, 0};
+    int confirmations = 0;
+
+    bool detect(const Frame& frame, Zone& area) const;
+public:
+    BarDetector(int interval, int threshold);
+
+    // Check the frame if it's due. Returns true when the active area changed.
+    bool update(const Frame& frame);
+
+    // Part of the frame that holds the picture, the whole frame until bars are found
+    const Zone& activeArea() const { return active; }
+};
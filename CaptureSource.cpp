@@ -0,0 +1,207 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include "ConfigParser.h"
+#include "JpegDecoder.h"
+#include "FlightRecorder.h"
+#include "CaptureSource.h"
+
+CaptureSource::CaptureSource(size_t index, const CaptureSourceSpec& spec, const CapturePolicy& policy, int bufferCount, Compositor& compositor,
+                             const ThreadSchedule& schedule) :
+    index(index),
+    spec(spec),
+    policy(policy),
+    bufferCount(bufferCount),
+    capture(spec.device, policy, bufferCount),
+    openedMode(capture.getMode()),
+    compositor(compositor) {
+    thread = std::thread(&CaptureSource::run, this, schedule);
+}
+
+CaptureSource::~CaptureSource() {
+    running = false;
+    thread.join();
+}
+
+std::vector<CaptureSourceSpec> CaptureSource::sourcesFromConfig(const Config& config) {
+    std::vector<CaptureSourceSpec> specs;
+    std::stringstream list(config.capture_sources);
+    std::string item;
+    while (std::getline(list, item, ';')) {
+        const size_t comma = item.find(',');
+        std::string device = item.substr(0, comma);
+        device.erase(0, device.find_first_not_of(' '));
+        if (device.empty() && comma == std::string::npos) {
+            continue; // Trailing separator
+        }
+        std::vector<int> rect;
+        try {
+            rect = ConfigParser::parseIntList(comma == std::string::npos ? "" : item.substr(comma + 1));
+        }
+        catch (const std::logic_error&) {
+            rect.clear();
+        }
+        if (device.empty() || rect.size() != 4 || rect[0] < 0 || rect[1] < 0 || rect[2] < 1 || rect[3] < 1) {
+            throw std::invalid_argument("Invalid capture source: " + item);
+        }
+        specs.push_back({device, {rect[0], rect[1], rect[2], rect[3]}});
+    }
+    return specs;
+}
+
+Zone CaptureSource::canvasOf(const std::vector<CaptureSourceSpec>& specs) {
+    int right = 0, bottom = 0;
+    for (const CaptureSourceSpec& spec : specs) {
+        right = std::max(right, spec.canvas.x + spec.canvas.width);
+        bottom = std::max(bottom, spec.canvas.y + spec.canvas.height);
+    }
+    return {0, 0, right, bottom};
+}
+
+std::vector<size_t> CaptureSource::setZones(const std::vector<Zone>& allZones, ZoneMode mode, int newRowStride, int newColStride) {
+    std::vector<size_t> leds;
+    std::vector<Zone> zones;
+    const Zone& area = spec.canvas;
+    for (size_t i = 0; i < allZones.size(); i++) {
+        const Zone& zone = allZones[i];
+        const int centerX = zone.x + zone.width / 2;
+        const int centerY = zone.y + zone.height / 2;
+        if (centerX >= area.x && centerX < area.x + area.width && centerY >= area.y && centerY < area.y + area.height) {
+            leds.push_back(i);
+            zones.push_back({zone.x - area.x, zone.y - area.y, zone.width, zone.height});
+        }
+    }
+    std::lock_guard<std::mutex> lock(zoneMutex);
+    canvasZones = std::move(zones);
+    zoneMode = mode;
+    rowStride = newRowStride;
+    colStride = newColStride;
+    zonesChanged = true;
+    return leds;
+}
+
+void CaptureSource::run(ThreadSchedule schedule) {
+    std::string scheduleError = Realtime::setSchedule(schedule);
+    if (!scheduleError.empty()) {
+        std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for " << spec.device << ": " << scheduleError << std::endl;
+    }
+    while (running) {
+        try {
+            captureLoop();
+            return;
+        }
+        catch (const std::exception& e) {
+            // The compositor fades this source's LEDs out, the other sources keep going
+            const auto lost = std::chrono::steady_clock::now();
+            std::cout << std::endl << spec.device << " lost (" << e.what() << "), waiting for it to come back" << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                error = e.what();
+            }
+            if (!capture.reopen(spec.device, policy, bufferCount, [this] { return running.load(); })) {
+                return;
+            }
+            const int64_t recoveryMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
+            std::cout << std::endl << spec.device << " back after " << recoveryMs << "ms: " << capture.getMode().describe() << std::endl;
+            std::lock_guard<std::mutex> lock(statsMutex);
+            error.clear();
+            reconnects++;
+        }
+    }
+}
+
+void CaptureSource::captureLoop() {
+    const CaptureMode& mode = capture.getMode();
+    const bool compressed = V4L2Capture::isCompressed(mode.pixelFormat);
+    std::unique_ptr<JpegDecoder> decoder(compressed ? new JpegDecoder() : nullptr);
+    ZoneExtractor zoneExtractor({});
+    std::vector<uint8_t> colors;
+    int mappedWidth = 0, mappedHeight = 0;
+
+    while (running) {
+        // Wake up regularly to notice when to stop
+        const V4L2Buffer* buffer = capture.dequeueBuffer(100);
+        if (buffer == nullptr) {
+            continue;
+        }
+        const auto dequeued = std::chrono::steady_clock::now();
+
+        Frame frame{};
+        if (compressed) {
+            const bool planar = planarJpeg && zoneExtractor.acceptsYUV();
+            if (!decoder->decode(static_cast<const uint8_t*>(buffer->get_ptr()), buffer->get_bytesused(), planar, frame)) {
+                capture.queueBuffer(*buffer);
+                continue;
+            }
+        }
+        else {
+            frame = capture.frameOf(*buffer);
+        }
+
+        // Scale this source's part of the canvas onto the frame, which may have any resolution
+        {
+            std::lock_guard<std::mutex> lock(zoneMutex);
+            if (zonesChanged || frame.width != mappedWidth || frame.height != mappedHeight) {
+                std::vector<Zone> zones;
+                zones.reserve(canvasZones.size());
+                for (const Zone& zone : canvasZones) {
+                    const int x = std::clamp(static_cast<int>(static_cast<int64_t>(zone.x) * frame.width / spec.canvas.width), 0, frame.width - 1);
+                    const int y = std::clamp(static_cast<int>(static_cast<int64_t>(zone.y) * frame.height / spec.canvas.height), 0, frame.height - 1);
+                    const int right = std::clamp(static_cast<int>(static_cast<int64_t>(zone.x + zone.width) * frame.width / spec.canvas.width), x + 1, frame.width);
+                    const int bottom = std::clamp(static_cast<int>(static_cast<int64_t>(zone.y + zone.height) * frame.height / spec.canvas.height), y + 1, frame.height);
+                    zones.push_back({x, y, right - x, bottom - y});
+                }
+                zoneExtractor.setZones(std::move(zones));
+                zoneExtractor.setMode(zoneMode);
+                zoneExtractor.setSampling(rowStride, colStride);
+                colors.assign(canvasZones.size() * 3, 0);
+                mappedWidth = frame.width;
+                mappedHeight = frame.height;
+                zonesChanged = false;
+            }
+        }
+        zoneExtractor.extract(frame, colors.data());
+
+        // Same clock as the driver timestamps
+        const int64_t nowUs = FlightRecorder::micros(std::chrono::steady_clock::now());
+        compositor.update(index, colors.data(), colors.size(), nowUs);
+        int64_t latencyUs = nowUs - FlightRecorder::micros(dequeued);
+        if ((buffer->get_flags() & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            const timeval& captured = buffer->get_timestamp();
+            latencyUs = nowUs - (static_cast<int64_t>(captured.tv_sec) * 1000000 + captured.tv_usec);
+        }
+        capture.queueBuffer(*buffer);
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        latency.add(latencyUs);
+        frames++;
+    }
+}
+
+std::string CaptureSource::statusLine() {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - lastStatusTime).count();
+    if (seconds < 1 && !lastStatus.empty()) {
+        return lastStatus;
+    }
+    std::stringstream status;
+    status << " | " << spec.device << ": ";
+    if (!error.empty()) {
+        status << "lost";
+    }
+    else {
+        status << std::fixed << std::setprecision(0) << static_cast<double>(frames - lastFrames) / seconds << "fps p50 "
+               << latency.percentile(0.5) << "us p99 " << latency.percentile(0.99) << "us";
+    }
+    if (reconnects > 0) {
+        status << " reconnects " << reconnects;
+    }
+    lastStatusTime = now;
+    lastFrames = frames;
+    lastStatus = status.str();
+    return lastStatus;
+}
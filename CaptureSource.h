@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "Config.h"
+#include "Realtime.h"
+#include "LatencyTracker.h"
+#include "ZoneExtractor.h"
+#include "V4L2Capture.h"
+#include "Compositor.h"
+
+// Where a capture device's picture goes on the canvas all sources share. The LED layout is placed around the whole canvas.
+struct CaptureSourceSpec {
+    std::string device;
+    Zone canvas;
+};
+
+// One of several capture devices in v4l2 mode: captures, decodes and extracts the colors of its own LEDs on its own thread,
+// and hands them to the compositor. Only the LEDs whose zone center lies on its part of the canvas belong to it.
+// A device that is lost is opened again once it comes back, the same way as the single device of v4l2 mode; meanwhile the
+// compositor fades its LEDs out.
+class CaptureSource {
+    const size_t index; // Of this source in the compositor
+    const CaptureSourceSpec spec;
+    const CapturePolicy policy;
+    const int bufferCount;
+    V4L2Capture capture;
+    const CaptureMode openedMode; // Read by other threads, capture's mode changes when it is opened again
+    Compositor& compositor;
+
+    // Zones of this source's LEDs relative to its part of the canvas, mapped onto the frame on the capture thread when the frame size
+    // is known. Guarded by zoneMutex, zonesChanged tells the capture thread to map them again.
+    std::mutex zoneMutex;
+    std::vector<Zone> canvasZones;
+    ZoneMode zoneMode = ZoneMode::Mean;
+    int rowStride = 1;
+    int colStride = 1;
+    bool zonesChanged = true;
+    std::atomic<bool> planarJpeg{true}; // Decode MJPEG to the YCbCr planes where the zone mode allows
+
+    // Statistics, read by statusLine()
+    std::mutex statsMutex;
+    LatencyTracker latency; // From capture until the colors are handed to the compositor
+    uint64_t frames = 0;
+    std::chrono::steady_clock::time_point lastStatusTime = std::chrono::steady_clock::now();
+    uint64_t lastFrames = 0;
+    std::string lastStatus;
+    std::string error; // Why the device was lost, empty while it captures
+    int reconnects = 0;
+
+    std::atomic<bool> running{true};
+    std::thread thread;
+
+    void run(ThreadSchedule schedule);
+    void captureLoop();
+public:
+    // Opens the device with policy and starts capturing. schedule is applied by the capture thread to itself.
+    CaptureSource(size_t index, const CaptureSourceSpec& spec, const CapturePolicy& policy, int bufferCount, Compositor& compositor,
+                  const ThreadSchedule& schedule = {});
+    ~CaptureSource();
+
+    CaptureSource(const CaptureSource&) = delete;
+    CaptureSource& operator=(const CaptureSource&) = delete;
+
+    // capture_sources, like "/dev/video0,0,0,1920,1080; /dev/video2,1920,0,1920,1080" (device, then x,y,width,height on the canvas).
+    // Empty if only capture_device is set.
+    static std::vector<CaptureSourceSpec> sourcesFromConfig(const Config& config);
+    // Smallest rectangle holding every source
+    static Zone canvasOf(const std::vector<CaptureSourceSpec>& specs);
+
+    // Take the zones of the whole canvas that belong to this source. Returns the indices of their LEDs, for the compositor.
+    std::vector<size_t> setZones(const std::vector<Zone>& allZones, ZoneMode mode, int newRowStride, int newColStride);
+    // jpeg_decode
+    void setPlanarJpeg(bool planar) { planarJpeg = planar; }
+
+    // The mode the device was first opened with
+    const CaptureMode& getMode() const { return openedMode; }
+    const std::string& getDevice() const { return spec.device; }
+
+    // Frame rate and latency, updated once a second
+    std::string statusLine();
+};
@@ -0,0 +1,17 @@
+#include <cmath>
+#include <algorithm>
+#include "ColorCorrection.h"
+
+ColorCorrection::ColorCorrection(double gamma) {
+    for (int i = 0; i < 256; i++) {
+        double adjustedBrightness = 255 * std::pow((i / 255.0), gamma);
+        adjustedBrightness = std::max(0.0, std::min(adjustedBrightness, 255.0));
+        table[i] = static_cast<uint8_t>(adjustedBrightness);
+    }
+}
+
+void ColorCorrection::apply(uint8_t* data, size_t len) const {
+    for (size_t i = 0; i < len; i++) {
+        data[i] = table[data[i]];
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Gamma correction through a precomputed lookup table
+class ColorCorrection {
+    std::array<uint8_t, 256> table{};
+public:
+    explicit ColorCorrection(double gamma);
+
+    void apply(uint8_t* data, size_t len) const;
+    uint8_t operator[](uint8_t inputBrightness) const { return table[inputBrightness]; }
+};
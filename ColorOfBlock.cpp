@@ -1,11 +1,34 @@
 #include <emmintrin.h>
 #include <immintrin.h>
+#include <algorithm>
 #include "ColorOfBlock.hpp"
 
-template <typename SIMDType>
+template <typename PixelLayout>
+struct PixelLayoutTraits;
+
+template <>
+struct PixelLayoutTraits<RGB24> {
+    static constexpr int bytesPerPixel = 3;
+    static constexpr int r = 0, g = 1, b = 2;
+};
+
+template <>
+struct PixelLayoutTraits<BGRX32> {
+    static constexpr int bytesPerPixel = 4;
+    static constexpr int r = 2, g = 1, b = 0;
+};
+
+// Number of pixels read from a block of an even width, when only every rowStride-th row and every colStride-th pair of pixels is sampled.
+// Pixels are sampled in adjacent pairs, because that's the unit most of the SIMD kernels load.
+static uint32_t sampledPixels(int width, int height, int rowStride, int colStride) {
+    return static_cast<uint32_t>((height + rowStride - 1) / rowStride) * ((width / 2 + colStride - 1) / colStride) * 2;
+}
+
+template <typename SIMDType, typename PixelLayout>
 struct ColorOfBlockImpl {
     static std::tuple<uint8_t, uint8_t, uint8_t> calculate(
-            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height) {
+            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height, int rowStride, int colStride) {
+        using Traits = PixelLayoutTraits<PixelLayout>;
 
         //If the width is odd, make it even. One of the SIMD optimizations requires this, but do it for all of them to be consistent.
         if (width % 2 == 1) {
@@ -13,15 +36,17 @@ struct ColorOfBlockImpl {
             else width += 1;
         }
 
-        uint32_t numOfPixels = width * height;
+        uint32_t numOfPixels = sampledPixels(width, height, rowStride, colStride);
         uint32_t color[] = {0, 0, 0};  // For storing summed color channels
 
         // Default implementation for non-SIMD case (fallback)
-        for (int ypos = y; ypos < y + height; ypos++) {
-            for (int xpos = x; xpos < x + width; xpos++) {
-                for (int i = 0; i < 3; i++) {
-                    int index = (ypos * imgwidth + xpos) * 3 + i;
-                    color[i] += img[index];
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
+                for (int pixel = 0; pixel < 2; pixel++) {
+                    int index = (ypos * imgwidth + xpos + pixel) * Traits::bytesPerPixel;
+                    color[0] += img[index + Traits::r];
+                    color[1] += img[index + Traits::g];
+                    color[2] += img[index + Traits::b];
                 }
             }
         }
@@ -36,9 +61,9 @@ struct ColorOfBlockImpl {
 
 // Specialization for AVX2
 template <>
-struct ColorOfBlockImpl<AVX2> {
+struct ColorOfBlockImpl<AVX2, RGB24> {
     static std::tuple<uint8_t, uint8_t, uint8_t> calculate(
-            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height) {
+            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height, int rowStride, int colStride) {
 
         if (width % 2 == 1) {
             if (width > 1) width -= 1;
@@ -46,10 +71,10 @@ struct ColorOfBlockImpl<AVX2> {
         }
 
         //use a 256 bit SIMD register containing 8 32 bit integers. The sum of even R,G,B pixels is in the first 3 uint32s, the sum of odd R,G,B pixels is in the following 3 uint32s, and the remaining 2 uint16s are unused.
-        uint32_t numOfPixels = width * height;
+        uint32_t numOfPixels = sampledPixels(width, height, rowStride, colStride);
         __m256i sum = _mm256_setzero_si256();
-        for (int ypos = y; ypos < y + height; ypos++) {
-            for (int xpos = x; xpos < x + width; xpos += 2) {
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
                 int index = (ypos * imgwidth + xpos) * 3;
                 __m128i p = _mm_loadu_si128((__m128i*)&img[index]); //load next 16 subpixels into 16x 8bit registers. Only the next 6 are needed. If we are at the very bottom right of the image, this may try to load values outside the image. To prevent segfaults, 16 bytes of padding is also allocated after the image data ends.
                 __m256i q = _mm256_cvtepu8_epi32(p); //convert 8bit registers to 32bit registers, throwing away the upper 8 values. This will leave us with 8 32bit registers, the last 2 of which are unused.
@@ -66,27 +91,60 @@ struct ColorOfBlockImpl<AVX2> {
     }
 };
 
+template <>
+struct ColorOfBlockImpl<AVX2, BGRX32> {
+    static std::tuple<uint8_t, uint8_t, uint8_t> calculate(
+            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height, int rowStride, int colStride) {
+
+        if (width % 2 == 1) {
+            if (width > 1) width -= 1;
+            else width += 1;
+        }
+
+        //Same as the RGB24 version, but two BGRX pixels are exactly 8 bytes, so nothing past them is loaded. The lanes hold B,G,R,X of the even pixel followed by B,G,R,X of the odd pixel.
+        uint32_t numOfPixels = sampledPixels(width, height, rowStride, colStride);
+        __m256i sum = _mm256_setzero_si256();
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
+                int index = (ypos * imgwidth + xpos) * 4;
+                __m128i p = _mm_loadl_epi64((__m128i*)&img[index]);
+                __m256i q = _mm256_cvtepu8_epi32(p);
+                sum = _mm256_add_epi32(sum, q);
+            }
+        }
+
+        int32_t result[8];
+        _mm256_storeu_si256((__m256i*)result, sum);
+        uint8_t b0 = (result[2] + result[6]) / numOfPixels;
+        uint8_t b1 = (result[1] + result[5]) / numOfPixels;
+        uint8_t b2 = (result[0] + result[4]) / numOfPixels;
+        return std::make_tuple(b0, b1, b2);
+    }
+};
+
 // Specialization for SSE2
 template <>
-struct ColorOfBlockImpl<SSE2> {
+struct ColorOfBlockImpl<SSE2, RGB24> {
     static std::tuple<uint8_t, uint8_t, uint8_t> calculate(
-            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height) {
+            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height, int rowStride, int colStride) {
 
         if (width % 2 == 1) {
             if (width > 1) width -= 1;
             else width += 1;
         }
 
-        uint32_t numOfPixels = width * height;
+        uint32_t numOfPixels = sampledPixels(width, height, rowStride, colStride);
         if (width >= 512) {
             //use a 128 bit SIMD register containing 4 32-bit integers. The first 3 are used for R,G,B sums, the fourth is unused.
             __m128i sum = _mm_setzero_si128();
-            for (int ypos = y; ypos < y + height; ypos++) {
-                for (int xpos = x; xpos < x + width; xpos++) {
-                    int index = (ypos * imgwidth + xpos) * 3;
-                    __m128i p = _mm_loadu_si128((__m128i*)&img[index]); //load next 16 subpixels into 16x 8bit registers. Only the next 6 are needed. If we are at the very bottom right of the image, this may try to load values outside the image. To prevent segfaults, 16 bytes of padding is also allocated after the image data ends.
-                    __m128i q = _mm_cvtepu8_epi32(p); //convert 8bit registers to 32bit registers, throwing away the upper 12 values. This will leave us with 4 32bit registers, the last of which is unused.
-                    sum = _mm_add_epi32(sum, q);
+            for (int ypos = y; ypos < y + height; ypos += rowStride) {
+                for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
+                    for (int pixel = xpos; pixel < xpos + 2; pixel++) {
+                        int index = (ypos * imgwidth + pixel) * 3;
+                        __m128i p = _mm_loadu_si128((__m128i*)&img[index]); //load next 16 subpixels into 16x 8bit registers. Only the next 6 are needed. If we are at the very bottom right of the image, this may try to load values outside the image. To prevent segfaults, 16 bytes of padding is also allocated after the image data ends.
+                        __m128i q = _mm_cvtepu8_epi32(p); //convert 8bit registers to 32bit registers, throwing away the upper 12 values. This will leave us with 4 32bit registers, the last of which is unused.
+                        sum = _mm_add_epi32(sum, q);
+                    }
                 }
             }
 
@@ -101,9 +159,9 @@ struct ColorOfBlockImpl<SSE2> {
             //use a 128 bit SIMD register containing 8 16bit integers. The sum of even R,G,B pixels is in the first 3 uint16s, the sum of odd R,G,B pixels is in the following 3 uint16s, and the remaining 2 uint16s are unused.
             //After each row has been summed, the odd and even sums are added together, and the result is added to the total sum. This only works for <512 pixels wide, because the sum of the odd and even sums may overflow an uint16 otherwise.
             uint32_t sum[] = {0, 0, 0};
-            for (int ypos = y; ypos < y + height; ypos++) {
+            for (int ypos = y; ypos < y + height; ypos += rowStride) {
                 __m128i rowsum = _mm_setzero_si128();
-                for (int xpos = x; xpos < x + width; xpos += 2) {
+                for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
                     int index = (ypos * imgwidth + xpos) * 3;
                     __m128i p = _mm_loadu_si128((__m128i*)&img[index]); //load next 16 subpixels into 16x 8bit registers. Only the next 6 is needed. If we are at the very bottom right of the image, this may try to load values outside the image. To prevent segfaults, 16 bytes of padding is also allocated after the image data ends.
                     __m128i q = _mm_cvtepu8_epi16(p); //convert 8bit registers to 16bit registers, throwing away the upper 8 values. This will leave us with 8 16bit registers, the last 2 of which are unused.
@@ -127,11 +185,75 @@ struct ColorOfBlockImpl<SSE2> {
     }
 };
 
-template <typename SIMDType>
-std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height) {
-    return ColorOfBlockImpl<SIMDType>::calculate(img, imgwidth, imgheight, x, y, width, height);
+template <>
+struct ColorOfBlockImpl<SSE2, BGRX32> {
+    static std::tuple<uint8_t, uint8_t, uint8_t> calculate(
+            const uint8_t* img, int imgwidth, int imgheight __attribute__((unused)), int x, int y, int width, int height, int rowStride, int colStride) {
+
+        if (width % 2 == 1) {
+            if (width > 1) width -= 1;
+            else width += 1;
+        }
+
+        uint32_t numOfPixels = sampledPixels(width, height, rowStride, colStride);
+        if (width >= 512) {
+            //use a 128 bit SIMD register containing 4 32-bit integers, holding the B,G,R,X sums of one pixel at a time.
+            __m128i sum = _mm_setzero_si128();
+            for (int ypos = y; ypos < y + height; ypos += rowStride) {
+                for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
+                    for (int pixel = xpos; pixel < xpos + 2; pixel++) {
+                        int index = (ypos * imgwidth + pixel) * 4;
+                        __m128i p = _mm_cvtsi32_si128(*(const int32_t*)&img[index]);
+                        __m128i q = _mm_cvtepu8_epi32(p);
+                        sum = _mm_add_epi32(sum, q);
+                    }
+                }
+            }
+
+            int32_t result[4];
+            _mm_storeu_si128((__m128i*)result, sum);
+            uint8_t b0 = result[2] / numOfPixels;
+            uint8_t b1 = result[1] / numOfPixels;
+            uint8_t b2 = result[0] / numOfPixels;
+            return std::make_tuple(b0, b1, b2);
+        }
+        else {
+            //use a 128 bit SIMD register containing 8 16bit integers, B,G,R,X of the even pixel followed by B,G,R,X of the odd pixel. Row sums fit into uint16 below 512 pixels, same as the RGB24 version.
+            uint32_t sum[] = {0, 0, 0};
+            for (int ypos = y; ypos < y + height; ypos += rowStride) {
+                __m128i rowsum = _mm_setzero_si128();
+                for (int xpos = x; xpos < x + width; xpos += 2 * colStride) {
+                    int index = (ypos * imgwidth + xpos) * 4;
+                    __m128i p = _mm_loadl_epi64((__m128i*)&img[index]);
+                    __m128i q = _mm_cvtepu8_epi16(p);
+                    rowsum = _mm_adds_epu16(rowsum, q);
+                }
+                uint16_t rowSumResult[8];
+                _mm_storeu_si128((__m128i*)rowSumResult, rowsum);
+                sum[0] += rowSumResult[2];
+                sum[1] += rowSumResult[1];
+                sum[2] += rowSumResult[0];
+                sum[0] += rowSumResult[6];
+                sum[1] += rowSumResult[5];
+                sum[2] += rowSumResult[4];
+            }
+
+            uint8_t b0 = sum[0] / numOfPixels;
+            uint8_t b1 = sum[1] / numOfPixels;
+            uint8_t b2 = sum[2] / numOfPixels;
+            return std::make_tuple(b0, b1, b2);
+        }
+    }
+};
+
+template <typename SIMDType, typename PixelLayout>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride) {
+    return ColorOfBlockImpl<SIMDType, PixelLayout>::calculate(img, imgwidth, imgheight, x, y, width, height, std::max(1, rowStride), std::max(1, colStride));
 }
 
-template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<void>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height);
-template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<SSE2>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height);
-template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<AVX2>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<void, RGB24>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<SSE2, RGB24>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<AVX2, RGB24>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<void, BGRX32>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<SSE2, BGRX32>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock<AVX2, BGRX32>(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride, int colStride);
@@ -1,9 +1,66 @@
 #pragma once
 #include <tuple>
 #include <cstdint>
+#include <cstddef>
 
 struct AVX2;
 struct SSE2;
 
+// The best implementation the compiler targets, for callers that don't pick one themselves
+#ifdef __AVX2__
+using BestSIMD = AVX2;
+#elif __SSE2__
+using BestSIMD = SSE2;
+#else
+using BestSIMD = void;
+#endif
+
+// Pixel layouts understood by the kernels
+struct RGB24;  // 3 bytes per pixel, R,G,B (turbojpeg TJPF_RGB)
+struct BGRX32; // 4 bytes per pixel, B,G,R,X (native X11 ZPixmap on little endian)
+
+// Average color of a block as R,G,B. imgwidth is the length of an image row in pixels.
+// With strides above 1, only every rowStride-th row and every colStride-th pair of adjacent pixels is read.
+template <typename SIMDType = void, typename PixelLayout = RGB24>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height, int rowStride = 1, int colStride = 1);
+
+// One bin of a zone histogram: the number of pixels that fell into it and the sums of their channels
+struct HistogramBin {
+    uint32_t count;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+};
+constexpr size_t histogramBins = 512; // Bins each zone needs in the histogram arena
+
+// Color of the most common quantized color (3 bits per channel) of a block, averaged over the pixels that have it. bins is scratch space of histogramBins bins.
+template <typename SIMDType = void, typename PixelLayout = RGB24>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockDominant(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins);
+
+// Mean color of a block with every pixel weighted by its saturation (max - min channel), so colored details outweigh gray and black areas
+template <typename SIMDType = void, typename PixelLayout = RGB24>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockSaturation(const uint8_t* img, int imgwidth, int x, int y, int width, int height);
+
+// Mean color of a block without its darkest and brightest 10% of pixels (by luma). bins is scratch space of histogramBins bins.
+template <typename SIMDType = void, typename PixelLayout = RGB24>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockTrimmed(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins);
+
+// Sum of a block of a single channel plane
+template <typename SIMDType = void>
+uint64_t sumOfBlock(const uint8_t* plane, int stride, int x, int y, int width, int height);
+
+// Average color of a block of an NV12 image as R,G,B. x, y, width and height are in luma pixels.
+// With strides above 1, only every rowStride-th row and every colStride-th sample of each plane is read, in all of the YUV kernels.
+template <typename SIMDType = void>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockNV12(const uint8_t* luma, int lumaStride, const uint8_t* chroma, int chromaStride, int x, int y, int width, int height,
+                                                       int rowStride = 1, int colStride = 1);
+
+// Average color of a block of a packed Y,U,Y,V (YUYV 4:2:2) image as R,G,B. stride is the length of an image row in bytes.
+template <typename SIMDType = void>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYUYV(const uint8_t* img, int stride, int x, int y, int width, int height, int rowStride = 1, int colStride = 1);
+
+// Average color of a block of full range (JFIF) Y, Cb and Cr planes as R,G,B, the layout of a decoded JPEG. x, y, width and height are
+// in luma pixels, each chroma sample covers scaleX by scaleY of them. Without chroma planes (grayscale), the color is gray.
 template <typename SIMDType = void>
-std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlock(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height);
\ No newline at end of file
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYCbCr(const uint8_t* luma, int lumaStride, const uint8_t* cb, const uint8_t* cr, int chromaStride, int scaleX, int scaleY,
+                                                        int x, int y, int width, int height, int rowStride = 1, int colStride = 1);
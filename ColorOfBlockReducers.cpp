@@ -0,0 +1,337 @@
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <cstring>
+#include <algorithm>
+#include "ColorOfBlock.hpp"
+
+template <typename PixelLayout>
+struct ReducerTraits;
+
+template <>
+struct ReducerTraits<RGB24> {
+    static constexpr int bytesPerPixel = 3;
+    static constexpr int r = 0, g = 8, b = 16; // Bit offsets of the channels within a 32bit pixel lane
+};
+
+template <>
+struct ReducerTraits<BGRX32> {
+    static constexpr int bytesPerPixel = 4;
+    static constexpr int r = 16, g = 8, b = 0;
+};
+
+// Bins of the two histograms. Quantized: 3 bits of each channel, 512 bins. Luma: BT.601 luma, 256 bins.
+enum class Binning { Quantized, Luma };
+
+static inline uint32_t binOf(uint32_t r, uint32_t g, uint32_t b, Binning binning) {
+    if (binning == Binning::Quantized) {
+        return (r >> 5) << 6 | (g >> 5) << 3 | (b >> 5);
+    }
+    return (r * 77 + g * 150 + b * 29) >> 8;
+}
+
+template <typename PixelLayout>
+static inline void addToBin(HistogramBin* bins, uint32_t pixel, Binning binning) {
+    using Traits = ReducerTraits<PixelLayout>;
+    uint32_t r = (pixel >> Traits::r) & 0xff, g = (pixel >> Traits::g) & 0xff, b = (pixel >> Traits::b) & 0xff;
+    HistogramBin& bin = bins[binOf(r, g, b, binning)];
+    bin.count++;
+    bin.r += r;
+    bin.g += g;
+    bin.b += b;
+}
+
+// Adds the saturation weighted channels of one pixel to sums (R, G, B, total weight). The weight is max - min + 1, so gray pixels still count a little.
+template <typename PixelLayout>
+static inline void addWeighted(uint64_t* sums, uint32_t pixel) {
+    using Traits = ReducerTraits<PixelLayout>;
+    uint32_t r = (pixel >> Traits::r) & 0xff, g = (pixel >> Traits::g) & 0xff, b = (pixel >> Traits::b) & 0xff;
+    uint32_t weight = std::max({r, g, b}) - std::min({r, g, b}) + 1;
+    sums[0] += weight * r;
+    sums[1] += weight * g;
+    sums[2] += weight * b;
+    sums[3] += weight;
+}
+
+template <typename PixelLayout>
+static inline uint32_t loadPixel(const uint8_t* p) {
+    uint32_t pixel = 0;
+    std::memcpy(&pixel, p, ReducerTraits<PixelLayout>::bytesPerPixel);
+    return pixel;
+}
+
+template <typename SIMDType, typename PixelLayout>
+struct ReducerImpl {
+    static void fillBins(const uint8_t* img, int imgwidth, int x, int y, int width, int height, Binning binning, HistogramBin* bins) {
+        constexpr int bpp = ReducerTraits<PixelLayout>::bytesPerPixel;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < width; xpos++) {
+                addToBin<PixelLayout>(bins, loadPixel<PixelLayout>(row + xpos * bpp), binning);
+            }
+        }
+    }
+
+    static void weightedSums(const uint8_t* img, int imgwidth, int x, int y, int width, int height, uint64_t* sums) {
+        constexpr int bpp = ReducerTraits<PixelLayout>::bytesPerPixel;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < width; xpos++) {
+                addWeighted<PixelLayout>(sums, loadPixel<PixelLayout>(row + xpos * bpp));
+            }
+        }
+    }
+};
+
+// Specialization for AVX2. 8 pixels are spread into the 32bit lanes of a register, the bin indices and weights are calculated
+// for all of them at once, and only the histogram increments themselves are scalar (a scatter with conflicting indices can't be vectorized).
+template <typename PixelLayout>
+struct ReducerImpl<AVX2, PixelLayout> {
+    using Traits = ReducerTraits<PixelLayout>;
+
+    static __m256i load(const uint8_t* p) {
+        if constexpr (Traits::bytesPerPixel == 4) {
+            return _mm256_loadu_si256((const __m256i*)p);
+        } else {
+            // Move bytes 0-11 into the low and 12-23 into the high 128bit lane, then spread each R,G,B triplet into its own 32bit lane.
+            // This loads 8 bytes more than the 8 pixels, which the padding after the image covers.
+            __m256i v = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)p), _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0));
+            const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            return _mm256_shuffle_epi8(v, spread);
+        }
+    }
+
+    static void fillBins(const uint8_t* img, int imgwidth, int x, int y, int width, int height, Binning binning, HistogramBin* bins) {
+        constexpr int bpp = Traits::bytesPerPixel;
+        const __m256i low3 = _mm256_set1_epi32(7);
+        const __m256i low8 = _mm256_set1_epi32(0xff);
+        alignas(32) uint32_t index[8];
+        alignas(32) uint32_t pixel[8];
+        const int vectorWidth = width & ~7;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 8) {
+                __m256i p = load(row + xpos * bpp);
+                __m256i bin;
+                if (binning == Binning::Quantized) {
+                    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, Traits::r + 5), low3);
+                    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, Traits::g + 5), low3);
+                    __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, Traits::b + 5), low3);
+                    bin = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 6), _mm256_slli_epi32(g, 3)), b);
+                } else {
+                    // The channels fit in the low 16 bits of their lanes, so _mm256_madd_epi16 is a 32bit multiply here
+                    __m256i r = _mm256_madd_epi16(_mm256_and_si256(_mm256_srli_epi32(p, Traits::r), low8), _mm256_set1_epi32(77));
+                    __m256i g = _mm256_madd_epi16(_mm256_and_si256(_mm256_srli_epi32(p, Traits::g), low8), _mm256_set1_epi32(150));
+                    __m256i b = _mm256_madd_epi16(_mm256_and_si256(_mm256_srli_epi32(p, Traits::b), low8), _mm256_set1_epi32(29));
+                    bin = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(r, g), b), 8);
+                }
+                _mm256_store_si256((__m256i*)index, bin);
+                _mm256_store_si256((__m256i*)pixel, p);
+                for (int k = 0; k < 8; k++) {
+                    HistogramBin& target = bins[index[k]];
+                    target.count++;
+                    target.r += (pixel[k] >> Traits::r) & 0xff;
+                    target.g += (pixel[k] >> Traits::g) & 0xff;
+                    target.b += (pixel[k] >> Traits::b) & 0xff;
+                }
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                addToBin<PixelLayout>(bins, loadPixel<PixelLayout>(row + xpos * bpp), binning);
+            }
+        }
+    }
+
+    static void weightedSums(const uint8_t* img, int imgwidth, int x, int y, int width, int height, uint64_t* sums) {
+        constexpr int bpp = Traits::bytesPerPixel;
+        const __m256i low8 = _mm256_set1_epi32(0xff);
+        const __m256i one = _mm256_set1_epi32(1);
+        const int vectorWidth = width & ~7;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            // weight * channel is at most 65280, so 32bit lanes are safe for a row of up to 500k pixels. They are flushed into sums after every row.
+            __m256i accR = _mm256_setzero_si256(), accG = _mm256_setzero_si256(), accB = _mm256_setzero_si256(), accW = _mm256_setzero_si256();
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 8) {
+                __m256i p = load(row + xpos * bpp);
+                __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, Traits::r), low8);
+                __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, Traits::g), low8);
+                __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, Traits::b), low8);
+                __m256i max = _mm256_max_epi32(_mm256_max_epi32(r, g), b);
+                __m256i min = _mm256_min_epi32(_mm256_min_epi32(r, g), b);
+                __m256i weight = _mm256_add_epi32(_mm256_sub_epi32(max, min), one);
+                accR = _mm256_add_epi32(accR, _mm256_madd_epi16(weight, r));
+                accG = _mm256_add_epi32(accG, _mm256_madd_epi16(weight, g));
+                accB = _mm256_add_epi32(accB, _mm256_madd_epi16(weight, b));
+                accW = _mm256_add_epi32(accW, weight);
+            }
+            uint32_t lanes[8];
+            __m256i* accumulators[4] = {&accR, &accG, &accB, &accW};
+            for (int c = 0; c < 4; c++) {
+                _mm256_storeu_si256((__m256i*)lanes, *accumulators[c]);
+                for (uint32_t lane : lanes) sums[c] += lane;
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                addWeighted<PixelLayout>(sums, loadPixel<PixelLayout>(row + xpos * bpp));
+            }
+        }
+    }
+};
+
+// Specialization for SSE2, 4 pixels at a time. There is no byte shuffle in SSE2, so R,G,B pixels are loaded into the lanes one by one.
+template <typename PixelLayout>
+struct ReducerImpl<SSE2, PixelLayout> {
+    using Traits = ReducerTraits<PixelLayout>;
+
+    static __m128i load(const uint8_t* p) {
+        if constexpr (Traits::bytesPerPixel == 4) {
+            return _mm_loadu_si128((const __m128i*)p);
+        } else {
+            uint32_t lanes[4];
+            std::memcpy(&lanes[0], p, 4);
+            std::memcpy(&lanes[1], p + 3, 4);
+            std::memcpy(&lanes[2], p + 6, 4);
+            std::memcpy(&lanes[3], p + 9, 4); // One byte past the 4 pixels, covered by the padding after the image
+            return _mm_and_si128(_mm_loadu_si128((const __m128i*)lanes), _mm_set1_epi32(0xffffff));
+        }
+    }
+
+    static void fillBins(const uint8_t* img, int imgwidth, int x, int y, int width, int height, Binning binning, HistogramBin* bins) {
+        constexpr int bpp = Traits::bytesPerPixel;
+        const __m128i low3 = _mm_set1_epi32(7);
+        const __m128i low8 = _mm_set1_epi32(0xff);
+        alignas(16) uint32_t index[4];
+        alignas(16) uint32_t pixel[4];
+        const int vectorWidth = width & ~3;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 4) {
+                __m128i p = load(row + xpos * bpp);
+                __m128i bin;
+                if (binning == Binning::Quantized) {
+                    __m128i r = _mm_and_si128(_mm_srli_epi32(p, Traits::r + 5), low3);
+                    __m128i g = _mm_and_si128(_mm_srli_epi32(p, Traits::g + 5), low3);
+                    __m128i b = _mm_and_si128(_mm_srli_epi32(p, Traits::b + 5), low3);
+                    bin = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 6), _mm_slli_epi32(g, 3)), b);
+                } else {
+                    __m128i r = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p, Traits::r), low8), _mm_set1_epi32(77));
+                    __m128i g = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p, Traits::g), low8), _mm_set1_epi32(150));
+                    __m128i b = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p, Traits::b), low8), _mm_set1_epi32(29));
+                    bin = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(r, g), b), 8);
+                }
+                _mm_store_si128((__m128i*)index, bin);
+                _mm_store_si128((__m128i*)pixel, p);
+                for (int k = 0; k < 4; k++) {
+                    HistogramBin& target = bins[index[k]];
+                    target.count++;
+                    target.r += (pixel[k] >> Traits::r) & 0xff;
+                    target.g += (pixel[k] >> Traits::g) & 0xff;
+                    target.b += (pixel[k] >> Traits::b) & 0xff;
+                }
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                addToBin<PixelLayout>(bins, loadPixel<PixelLayout>(row + xpos * bpp), binning);
+            }
+        }
+    }
+
+    static void weightedSums(const uint8_t* img, int imgwidth, int x, int y, int width, int height, uint64_t* sums) {
+        constexpr int bpp = Traits::bytesPerPixel;
+        const __m128i low8 = _mm_set1_epi32(0xff);
+        const __m128i one = _mm_set1_epi32(1);
+        const int vectorWidth = width & ~3;
+        for (int ypos = y; ypos < y + height; ypos++) {
+            __m128i accR = _mm_setzero_si128(), accG = _mm_setzero_si128(), accB = _mm_setzero_si128(), accW = _mm_setzero_si128();
+            const uint8_t* row = img + (static_cast<size_t>(ypos) * imgwidth + x) * bpp;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 4) {
+                __m128i p = load(row + xpos * bpp);
+                __m128i r = _mm_and_si128(_mm_srli_epi32(p, Traits::r), low8);
+                __m128i g = _mm_and_si128(_mm_srli_epi32(p, Traits::g), low8);
+                __m128i b = _mm_and_si128(_mm_srli_epi32(p, Traits::b), low8);
+                // SSE2 has no 32bit min/max, but with the upper 16 bits of every lane zero the 16bit ones give the same result
+                __m128i max = _mm_max_epi16(_mm_max_epi16(r, g), b);
+                __m128i min = _mm_min_epi16(_mm_min_epi16(r, g), b);
+                __m128i weight = _mm_add_epi32(_mm_sub_epi32(max, min), one);
+                accR = _mm_add_epi32(accR, _mm_madd_epi16(weight, r));
+                accG = _mm_add_epi32(accG, _mm_madd_epi16(weight, g));
+                accB = _mm_add_epi32(accB, _mm_madd_epi16(weight, b));
+                accW = _mm_add_epi32(accW, weight);
+            }
+            uint32_t lanes[4];
+            __m128i* accumulators[4] = {&accR, &accG, &accB, &accW};
+            for (int c = 0; c < 4; c++) {
+                _mm_storeu_si128((__m128i*)lanes, *accumulators[c]);
+                for (uint32_t lane : lanes) sums[c] += lane;
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                addWeighted<PixelLayout>(sums, loadPixel<PixelLayout>(row + xpos * bpp));
+            }
+        }
+    }
+};
+
+static std::tuple<uint8_t, uint8_t, uint8_t> averageOf(uint64_t r, uint64_t g, uint64_t b, uint64_t count) {
+    if (count == 0) {
+        return std::make_tuple(0, 0, 0);
+    }
+    return std::make_tuple(static_cast<uint8_t>(r / count), static_cast<uint8_t>(g / count), static_cast<uint8_t>(b / count));
+}
+
+template <typename SIMDType, typename PixelLayout>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockDominant(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins) {
+    std::fill(bins, bins + histogramBins, HistogramBin{});
+    ReducerImpl<SIMDType, PixelLayout>::fillBins(img, imgwidth, x, y, width, height, Binning::Quantized, bins);
+
+    // The average of the pixels in the fullest bin, so the result is an actual color of the zone rather than the bin center
+    const HistogramBin* dominant = std::max_element(bins, bins + histogramBins, [](const HistogramBin& a, const HistogramBin& b) { return a.count < b.count; });
+    return averageOf(dominant->r, dominant->g, dominant->b, dominant->count);
+}
+
+template <typename SIMDType, typename PixelLayout>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockSaturation(const uint8_t* img, int imgwidth, int x, int y, int width, int height) {
+    uint64_t sums[4] = {0, 0, 0, 0};
+    ReducerImpl<SIMDType, PixelLayout>::weightedSums(img, imgwidth, x, y, width, height, sums);
+    return averageOf(sums[0], sums[1], sums[2], sums[3]);
+}
+
+template <typename SIMDType, typename PixelLayout>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockTrimmed(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins) {
+    std::fill(bins, bins + 256, HistogramBin{});
+    ReducerImpl<SIMDType, PixelLayout>::fillBins(img, imgwidth, x, y, width, height, Binning::Luma, bins);
+
+    // Skip the darkest and brightest 10% of the pixels. Bins on the cut are taken in part, assuming their pixels average out to the bin's mean.
+    const uint64_t total = static_cast<uint64_t>(width) * height;
+    const double trim = total / 10.0;
+    const double keep = total - 2 * trim;
+    double skipped = 0, kept = 0;
+    double r = 0, g = 0, b = 0;
+    for (int i = 0; i < 256 && kept < keep; i++) {
+        const HistogramBin& bin = bins[i];
+        if (bin.count == 0) continue;
+        double available = bin.count;
+        double skip = std::min(available, trim - skipped);
+        skipped += skip;
+        double take = std::min(available - skip, keep - kept);
+        if (take <= 0) continue;
+        double share = take / bin.count;
+        r += bin.r * share;
+        g += bin.g * share;
+        b += bin.b * share;
+        kept += take;
+    }
+    if (kept <= 0) {
+        return std::make_tuple(0, 0, 0);
+    }
+    auto channel = [&](double sum) { return static_cast<uint8_t>(std::clamp(sum / kept, 0.0, 255.0)); };
+    return std::make_tuple(channel(r), channel(g), channel(b));
+}
+
+#define INSTANTIATE_REDUCERS(SIMDType, PixelLayout) \
+    template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockDominant<SIMDType, PixelLayout>(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins); \
+    template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockSaturation<SIMDType, PixelLayout>(const uint8_t* img, int imgwidth, int x, int y, int width, int height); \
+    template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockTrimmed<SIMDType, PixelLayout>(const uint8_t* img, int imgwidth, int x, int y, int width, int height, HistogramBin* bins);
+
+INSTANTIATE_REDUCERS(void, RGB24)
+INSTANTIATE_REDUCERS(SSE2, RGB24)
+INSTANTIATE_REDUCERS(void, BGRX32)
+INSTANTIATE_REDUCERS(SSE2, BGRX32)
+INSTANTIATE_REDUCERS(AVX2, RGB24)
+INSTANTIATE_REDUCERS(AVX2, BGRX32)
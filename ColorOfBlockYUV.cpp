@@ -0,0 +1,341 @@
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include "ColorOfBlock.hpp"
+
+template <typename SIMDType>
+struct SumOfBlockImpl {
+    // Every rowStride-th row and every colStride-th element (byte, byte pair or pixel pair) of a block is read
+    static uint64_t calculate(const uint8_t* plane, int stride, int x, int y, int width, int height, int rowStride, int colStride) {
+        uint64_t sum = 0;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride;
+            for (int xpos = x; xpos < x + width; xpos += colStride) {
+                sum += row[xpos];
+            }
+        }
+        return sum;
+    }
+
+    // Sums of the even and odd bytes of a block of an interleaved two channel plane. x and width are in byte pairs.
+    static void calculateInterleaved(const uint8_t* plane, int stride, int x, int y, int width, int height, uint64_t& even, uint64_t& odd, int rowStride, int colStride) {
+        even = 0;
+        odd = 0;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride;
+            for (int xpos = x; xpos < x + width; xpos += colStride) {
+                even += row[xpos * 2];
+                odd += row[xpos * 2 + 1];
+            }
+        }
+    }
+
+    // Sums of the Y, U and V bytes of a block of packed Y,U,Y,V pixel pairs. x and width are in pixel pairs.
+    static void calculatePacked422(const uint8_t* img, int stride, int x, int y, int width, int height, uint64_t& ySum, uint64_t& uSum, uint64_t& vSum, int rowStride, int colStride) {
+        ySum = 0;
+        uSum = 0;
+        vSum = 0;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = img + ypos * stride;
+            for (int xpos = x; xpos < x + width; xpos += colStride) {
+                ySum += row[xpos * 4] + row[xpos * 4 + 2];
+                uSum += row[xpos * 4 + 1];
+                vSum += row[xpos * 4 + 3];
+            }
+        }
+    }
+};
+
+// Specialization for AVX2
+template <>
+struct SumOfBlockImpl<AVX2> {
+    static uint64_t calculate(const uint8_t* plane, int stride, int x, int y, int width, int height, int rowStride, int colStride) {
+        if (colStride > 1) {
+            // Skipping columns doesn't fit the vector loads, and saves little memory traffic within a row anyway. Every kernel falls back like this.
+            return SumOfBlockImpl<void>::calculate(plane, stride, x, y, width, height, rowStride, colStride);
+        }
+        //_mm256_sad_epu8 against zero adds up groups of 8 bytes into 4 64bit lanes, so a single channel plane is summed 32 pixels at a time without any overflow concerns.
+        //A remainder of 16 or more is summed with one more 16 byte load, which matters for narrow zones and the half width chroma planes.
+        __m256i sum = _mm256_setzero_si256();
+        __m128i halfSum = _mm_setzero_si128();
+        uint64_t tail = 0;
+        const int vectorWidth = width & ~31;
+        const int halfWidth = width & ~15;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride + x;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 32) {
+                __m256i p = _mm256_loadu_si256((const __m256i*)&row[xpos]);
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(p, _mm256_setzero_si256()));
+            }
+            if (halfWidth > vectorWidth) {
+                __m128i p = _mm_loadu_si128((const __m128i*)&row[vectorWidth]);
+                halfSum = _mm_add_epi64(halfSum, _mm_sad_epu8(p, _mm_setzero_si128()));
+            }
+            for (int xpos = halfWidth; xpos < width; xpos++) {
+                tail += row[xpos];
+            }
+        }
+
+        uint64_t result[4];
+        _mm256_storeu_si256((__m256i*)result, sum);
+        uint64_t halfResult[2];
+        _mm_storeu_si128((__m128i*)halfResult, halfSum);
+        return result[0] + result[1] + result[2] + result[3] + halfResult[0] + halfResult[1] + tail;
+    }
+
+    static void calculateInterleaved(const uint8_t* plane, int stride, int x, int y, int width, int height, uint64_t& even, uint64_t& odd, int rowStride, int colStride) {
+        if (colStride > 1) {
+            SumOfBlockImpl<void>::calculateInterleaved(plane, stride, x, y, width, height, even, odd, rowStride, colStride);
+            return;
+        }
+        //Split 16 byte pairs into the low and high bytes of 16bit lanes, then sum both with _mm256_sad_epu8.
+        const __m256i lowMask = _mm256_set1_epi16(0x00ff);
+        __m256i evenSum = _mm256_setzero_si256();
+        __m256i oddSum = _mm256_setzero_si256();
+        even = 0;
+        odd = 0;
+        const int vectorWidth = width & ~15;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride + x * 2;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 16) {
+                __m256i p = _mm256_loadu_si256((const __m256i*)&row[xpos * 2]);
+                evenSum = _mm256_add_epi64(evenSum, _mm256_sad_epu8(_mm256_and_si256(p, lowMask), _mm256_setzero_si256()));
+                oddSum = _mm256_add_epi64(oddSum, _mm256_sad_epu8(_mm256_srli_epi16(p, 8), _mm256_setzero_si256()));
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                even += row[xpos * 2];
+                odd += row[xpos * 2 + 1];
+            }
+        }
+
+        uint64_t result[4];
+        _mm256_storeu_si256((__m256i*)result, evenSum);
+        even += result[0] + result[1] + result[2] + result[3];
+        _mm256_storeu_si256((__m256i*)result, oddSum);
+        odd += result[0] + result[1] + result[2] + result[3];
+    }
+
+    static void calculatePacked422(const uint8_t* img, int stride, int x, int y, int width, int height, uint64_t& ySum, uint64_t& uSum, uint64_t& vSum, int rowStride, int colStride) {
+        if (colStride > 1) {
+            SumOfBlockImpl<void>::calculatePacked422(img, stride, x, y, width, height, ySum, uSum, vSum, rowStride, colStride);
+            return;
+        }
+        //Each 32bit lane is one Y,U,Y,V pixel pair. Masking and shifting the lanes leaves only Y, U or V bytes, which _mm256_sad_epu8 sums 8 pairs at a time.
+        const __m256i lumaMask = _mm256_set1_epi16(0x00ff);
+        const __m256i byteMask = _mm256_set1_epi32(0xff);
+        __m256i yAcc = _mm256_setzero_si256();
+        __m256i uAcc = _mm256_setzero_si256();
+        __m256i vAcc = _mm256_setzero_si256();
+        ySum = 0;
+        uSum = 0;
+        vSum = 0;
+        const int vectorWidth = width & ~7;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = img + ypos * stride + x * 4;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 8) {
+                __m256i p = _mm256_loadu_si256((const __m256i*)&row[xpos * 4]);
+                yAcc = _mm256_add_epi64(yAcc, _mm256_sad_epu8(_mm256_and_si256(p, lumaMask), _mm256_setzero_si256()));
+                uAcc = _mm256_add_epi64(uAcc, _mm256_sad_epu8(_mm256_and_si256(_mm256_srli_epi32(p, 8), byteMask), _mm256_setzero_si256()));
+                vAcc = _mm256_add_epi64(vAcc, _mm256_sad_epu8(_mm256_srli_epi32(p, 24), _mm256_setzero_si256()));
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                ySum += row[xpos * 4] + row[xpos * 4 + 2];
+                uSum += row[xpos * 4 + 1];
+                vSum += row[xpos * 4 + 3];
+            }
+        }
+
+        uint64_t result[4];
+        _mm256_storeu_si256((__m256i*)result, yAcc);
+        ySum += result[0] + result[1] + result[2] + result[3];
+        _mm256_storeu_si256((__m256i*)result, uAcc);
+        uSum += result[0] + result[1] + result[2] + result[3];
+        _mm256_storeu_si256((__m256i*)result, vAcc);
+        vSum += result[0] + result[1] + result[2] + result[3];
+    }
+};
+
+// Specialization for SSE2
+template <>
+struct SumOfBlockImpl<SSE2> {
+    static uint64_t calculate(const uint8_t* plane, int stride, int x, int y, int width, int height, int rowStride, int colStride) {
+        if (colStride > 1) {
+            return SumOfBlockImpl<void>::calculate(plane, stride, x, y, width, height, rowStride, colStride);
+        }
+        //Same as the AVX2 version, 16 pixels at a time into 2 64bit lanes.
+        __m128i sum = _mm_setzero_si128();
+        uint64_t tail = 0;
+        const int vectorWidth = width & ~15;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride + x;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 16) {
+                __m128i p = _mm_loadu_si128((const __m128i*)&row[xpos]);
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(p, _mm_setzero_si128()));
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                tail += row[xpos];
+            }
+        }
+
+        uint64_t result[2];
+        _mm_storeu_si128((__m128i*)result, sum);
+        return result[0] + result[1] + tail;
+    }
+
+    static void calculateInterleaved(const uint8_t* plane, int stride, int x, int y, int width, int height, uint64_t& even, uint64_t& odd, int rowStride, int colStride) {
+        if (colStride > 1) {
+            SumOfBlockImpl<void>::calculateInterleaved(plane, stride, x, y, width, height, even, odd, rowStride, colStride);
+            return;
+        }
+        const __m128i lowMask = _mm_set1_epi16(0x00ff);
+        __m128i evenSum = _mm_setzero_si128();
+        __m128i oddSum = _mm_setzero_si128();
+        even = 0;
+        odd = 0;
+        const int vectorWidth = width & ~7;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = plane + ypos * stride + x * 2;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 8) {
+                __m128i p = _mm_loadu_si128((const __m128i*)&row[xpos * 2]);
+                evenSum = _mm_add_epi64(evenSum, _mm_sad_epu8(_mm_and_si128(p, lowMask), _mm_setzero_si128()));
+                oddSum = _mm_add_epi64(oddSum, _mm_sad_epu8(_mm_srli_epi16(p, 8), _mm_setzero_si128()));
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                even += row[xpos * 2];
+                odd += row[xpos * 2 + 1];
+            }
+        }
+
+        uint64_t result[2];
+        _mm_storeu_si128((__m128i*)result, evenSum);
+        even += result[0] + result[1];
+        _mm_storeu_si128((__m128i*)result, oddSum);
+        odd += result[0] + result[1];
+    }
+
+    static void calculatePacked422(const uint8_t* img, int stride, int x, int y, int width, int height, uint64_t& ySum, uint64_t& uSum, uint64_t& vSum, int rowStride, int colStride) {
+        if (colStride > 1) {
+            SumOfBlockImpl<void>::calculatePacked422(img, stride, x, y, width, height, ySum, uSum, vSum, rowStride, colStride);
+            return;
+        }
+        const __m128i lumaMask = _mm_set1_epi16(0x00ff);
+        const __m128i byteMask = _mm_set1_epi32(0xff);
+        __m128i yAcc = _mm_setzero_si128();
+        __m128i uAcc = _mm_setzero_si128();
+        __m128i vAcc = _mm_setzero_si128();
+        ySum = 0;
+        uSum = 0;
+        vSum = 0;
+        const int vectorWidth = width & ~3;
+        for (int ypos = y; ypos < y + height; ypos += rowStride) {
+            const uint8_t* row = img + ypos * stride + x * 4;
+            for (int xpos = 0; xpos < vectorWidth; xpos += 4) {
+                __m128i p = _mm_loadu_si128((const __m128i*)&row[xpos * 4]);
+                yAcc = _mm_add_epi64(yAcc, _mm_sad_epu8(_mm_and_si128(p, lumaMask), _mm_setzero_si128()));
+                uAcc = _mm_add_epi64(uAcc, _mm_sad_epu8(_mm_and_si128(_mm_srli_epi32(p, 8), byteMask), _mm_setzero_si128()));
+                vAcc = _mm_add_epi64(vAcc, _mm_sad_epu8(_mm_srli_epi32(p, 24), _mm_setzero_si128()));
+            }
+            for (int xpos = vectorWidth; xpos < width; xpos++) {
+                ySum += row[xpos * 4] + row[xpos * 4 + 2];
+                uSum += row[xpos * 4 + 1];
+                vSum += row[xpos * 4 + 3];
+            }
+        }
+
+        uint64_t result[2];
+        _mm_storeu_si128((__m128i*)result, yAcc);
+        ySum += result[0] + result[1];
+        _mm_storeu_si128((__m128i*)result, uAcc);
+        uSum += result[0] + result[1];
+        _mm_storeu_si128((__m128i*)result, vAcc);
+        vSum += result[0] + result[1];
+    }
+};
+
+// BT.601 limited range conversion. It is affine, so converting the averaged Y,Cb,Cr gives the same result as averaging converted pixels (apart from clamping).
+static std::tuple<uint8_t, uint8_t, uint8_t> limitedRangeToRgb(double y, double cb, double cr) {
+    y = 1.164 * (y - 16.0);
+    cb -= 128.0;
+    cr -= 128.0;
+    auto clamp = [](double v) { return static_cast<uint8_t>(std::clamp(v + 0.5, 0.0, 255.0)); };
+    return std::make_tuple(clamp(y + 1.596 * cr), clamp(y - 0.392 * cb - 0.813 * cr), clamp(y + 2.017 * cb));
+}
+
+// BT.601 full range conversion, as used by JPEG (JFIF)
+static std::tuple<uint8_t, uint8_t, uint8_t> fullRangeToRgb(double y, double cb, double cr) {
+    cb -= 128.0;
+    cr -= 128.0;
+    auto clamp = [](double v) { return static_cast<uint8_t>(std::clamp(v + 0.5, 0.0, 255.0)); };
+    return std::make_tuple(clamp(y + 1.402 * cr), clamp(y - 0.344136 * cb - 0.714136 * cr), clamp(y + 1.772 * cb));
+}
+
+template <typename SIMDType>
+uint64_t sumOfBlock(const uint8_t* plane, int stride, int x, int y, int width, int height) {
+    return SumOfBlockImpl<SIMDType>::calculate(plane, stride, x, y, width, height, 1, 1);
+}
+
+// Number of elements read from length elements, when only every stride-th one is
+static int sampled(int length, int stride) {
+    return (length + stride - 1) / stride;
+}
+
+template <typename SIMDType>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockNV12(const uint8_t* luma, int lumaStride, const uint8_t* chroma, int chromaStride, int x, int y, int width, int height,
+                                                       int rowStride, int colStride) {
+    uint64_t lumaSum = SumOfBlockImpl<SIMDType>::calculate(luma, lumaStride, x, y, width, height, rowStride, colStride);
+
+    // The chroma block covers every chroma sample that touches the luma block
+    int chromaX = x / 2, chromaY = y / 2;
+    int chromaWidth = std::max(1, (x + width + 1) / 2 - chromaX);
+    int chromaHeight = std::max(1, (y + height + 1) / 2 - chromaY);
+    uint64_t cbSum, crSum;
+    SumOfBlockImpl<SIMDType>::calculateInterleaved(chroma, chromaStride, chromaX, chromaY, chromaWidth, chromaHeight, cbSum, crSum, rowStride, colStride);
+
+    double lumaPixels = static_cast<double>(sampled(width, colStride)) * sampled(height, rowStride);
+    double chromaPixels = static_cast<double>(sampled(chromaWidth, colStride)) * sampled(chromaHeight, rowStride);
+    return limitedRangeToRgb(lumaSum / lumaPixels, cbSum / chromaPixels, crSum / chromaPixels);
+}
+
+template <typename SIMDType>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYUYV(const uint8_t* img, int stride, int x, int y, int width, int height, int rowStride, int colStride) {
+    // Pixels share their chroma with the other pixel of their pair, so the block is widened to whole pairs
+    int pairX = x / 2;
+    int pairWidth = std::max(1, (x + width + 1) / 2 - pairX);
+    uint64_t ySum, uSum, vSum;
+    SumOfBlockImpl<SIMDType>::calculatePacked422(img, stride, pairX, y, pairWidth, height, ySum, uSum, vSum, rowStride, colStride);
+
+    double pairs = static_cast<double>(sampled(pairWidth, colStride)) * sampled(height, rowStride);
+    return limitedRangeToRgb(ySum / (pairs * 2), uSum / pairs, vSum / pairs);
+}
+
+template <typename SIMDType>
+std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYCbCr(const uint8_t* luma, int lumaStride, const uint8_t* cb, const uint8_t* cr, int chromaStride, int scaleX, int scaleY,
+                                                        int x, int y, int width, int height, int rowStride, int colStride) {
+    const double lumaMean = static_cast<double>(SumOfBlockImpl<SIMDType>::calculate(luma, lumaStride, x, y, width, height, rowStride, colStride)) /
+                            (static_cast<double>(sampled(width, colStride)) * sampled(height, rowStride));
+    if (cb == nullptr) {
+        return fullRangeToRgb(lumaMean, 128.0, 128.0);
+    }
+
+    // Like NV12, every chroma sample that touches the luma block counts, only here the planes are separate and the subsampling varies
+    int chromaX = x / scaleX, chromaY = y / scaleY;
+    int chromaWidth = std::max(1, (x + width + scaleX - 1) / scaleX - chromaX);
+    int chromaHeight = std::max(1, (y + height + scaleY - 1) / scaleY - chromaY);
+    double chromaPixels = static_cast<double>(sampled(chromaWidth, colStride)) * sampled(chromaHeight, rowStride);
+    uint64_t cbSum = SumOfBlockImpl<SIMDType>::calculate(cb, chromaStride, chromaX, chromaY, chromaWidth, chromaHeight, rowStride, colStride);
+    uint64_t crSum = SumOfBlockImpl<SIMDType>::calculate(cr, chromaStride, chromaX, chromaY, chromaWidth, chromaHeight, rowStride, colStride);
+    return fullRangeToRgb(lumaMean, cbSum / chromaPixels, crSum / chromaPixels);
+}
+
+template uint64_t sumOfBlock<void>(const uint8_t* plane, int stride, int x, int y, int width, int height);
+template uint64_t sumOfBlock<SSE2>(const uint8_t* plane, int stride, int x, int y, int width, int height);
+template uint64_t sumOfBlock<AVX2>(const uint8_t* plane, int stride, int x, int y, int width, int height);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockNV12<void>(const uint8_t* luma, int lumaStride, const uint8_t* chroma, int chromaStride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockNV12<SSE2>(const uint8_t* luma, int lumaStride, const uint8_t* chroma, int chromaStride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockNV12<AVX2>(const uint8_t* luma, int lumaStride, const uint8_t* chroma, int chromaStride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYUYV<void>(const uint8_t* img, int stride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYUYV<SSE2>(const uint8_t* img, int stride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYUYV<AVX2>(const uint8_t* img, int stride, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYCbCr<void>(const uint8_t* luma, int lumaStride, const uint8_t* cb, const uint8_t* cr, int chromaStride, int scaleX, int scaleY, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYCbCr<SSE2>(const uint8_t* luma, int lumaStride, const uint8_t* cb, const uint8_t* cr, int chromaStride, int scaleX, int scaleY, int x, int y, int width, int height, int rowStride, int colStride);
+template std::tuple<uint8_t, uint8_t, uint8_t> colorOfBlockYCbCr<AVX2>(const uint8_t* luma, int lumaStride, const uint8_t* cb, const uint8_t* cr, int chromaStride, int scaleX, int scaleY, int x, int y, int width, int height, int rowStride, int colStride);
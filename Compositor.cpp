@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include "Compositor.h"
+
+Compositor::Compositor(size_t sourceCount, int64_t timeoutUs) : timeoutUs(timeoutUs), sources(sourceCount) {
+    if (timeoutUs < 1) {
+        throw std::invalid_argument("Source timeout must be greater than 0");
+    }
+}
+
+void Compositor::setLeds(size_t source, std::vector<size_t> leds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Source& target = sources.at(source);
+    target.colors.assign(leds.size() * 3, 0);
+    target.leds = std::move(leds);
+    target.updatedUs = 0;
+}
+
+void Compositor::update(size_t source, const uint8_t* colors, size_t length, int64_t nowUs) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Source& target = sources.at(source);
+        // Colors extracted for an older assignment of LEDs are dropped, the next frame has the right ones
+        if (length != target.colors.size()) {
+            return;
+        }
+        std::memcpy(target.colors.data(), colors, length);
+        target.updatedUs = nowUs;
+        updated = true;
+    }
+    condition.notify_one();
+}
+
+bool Compositor::wait(int64_t waitUs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const bool result = condition.wait_for(lock, std::chrono::microseconds(waitUs), [this] { return updated; });
+    updated = false;
+    return result;
+}
+
+void Compositor::compose(int64_t nowUs, uint8_t* ledData, size_t length) {
+    std::memset(ledData, 0, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Source& source : sources) {
+        // Full brightness until the timeout, then a linear fade to black over another timeout. Weights are 8.8 fixed point.
+        const int64_t age = source.updatedUs == 0 ? 2 * timeoutUs : nowUs - source.updatedUs;
+        const uint32_t weight = static_cast<uint32_t>(256 - std::clamp<int64_t>((age - timeoutUs) * 256 / timeoutUs, 0, 256));
+        if (weight == 0) {
+            continue;
+        }
+        for (size_t i = 0; i < source.leds.size(); i++) {
+            const size_t offset = source.leds[i] * 3;
+            if (offset + 3 > length) {
+                continue;
+            }
+            for (size_t c = 0; c < 3; c++) {
+                ledData[offset + c] = static_cast<uint8_t>((source.colors[i * 3 + c] * weight + 128) >> 8);
+            }
+        }
+    }
+}
+
+bool Compositor::isStale(size_t source, int64_t nowUs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Source& target = sources.at(source);
+    return target.updatedUs == 0 || nowUs - target.updatedUs > timeoutUs;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+// Merges the LED colors of several capture sources, each driving its own LEDs of the layout, into one frame.
+// Sources update from their own threads; the output side waits for an update and composes a frame from the newest colors of every source.
+// A source that hasn't updated for timeoutUs is stale: its LEDs keep their last colors for that long, then fade to black over another timeoutUs.
+class Compositor {
+    struct Source {
+        std::vector<size_t> leds;    // LED indices driven by this source, in the order of its colors
+        std::vector<uint8_t> colors; // Newest colors, 3 bytes per entry of leds
+        int64_t updatedUs = 0;       // When colors were last updated, 0 if never
+    };
+
+    const int64_t timeoutUs;
+    std::vector<Source> sources;
+    bool updated = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+public:
+    Compositor(size_t sourceCount, int64_t timeoutUs);
+
+    // Assign LEDs to a source, resetting its colors. LEDs no source drives stay black.
+    void setLeds(size_t source, std::vector<size_t> leds);
+
+    // New colors of a source, 3 bytes for each of its LEDs, at nowUs (on CLOCK_MONOTONIC)
+    void update(size_t source, const uint8_t* colors, size_t length, int64_t nowUs);
+
+    // Wait until a source updated or waitUs passed. Returns false on timeout.
+    bool wait(int64_t waitUs);
+
+    // Write the frame for time nowUs into ledData, length bytes
+    void compose(int64_t nowUs, uint8_t* ledData, size_t length);
+
+    // If a source missed its timeout at nowUs
+    bool isStale(size_t source, int64_t nowUs);
+};
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include "Config.h"
+
+std::vector<std::string> Config::restartRequired(const Config& other) const {
+    std::vector<std::string> changed;
+    auto check = [&](const char* key, bool differs) {
+        if (differs) {
+            changed.emplace_back(key);
+        }
+    };
+    check("mode", mode != other.mode);
+    check("capture_device", capture_device != other.capture_device);
+    check("capture_format", capture_format != other.capture_format);
+    check("capture_width", capture_width != other.capture_width);
+    check("capture_height", capture_height != other.capture_height);
+    check("capture_fps", capture_fps != other.capture_fps);
+    check("v4l2_buffer_count", v4l2_buffer_count != other.v4l2_buffer_count);
+    check("capture_sources", capture_sources != other.capture_sources);
+    check("source_timeout", source_timeout != other.source_timeout);
+    check("decode_threads", decode_threads != other.decode_threads);
+    check("decode_cpus", decode_cpus != other.decode_cpus);
+    check("decode_split", decode_split != other.decode_split);
+    check("port", port != other.port);
+    check("pipe_path", pipe_path != other.pipe_path);
+    check("pipe_format", pipe_format != other.pipe_format);
+    check("pipe_width", pipe_width != other.pipe_width);
+    check("pipe_height", pipe_height != other.pipe_height);
+    check("control_socket", control_socket != other.control_socket);
+    check("rt_policy", rt_policy != other.rt_policy);
+    check("rt_priority", rt_priority != other.rt_priority);
+    check("rt_runtime", rt_runtime != other.rt_runtime);
+    check("capture_cpu", capture_cpu != other.capture_cpu);
+    check("serial_cpus", serial_cpus != other.serial_cpus);
+    check("lock_memory", lock_memory != other.lock_memory);
+    check("flight_recorder", flight_recorder != other.flight_recorder);
+    check("flight_recorder_size", flight_recorder_size != other.flight_recorder_size);
+    check("flight_recorder_delta", flight_recorder_delta != other.flight_recorder_delta);
+    return changed;
+}
+
+ThreadSchedule Config::threadSchedule(ThreadRole role) const {
+    ThreadSchedule schedule;
+    if (rt_policy == "off") {
+        return schedule;
+    }
+    schedule.policy = ThreadSchedule::Policy::Fifo;
+    // A finished frame should go out before the next one is processed
+    schedule.priority = role == ThreadRole::Serial ? std::min(rt_priority + 1, 99) : rt_priority;
+    if (rt_policy == "deadline" && role == ThreadRole::Capture) {
+        schedule.policy = ThreadSchedule::Policy::Deadline;
+        schedule.periodUs = 1000000 / (capture_fps > 0 ? capture_fps : 60);
+        schedule.runtimeUs = rt_runtime > 0 ? std::min<int64_t>(rt_runtime, schedule.periodUs) : schedule.periodUs / 2;
+    }
+    return schedule;
+}
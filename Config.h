@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Realtime.h"
+
+// Typed settings from the config file. ConfigParser checks that everything the selected mode needs is present and in range,
+// so the modes can use the values directly.
+struct Config {
+    std::string mode;
+
+    // LED chain and outputs
+    int vertical_leds = 0;
+    int horizontal_leds = 0;
+    std::string serial_port;
+    int baud = 0;
+    std::string serial_segments;
+    bool serial_calibrate = true;
+    std::string outputs; // Network nodes and files, alongside or instead of the serial ports
+    int output_fps = 0; // Send at this rate, fading between captured frames. 0 sends every captured frame as it is.
+
+    // Color extraction
+    int border_size = 0;
+    double gamma_correction = 1.0;
+    int averaging_samples = 1;
+    std::string zone_mode = "mean"; // mean, dominant, saturation or trimmed
+    int sample_rows = 1;            // Read every n-th row of a zone
+    int sample_cols = 1;            // Read every n-th pair of pixels of a row
+    std::string jpeg_decode = "yuv"; // MJPEG frames are decoded to their YCbCr planes (yuv), or to packed RGB (rgb)
+    int extract_threads = 1;
+    std::vector<int> extract_cpus;
+    bool letterbox_detect = false; // Move the zones to the picture inside black bars
+    int letterbox_interval = 10;   // Frames between two checks
+    int letterbox_threshold = 24;  // Brightest channel value that still counts as black
+
+    // v4l2 mode. capture_width, capture_height and capture_fps are the minimum the selected capture mode has to reach.
+    std::string capture_device;
+    std::string capture_format = "auto"; // auto, mjpeg, yuyv, nv12 or bgrx
+    int capture_width = 0;
+    int capture_height = 0;
+    int capture_fps = 0;
+    int v4l2_buffer_count = 4;
+    bool capture_latest = false; // Skip to the newest captured frame instead of processing the queued ones in order
+    int sleep_after = 600;
+    int sleep_fps = 1; // Capture rate while the input is blank
+    std::string capture_sources; // Several devices on one canvas, replaces capture_device
+    int source_timeout = 500;    // ms without a frame until a source's LEDs fade out
+    int hotplug_fade = 0;        // ms to fade the LEDs out while the capture device is gone, 0 keeps the last colors
+    int decode_threads = 1;      // MJPEG frames decoded in parallel, 1 decodes on the capture thread
+    std::vector<int> decode_cpus;
+    int decode_split = 1;        // Threads decoding one MJPEG frame in strips, v4l2 and pipe modes
+
+    // network mode
+    int port = 0;
+    std::string io_engine = "blocking"; // blocking or io_uring
+
+    // pipe mode
+    std::string pipe_path = "-";
+    std::string pipe_format;
+    int pipe_width = 0;
+    int pipe_height = 0;
+
+    // Path of the Unix socket accepting live config changes, disabled if empty
+    std::string control_socket;
+
+    // Real-time profile, for the v4l2 and pipe modes
+    std::string rt_policy = "off"; // off, fifo or deadline
+    int rt_priority = 50;          // SCHED_FIFO priority of the capture and extraction threads, the serial writers get one more
+    int rt_runtime = 0;            // SCHED_DEADLINE budget of the capture thread per frame in us, 0 for half the frame time
+    int capture_cpu = -1;          // Pin the capture (and decode) thread, -1 for any core
+    std::vector<int> serial_cpus;  // Pin the serial writer threads, in the order of the segments
+    bool lock_memory = false;      // mlockall() and pre-fault the frame buffers
+
+    // Flight recorder, for the v4l2 and pipe modes
+    std::string flight_recorder;       // Path of the recording, disabled if empty
+    int flight_recorder_size = 16;     // Size of the ring in MB
+    bool flight_recorder_delta = true; // Store frames as changes to the previous one
+
+    size_t ledCount() const { return static_cast<size_t>(vertical_leds + horizontal_leds) * 2; }
+
+    // Settings that can't be applied to a running capture stream, and which of them differ from other
+    std::vector<std::string> restartRequired(const Config& other) const;
+
+    enum class ThreadRole { Capture, Extract, Serial };
+    // Scheduling of a pipeline thread under the real-time profile. Only the capture thread uses SCHED_DEADLINE, the others SCHED_FIFO.
+    ThreadSchedule threadSchedule(ThreadRole role) const;
+};
@@ -1,8 +1,17 @@
 #include <fstream>
+#include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <set>
+#include <sched.h>
+#include <unistd.h>
 #include "ConfigParser.h"
 
-std::map<std::string, std::string> ConfigParser::parse(const std::string& filename)  {
+Config ConfigParser::parse(const std::string& filename) {
+    return fromValues(parseValues(filename));
+}
+
+std::map<std::string, std::string> ConfigParser::parseValues(const std::string& filename)  {
     std::ifstream file(filename);
     if (!file.is_open()) {
         throw std::runtime_error("Error opening file: " + filename);
@@ -28,6 +37,251 @@ std::map<std::string, std::string> ConfigParser::parse(const std::string& filena
     return configMap;
 }
 
+namespace {
+    // Typed access to the raw values. Missing keys keep the default already in the Config, unless required.
+    class ValueReader {
+        const std::map<std::string, std::string>& values;
+    public:
+        explicit ValueReader(const std::map<std::string, std::string>& values) : values(values) {}
+
+        bool has(const std::string& key) const {
+            auto it = values.find(key);
+            return it != values.end() && !it->second.empty();
+        }
+
+        void read(const std::string& key, std::string& target, bool required = false) const {
+            if (has(key)) {
+                target = values.at(key);
+            } else if (required) {
+                throw std::runtime_error("Missing config key: " + key);
+            }
+        }
+
+        void read(const std::string& key, int& target, bool required = false, int min = 1) const {
+            if (!has(key)) {
+                if (required) {
+                    throw std::runtime_error("Missing config key: " + key);
+                }
+                return;
+            }
+            const std::string& value = values.at(key);
+            size_t end = 0;
+            try {
+                target = std::stoi(value, &end);
+            }
+            catch (const std::logic_error&) {
+                end = 0;
+            }
+            if (end != value.size() || target < min) {
+                throw std::runtime_error("Invalid value for " + key + ": " + value);
+            }
+        }
+
+        void read(const std::string& key, double& target, bool required = false) const {
+            if (!has(key)) {
+                if (required) {
+                    throw std::runtime_error("Missing config key: " + key);
+                }
+                return;
+            }
+            const std::string& value = values.at(key);
+            size_t end = 0;
+            try {
+                target = std::stod(value, &end);
+            }
+            catch (const std::logic_error&) {
+                end = 0;
+            }
+            if (end != value.size() || !(target > 0)) {
+                throw std::runtime_error("Invalid value for " + key + ": " + value);
+            }
+        }
+
+        void read(const std::string& key, bool& target) const {
+            if (has(key)) {
+                target = values.at(key) != "0";
+            }
+        }
+    };
+
+    const std::set<std::string> knownKeys = {
+        "mode", "vertical_leds", "horizontal_leds", "serial_port", "baud", "serial_segments", "serial_calibrate", "outputs", "output_fps",
+        "border_size", "gamma_correction", "averaging_samples", "zone_mode", "sample_rows", "sample_cols", "jpeg_decode",
+        "extract_threads", "extract_cpus",
+        "letterbox_detect", "letterbox_interval", "letterbox_threshold",
+        "capture_device", "capture_format", "capture_width", "capture_height", "capture_fps", "v4l2_buffer_count", "capture_latest", "sleep_after", "sleep_fps",
+        "capture_sources", "source_timeout", "hotplug_fade", "decode_threads", "decode_cpus", "decode_split",
+        "port", "io_engine", "pipe_path", "pipe_format", "pipe_width", "pipe_height", "control_socket",
+        "rt_policy", "rt_priority", "rt_runtime", "capture_cpu", "serial_cpus", "lock_memory",
+        "flight_recorder", "flight_recorder_size", "flight_recorder_delta",
+    };
+}
+
+Config ConfigParser::fromValues(const std::map<std::string, std::string>& values) {
+    for (const auto& [key, value] : values) {
+        if (knownKeys.count(key) == 0) {
+            std::cout << "Ignoring unknown config key: " << key << std::endl;
+        }
+    }
+
+    const ValueReader reader(values);
+    Config config;
+    reader.read("mode", config.mode, true);
+    if (config.mode != "v4l2" && config.mode != "network" && config.mode != "pipe") {
+        throw std::runtime_error("Invalid mode: " + config.mode);
+    }
+
+    // Every mode drives LEDs over serial, network nodes or both
+    reader.read("vertical_leds", config.vertical_leds, true);
+    reader.read("horizontal_leds", config.horizontal_leds, true);
+    reader.read("serial_segments", config.serial_segments);
+    reader.read("outputs", config.outputs);
+    reader.read("serial_port", config.serial_port, config.serial_segments.empty() && config.outputs.empty());
+    reader.read("baud", config.baud, config.serial_segments.empty() && !config.serial_port.empty());
+    reader.read("serial_calibrate", config.serial_calibrate);
+    reader.read("output_fps", config.output_fps, false, 0);
+    reader.read("control_socket", config.control_socket);
+
+    // Color extraction, for the modes that look at images themselves
+    const bool capturing = config.mode != "network";
+    reader.read("border_size", config.border_size, capturing);
+    reader.read("gamma_correction", config.gamma_correction);
+    reader.read("averaging_samples", config.averaging_samples);
+    reader.read("zone_mode", config.zone_mode);
+    if (config.zone_mode != "mean" && config.zone_mode != "dominant" && config.zone_mode != "saturation" && config.zone_mode != "trimmed") {
+        throw std::runtime_error("Invalid value for zone_mode: " + config.zone_mode);
+    }
+    reader.read("sample_rows", config.sample_rows);
+    reader.read("sample_cols", config.sample_cols);
+    reader.read("jpeg_decode", config.jpeg_decode);
+    if (config.jpeg_decode != "yuv" && config.jpeg_decode != "rgb") {
+        throw std::runtime_error("Invalid value for jpeg_decode: " + config.jpeg_decode);
+    }
+    reader.read("extract_threads", config.extract_threads);
+    reader.read("letterbox_detect", config.letterbox_detect);
+    reader.read("letterbox_interval", config.letterbox_interval);
+    reader.read("letterbox_threshold", config.letterbox_threshold, false, 0);
+    if (reader.has("extract_cpus")) {
+        config.extract_cpus = parseCpuList(values, "extract_cpus");
+    }
+
+    // Real-time profile
+    reader.read("rt_policy", config.rt_policy);
+    if (config.rt_policy != "off" && config.rt_policy != "fifo" && config.rt_policy != "deadline") {
+        throw std::runtime_error("Invalid value for rt_policy: " + config.rt_policy);
+    }
+    reader.read("rt_priority", config.rt_priority);
+    if (config.rt_priority > 99) {
+        throw std::runtime_error("Invalid value for rt_priority: " + values.at("rt_priority"));
+    }
+    reader.read("rt_runtime", config.rt_runtime, false, 0);
+    reader.read("capture_cpu", config.capture_cpu, false, 0);
+    reader.read("lock_memory", config.lock_memory);
+    if (reader.has("serial_cpus")) {
+        config.serial_cpus = parseCpuList(values, "serial_cpus");
+    }
+
+    // Flight recorder
+    reader.read("flight_recorder", config.flight_recorder);
+    reader.read("flight_recorder_size", config.flight_recorder_size);
+    reader.read("flight_recorder_delta", config.flight_recorder_delta);
+
+    if (config.mode == "v4l2") {
+        reader.read("capture_sources", config.capture_sources);
+        reader.read("capture_device", config.capture_device, config.capture_sources.empty());
+        reader.read("source_timeout", config.source_timeout);
+        reader.read("capture_format", config.capture_format);
+        if (config.capture_format != "auto" && config.capture_format != "mjpeg" && config.capture_format != "yuyv" && config.capture_format != "nv12" && config.capture_format != "bgrx") {
+            throw std::runtime_error("Invalid value for capture_format: " + config.capture_format);
+        }
+        reader.read("capture_width", config.capture_width, true);
+        reader.read("capture_height", config.capture_height, true);
+        reader.read("capture_fps", config.capture_fps, true);
+        reader.read("v4l2_buffer_count", config.v4l2_buffer_count);
+        reader.read("capture_latest", config.capture_latest);
+        reader.read("sleep_after", config.sleep_after);
+        reader.read("sleep_fps", config.sleep_fps);
+        reader.read("hotplug_fade", config.hotplug_fade, false, 0);
+        reader.read("decode_threads", config.decode_threads);
+        if (reader.has("decode_cpus")) {
+            config.decode_cpus = parseCpuList(values, "decode_cpus");
+        }
+        reader.read("decode_split", config.decode_split);
+    }
+    else if (config.mode == "network") {
+        reader.read("port", config.port, true);
+        if (config.port > 65535) {
+            throw std::runtime_error("Invalid value for port: " + values.at("port"));
+        }
+        reader.read("io_engine", config.io_engine);
+        if (config.io_engine != "blocking" && config.io_engine != "io_uring") {
+            throw std::runtime_error("Invalid value for io_engine: " + config.io_engine);
+        }
+    }
+    else if (config.mode == "pipe") {
+        reader.read("pipe_path", config.pipe_path);
+        reader.read("pipe_format", config.pipe_format, true);
+        if (config.pipe_format != "rgb24" && config.pipe_format != "bgr0" && config.pipe_format != "nv12" && config.pipe_format != "yuyv422" && config.pipe_format != "mjpeg") {
+            throw std::runtime_error("Invalid value for pipe_format: " + config.pipe_format);
+        }
+        // MJPEG frames carry their own size
+        const bool raw = config.pipe_format != "mjpeg";
+        reader.read("pipe_width", config.pipe_width, raw);
+        reader.read("pipe_height", config.pipe_height, raw);
+        reader.read("decode_split", config.decode_split);
+        if (config.pipe_format == "nv12" && (config.pipe_width % 2 != 0 || config.pipe_height % 2 != 0)) {
+            throw std::runtime_error("nv12 frames must have an even width and height");
+        }
+        if (config.pipe_format == "yuyv422" && config.pipe_width % 2 != 0) {
+            throw std::runtime_error("yuyv422 frames must have an even width");
+        }
+    }
+
+    // The zones of opposite edges can't overlap. The frame size is known up front, except for MJPEG pipes.
+    const int pictureWidth = config.mode == "v4l2" ? config.capture_width : config.pipe_width;
+    const int pictureHeight = config.mode == "v4l2" ? config.capture_height : config.pipe_height;
+    if (capturing && pictureWidth > 0 && pictureHeight > 0 && config.border_size * 2 > std::min(pictureWidth, pictureHeight)) {
+        throw std::runtime_error("Invalid value for border_size: " + values.at("border_size") + ", it can't be more than half of the picture");
+    }
+
+    return config;
+}
+
+std::vector<int> ConfigParser::parseIntList(const std::string& value) {
+    std::vector<int> result;
+    size_t start = 0;
+    while (start < value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        std::string item = value.substr(start, end - start);
+        trim(item);
+        if (!item.empty()) {
+            result.push_back(std::stoi(item));
+        }
+        start = end + 1;
+    }
+    return result;
+}
+
+std::vector<int> ConfigParser::parseCpuList(const std::map<std::string, std::string>& values, const std::string& key) {
+    std::vector<int> cpus;
+    try {
+        cpus = parseIntList(values.at(key));
+    }
+    catch (const std::logic_error&) {
+        throw std::runtime_error("Invalid value for " + key + ": " + values.at(key));
+    }
+    const long cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu : cpus) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE || (cpuCount > 0 && cpu >= cpuCount)) {
+            throw std::runtime_error("Invalid value for " + key + ": " + values.at(key) + ", there is no CPU " + std::to_string(cpu));
+        }
+    }
+    return cpus;
+}
+
 void ConfigParser::trim(std::string& s) {
     s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) { return !std::isspace(ch); }));
     s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) { return !std::isspace(ch); }).base(), s.end());
@@ -1,9 +1,19 @@
 #pragma once
 #include <string>
 #include <map>
+#include <vector>
+#include "Config.h"
 
 class ConfigParser {
-    static void trim(std::string& s);
 public:
-    static std::map<std::string, std::string> parse(const std::string& filename);
+    // Read and validate a config file. Throws std::runtime_error naming the offending key if a value is missing or invalid.
+    static Config parse(const std::string& filename);
+    // The raw key: value pairs of a config file
+    static std::map<std::string, std::string> parseValues(const std::string& filename);
+    // Validate raw values, as read from a file or changed through the control socket
+    static Config fromValues(const std::map<std::string, std::string>& values);
+    static std::vector<int> parseIntList(const std::string& value); // Comma separated list, like "2,3"
+    // A list of CPUs to pin threads to. Throws std::runtime_error naming key if one of them doesn't exist.
+    static std::vector<int> parseCpuList(const std::map<std::string, std::string>& values, const std::string& key);
+    static void trim(std::string& s); // Strip surrounding whitespace
 };
@@ -0,0 +1,239 @@
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+#include "ConfigParser.h"
+#include "ConfigWatcher.h"
+
+ConfigWatcher::ConfigWatcher(const std::string& path, const Config& config) : path(path), socketPath(config.control_socket) {
+    values = ConfigParser::parseValues(path);
+    appliedValues = values;
+
+    // Watch the directory instead of the file, editors usually save by writing a new file and renaming it over the old one
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    if (directory.empty()) {
+        directory = "/";
+    }
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd == -1 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        std::cout << "Can't watch " << path << " for changes: " << strerror(errno) << std::endl;
+        if (inotifyFd != -1) {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+    }
+
+    if (!socketPath.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("control_socket path is too long: " + socketPath);
+        }
+        std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        socketFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (socketFd == -1) {
+            throw std::runtime_error("Error creating control socket");
+        }
+        unlink(socketPath.c_str()); // Left over from a previous run
+        if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || listen(socketFd, 4) == -1) {
+            close(socketFd);
+            throw std::runtime_error("Error binding control socket " + socketPath + ": " + strerror(errno));
+        }
+    }
+
+    if (pipe2(wakePipe, O_CLOEXEC) == -1) {
+        throw std::runtime_error("Error creating pipe");
+    }
+    thread = std::thread(&ConfigWatcher::run, this);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    char wake = 0;
+    (void)!write(wakePipe[1], &wake, 1);
+    thread.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    if (inotifyFd != -1) {
+        close(inotifyFd);
+    }
+    if (socketFd != -1) {
+        close(socketFd);
+        unlink(socketPath.c_str());
+    }
+}
+
+std::optional<Config> ConfigWatcher::takeUpdate() {
+    if (!hasPending.load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    hasPending = false;
+    std::optional<Config> update = std::move(pending);
+    pending.reset();
+    takenSequence = publishedSequence;
+    takenValues = std::move(pendingValues);
+    pendingValues.clear();
+    return update;
+}
+
+void ConfigWatcher::applied(const std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        appliedSequence = takenSequence;
+        applyError = error;
+        if (error.empty()) {
+            appliedValues = std::move(takenValues);
+        }
+        else if (takenSequence == publishedSequence) {
+            values = appliedValues;
+        }
+        takenValues.clear();
+    }
+    appliedCondition.notify_all();
+}
+
+std::string ConfigWatcher::waitApplied() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!appliedCondition.wait_for(lock, std::chrono::seconds(2), [&] { return appliedSequence == publishedSequence; })) {
+        return "ok: queued\n";
+    }
+    return applyError.empty() ? "ok\n" : "error: " + applyError + "\n";
+}
+
+void ConfigWatcher::run() {
+    pollfd fds[3] = {{wakePipe[0], POLLIN, 0}, {inotifyFd, POLLIN, 0}, {socketFd, POLLIN, 0}}; // Negative fds are ignored by poll()
+    while (true) {
+        if (poll(fds, 3, -1) == -1) {
+            if (errno == EINTR) continue;
+            std::cout << "Config watcher stopped: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[0].revents) {
+            return;
+        }
+        if (fds[1].revents & POLLIN) {
+            fileChanged();
+        }
+        if (fds[2].revents & POLLIN) {
+            int clientFd = accept4(socketFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd != -1) {
+                handleClient(clientFd);
+                close(clientFd);
+            }
+        }
+    }
+}
+
+void ConfigWatcher::fileChanged() {
+    const std::string name = path.substr(path.find_last_of('/') + 1);
+    bool ours = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t pos = 0; pos < len;) {
+            auto* event = reinterpret_cast<inotify_event*>(buffer + pos);
+            if (event->len > 0 && name == event->name) {
+                ours = true;
+            }
+            pos += sizeof(inotify_event) + event->len;
+        }
+    }
+    if (!ours) {
+        return;
+    }
+
+    std::map<std::string, std::string> newValues;
+    try {
+        newValues = ConfigParser::parseValues(path);
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << std::endl << "Error reading config file: " << e.what() << std::endl;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (newValues == values) {
+            return;
+        }
+    }
+    std::string error = publish(newValues);
+    if (!error.empty()) {
+        std::cout << std::endl << "Ignoring invalid config file change: " << error << std::endl;
+    }
+}
+
+void ConfigWatcher::handleClient(int clientFd) {
+    // Commands are short, wait a moment for the whole line instead of keeping per-client state
+    std::string request;
+    pollfd pfd{clientFd, POLLIN, 0};
+    while (request.find('\n') == std::string::npos && request.size() < 4096 && poll(&pfd, 1, 1000) > 0) {
+        char buffer[512];
+        ssize_t n = read(clientFd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        request.append(buffer, n);
+    }
+    request = request.substr(0, request.find('\n'));
+
+    std::istringstream fields(request);
+    std::string command;
+    fields >> command;
+    std::string reply;
+    if (command == "set") {
+        std::string key, value;
+        fields >> key;
+        std::getline(fields >> std::ws, value);
+        std::map<std::string, std::string> newValues;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            newValues = values;
+        }
+        newValues[key] = value;
+        std::string error = key.empty() ? "usage: set <key> <value>" : publish(newValues);
+        reply = error.empty() ? waitApplied() : "error: " + error + "\n";
+    } else if (command == "reload") {
+        try {
+            std::map<std::string, std::string> newValues = ConfigParser::parseValues(path);
+            std::string error = publish(newValues);
+            reply = error.empty() ? waitApplied() : "error: " + error + "\n";
+        }
+        catch (const std::runtime_error& e) {
+            reply = std::string("error: ") + e.what() + "\n";
+        }
+    } else if (command == "get") {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [key, value] : appliedValues) {
+            reply += key + ": " + value + "\n";
+        }
+        reply += "ok\n";
+    } else {
+        reply = "error: unknown command, expected set, reload or get\n";
+    }
+    (void)!write(clientFd, reply.data(), reply.size());
+}
+
+std::string ConfigWatcher::publish(const std::map<std::string, std::string>& newValues) {
+    Config config;
+    try {
+        config = ConfigParser::fromValues(newValues);
+    }
+    catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        values = newValues;
+        pending = std::move(config);
+        pendingValues = newValues;
+        publishedSequence++;
+        hasPending.store(true, std::memory_order_release);
+    }
+    return "";
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <optional>
+#include "Config.h"
+
+// Picks up config changes while running, from edits to the config file (inotify) and from commands on the control socket.
+// Changes are validated on a background thread; the capture loop collects them with takeUpdate() between frames, so a frame is
+// always processed with one consistent set of settings, and reports back with applied().
+//
+// Control socket commands, one per line, each answered with "ok" or "error: <reason>" once the capture loop applied the change.
+// Without frames coming in the change can't be applied yet; after two seconds the answer is "ok: queued" instead.
+//   set <key> <value>   change one setting, like "set gamma_correction 2.4"
+//   reload              re-read the config file
+//   get                 list the current settings
+class ConfigWatcher {
+    std::string path;
+    std::string socketPath;
+
+    int inotifyFd = -1;
+    int socketFd = -1;
+    int wakePipe[2] = {-1, -1};
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable appliedCondition;
+    std::map<std::string, std::string> values;        // Raw values of the newest published config, changes are based on them
+    std::map<std::string, std::string> appliedValues; // Raw values of the config the capture loop runs with
+    std::optional<Config> pending;
+    std::map<std::string, std::string> pendingValues;
+    std::map<std::string, std::string> takenValues;
+    uint64_t publishedSequence = 0;
+    uint64_t takenSequence = 0;
+    uint64_t appliedSequence = 0;
+    std::string applyError; // Of appliedSequence
+    std::atomic<bool> hasPending{false};
+
+    void run();
+    void fileChanged();
+    void handleClient(int clientFd);
+    // Validate new raw values and queue them for the capture loop. Returns the error message if they are invalid.
+    std::string publish(const std::map<std::string, std::string>& newValues);
+    // Wait for the capture loop to apply the last published config, and return the reply for the control socket
+    std::string waitApplied();
+public:
+    ConfigWatcher(const std::string& path, const Config& config);
+    ~ConfigWatcher();
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    // The newest valid config, if it changed since the last call. Cheap enough to call every frame.
+    std::optional<Config> takeUpdate();
+    // Report the result of applying the config from takeUpdate(): empty, or the error. A rejected change is forgotten, later
+    // changes are based on the config that is active.
+    void applied(const std::string& error);
+};
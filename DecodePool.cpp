@@ -0,0 +1,152 @@
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <iostream>
+#include <stdexcept>
+#include "DecodePool.h"
+
+DecodePool::DecodePool(int threadCount, const std::vector<int>& cpus, const ThreadSchedule& schedule) {
+    if (threadCount < 1) {
+        throw std::invalid_argument("threadCount must be at least 1");
+    }
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd == -1) {
+        throw std::runtime_error("Failed to create eventfd");
+    }
+    for (int i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        Worker& worker = *workers[i];
+        worker.thread = std::thread(&DecodePool::workerLoop, this, std::ref(worker));
+        if (static_cast<size_t>(i) < cpus.size() && !Realtime::pin(cpus[i], worker.thread.native_handle())) {
+            std::cout << "Can't pin decode thread " << i << " to CPU " << cpus[i] << std::endl;
+        }
+        std::string error = Realtime::setSchedule(schedule, worker.thread.native_handle());
+        if (!error.empty()) {
+            std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for decode thread " << i << ": " << error << std::endl;
+        }
+    }
+}
+
+DecodePool::~DecodePool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobCondition.notify_all();
+    for (const std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+    close(eventFd);
+}
+
+void DecodePool::workerLoop(Worker& worker) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobCondition.wait(lock, [&] { return stopping || (worker.buffer != nullptr && !worker.done); });
+        if (stopping) {
+            return;
+        }
+        const V4L2Buffer* buffer = worker.buffer;
+        const bool planar = worker.planar;
+        lock.unlock();
+
+        Frame frame{};
+        const bool ok = worker.decoder.decode(static_cast<const uint8_t*>(buffer->get_ptr()), buffer->get_bytesused(), planar, frame);
+        const auto decoded = std::chrono::steady_clock::now();
+
+        lock.lock();
+        worker.frame = frame;
+        worker.ok = ok;
+        worker.decoded = decoded;
+        worker.done = true;
+        doneCondition.notify_all();
+        const uint64_t one = 1;
+        if (write(eventFd, &one, sizeof(one)) == -1) {
+            // Only fails if the counter would overflow, and then it's readable anyway
+        }
+    }
+}
+
+void DecodePool::submit(const V4L2Buffer& buffer, bool planar, std::chrono::steady_clock::time_point dequeued) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (inFlight == workers.size()) {
+            throw std::logic_error("All decoders are busy");
+        }
+        Worker& worker = *workers[(oldest + inFlight) % workers.size()];
+        worker.buffer = &buffer;
+        worker.planar = planar;
+        worker.done = false;
+        worker.dequeued = dequeued;
+        inFlight++;
+    }
+    jobCondition.notify_all();
+}
+
+void DecodePool::advance() {
+    Worker& worker = *workers[oldest];
+    worker.buffer = nullptr;
+    worker.done = false;
+    oldest = (oldest + 1) % workers.size();
+    inFlight--;
+}
+
+bool DecodePool::take(Decoded& decoded, std::vector<Stale>& stale) {
+    // Reset the event first: a frame finishing after this signals it again
+    uint64_t count;
+    if (read(eventFd, &count, sizeof(count)) == -1) {
+        // Nothing was signaled
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (taken) {
+        throw std::logic_error("The last frame wasn't released");
+    }
+    // Of the decoded frames at the front, the newest good one is processed and the others are dropped
+    size_t ready = 0;
+    size_t newest = 0;
+    bool found = false;
+    while (ready < inFlight && workers[(oldest + ready) % workers.size()]->done) {
+        if (workers[(oldest + ready) % workers.size()]->ok) {
+            newest = ready;
+            found = true;
+        }
+        ready++;
+    }
+    const size_t drop = found ? newest : ready;
+    for (size_t i = 0; i < drop; i++) {
+        const Worker& worker = *workers[oldest];
+        stale.push_back({worker.buffer, !worker.ok});
+        advance();
+    }
+    if (!found) {
+        return false;
+    }
+
+    const Worker& worker = *workers[oldest];
+    decoded = Decoded{worker.buffer, worker.frame, worker.dequeued, worker.decoded};
+    taken = true;
+    return true;
+}
+
+void DecodePool::release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (taken) {
+        advance();
+        taken = false;
+    }
+}
+
+void DecodePool::finish(std::vector<Stale>& stale) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (taken) {
+        throw std::logic_error("The last frame wasn't released");
+    }
+    while (inFlight > 0) {
+        const Worker& worker = *workers[oldest];
+        doneCondition.wait(lock, [&] { return worker.done; });
+        stale.push_back({worker.buffer, !worker.ok});
+        advance();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "JpegDecoder.h"
+#include "V4L2Capture.h"
+#include "Realtime.h"
+
+// Decodes MJPEG frames on several threads, each with its own decompressor and buffers, for when a single thread can't decode a
+// frame within the capture interval. Dequeued buffers go to the decoders round-robin and come back in capture order: the oldest
+// frame is always handed out first. If the caller fell behind and newer frames are decoded already, the older ones are dropped
+// instead of processed late. Only the capture thread calls the methods, the workers just decode.
+class DecodePool {
+public:
+    struct Decoded {
+        const V4L2Buffer* buffer = nullptr; // Requeued by the caller once the frame is processed and released
+        Frame frame{};
+        std::chrono::steady_clock::time_point dequeued;
+        std::chrono::steady_clock::time_point decoded;
+    };
+    // A buffer the caller has to requeue without processing it
+    struct Stale {
+        const V4L2Buffer* buffer;
+        bool failed; // Didn't decode, otherwise it was superseded by a newer frame
+    };
+private:
+    struct Worker {
+        JpegDecoder decoder;
+        std::thread thread;
+        // Job, guarded by the pool's mutex. The worker is busy from submit() until its frame is released or dropped.
+        const V4L2Buffer* buffer = nullptr;
+        bool planar = false;
+        bool done = false;
+        bool ok = false;
+        Frame frame{};
+        std::chrono::steady_clock::time_point dequeued;
+        std::chrono::steady_clock::time_point decoded;
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    std::condition_variable jobCondition;
+    std::condition_variable doneCondition;
+    int eventFd = -1;   // Signaled whenever a frame is decoded, so the capture thread can wait for it and the device in one poll()
+    size_t oldest = 0;  // Worker with the oldest frame in flight, the next ones follow round-robin
+    size_t inFlight = 0;
+    bool taken = false; // The oldest frame is being processed by the caller
+    bool stopping = false;
+
+    void workerLoop(Worker& worker);
+    // Free the oldest worker, with the lock held
+    void advance();
+public:
+    // Worker i is pinned to cpus[i], if given, and scheduled with schedule (which can't be SCHED_DEADLINE)
+    DecodePool(int threadCount, const std::vector<int>& cpus = {}, const ThreadSchedule& schedule = {});
+    ~DecodePool();
+
+    DecodePool(const DecodePool&) = delete;
+    DecodePool& operator=(const DecodePool&) = delete;
+
+    size_t getThreadCount() const { return workers.size(); }
+    int getEventFd() const { return eventFd; }
+    bool full() const { return inFlight == workers.size(); }
+    bool empty() const { return inFlight == 0; }
+
+    // Hand a dequeued buffer to the next decoder in turn. Only while the pool isn't full.
+    void submit(const V4L2Buffer& buffer, bool planar, std::chrono::steady_clock::time_point dequeued);
+    // The oldest frame, if it's decoded. Decoded frames older than the newest decoded one, and frames that failed to decode, are
+    // added to stale. Returns false if no frame is ready yet, stale may have been filled anyway.
+    bool take(Decoded& decoded, std::vector<Stale>& stale);
+    // Done with the frame from take(), its decoder is free again
+    void release();
+    // Wait for every frame in flight and add them all to stale, so no buffer is held by the pool. Not while a frame is taken.
+    void finish(std::vector<Stale>& stale);
+};
@@ -0,0 +1,52 @@
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
+#include "DeviceWatcher.h"
+
+DeviceWatcher::DeviceWatcher() {
+    socketFd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (socketFd == -1) {
+        return;
+    }
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1; // Kernel uevents
+    if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+DeviceWatcher::~DeviceWatcher() {
+    if (socketFd != -1) {
+        close(socketFd);
+    }
+}
+
+bool DeviceWatcher::waitFor(const std::string& path, int timeoutMs) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        if (access(path.c_str(), R_OK | W_OK) == 0) {
+            return true;
+        }
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            return false;
+        }
+        const int waitMs = static_cast<int>(std::min<int64_t>(remaining, 250));
+        if (socketFd == -1) {
+            usleep(waitMs * 1000);
+            continue;
+        }
+        pollfd pfd{socketFd, POLLIN, 0};
+        if (poll(&pfd, 1, waitMs) > 0) {
+            // Any event is reason enough to look again, so the messages themselves aren't parsed
+            char message[4096];
+            while (recv(socketFd, message, sizeof(message), 0) > 0) {
+            }
+        }
+    }
+}
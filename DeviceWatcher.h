@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+
+// Waits for a device node to (re)appear after it was unplugged, like a capture card or an MCU re-enumerating on USB.
+// Wakes up on kernel uevents from netlink, and also checks every 250ms: udev creates symlinks like /dev/serial/by-id/... only
+// after the kernel event, and netlink may not be available at all (containers), in which case this just polls.
+class DeviceWatcher {
+    int socketFd = -1;
+public:
+    DeviceWatcher();
+    ~DeviceWatcher();
+
+    DeviceWatcher(const DeviceWatcher&) = delete;
+    DeviceWatcher& operator=(const DeviceWatcher&) = delete;
+
+    // Wait up to timeoutMs for path to exist and be accessible. Returns false if it didn't appear in time.
+    bool waitFor(const std::string& path, int timeoutMs);
+};
@@ -0,0 +1,106 @@
+#include <stdexcept>
+#include <iostream>
+#include "Realtime.h"
+#include "ExtractionPool.h"
+
+ExtractionPool::ExtractionPool(int threadCount, const std::vector<int>& cpus, const ThreadSchedule& schedule) {
+    if (threadCount < 1) {
+        throw std::invalid_argument("threadCount must be at least 1");
+    }
+    bounds.resize(threadCount + 1);
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(&ExtractionPool::workerLoop, this, i);
+        if (static_cast<size_t>(i - 1) < cpus.size() && !Realtime::pin(cpus[i - 1], threads.back().native_handle())) {
+            std::cout << "Can't pin extraction thread " << i << " to CPU " << cpus[i - 1] << std::endl;
+        }
+        std::string error = Realtime::setSchedule(schedule, threads.back().native_handle());
+        if (!error.empty()) {
+            std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for extraction thread " << i << ": " << error << std::endl;
+        }
+    }
+}
+
+ExtractionPool::~ExtractionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// Split the zones into ranges of roughly the same number of pixels, as the zones along the long and short edges differ in size
+void ExtractionPool::partition(const std::vector<Zone>& zones) {
+    const size_t threadCount = bounds.size() - 1;
+    uint64_t totalPixels = 0;
+    for (const Zone& zone : zones) {
+        totalPixels += static_cast<uint64_t>(zone.width) * zone.height;
+    }
+
+    bounds[0] = 0;
+    size_t zoneIndex = 0;
+    uint64_t pixels = 0;
+    for (size_t i = 1; i < threadCount; i++) {
+        const uint64_t target = totalPixels * i / threadCount;
+        while (zoneIndex < zones.size() && pixels < target) {
+            pixels += static_cast<uint64_t>(zones[zoneIndex].width) * zones[zoneIndex].height;
+            zoneIndex++;
+        }
+        bounds[i] = zoneIndex;
+    }
+    bounds[threadCount] = zones.size();
+}
+
+void ExtractionPool::extract(const ZoneExtractor& zoneExtractor, const Frame& currentFrame, uint8_t* currentLedData) {
+    if (threads.empty()) {
+        zoneExtractor.extract(currentFrame, currentLedData);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        partition(zoneExtractor.getZones());
+        extractor = &zoneExtractor;
+        frame = &currentFrame;
+        ledData = currentLedData;
+        pending = threads.size();
+        generation++;
+    }
+    startCondition.notify_all();
+
+    // The calling thread takes the first slice
+    zoneExtractor.extract(currentFrame, currentLedData, bounds[0], bounds[1]);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return pending == 0; });
+}
+
+void ExtractionPool::workerLoop(size_t index) {
+    uint64_t seenGeneration = 0;
+    while (true) {
+        size_t first, last;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+            first = bounds[index];
+            last = bounds[index + 1];
+        }
+
+        extractor->extract(*frame, ledData, first, last);
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = --pending == 0;
+        }
+        if (done) {
+            doneCondition.notify_one();
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "ZoneExtractor.h"
+#include "Realtime.h"
+
+// Persistent worker threads that split the zone list of every frame between them. Each thread writes its own slice of the LED data, so the only synchronization is a single barrier at the end of the frame.
+class ExtractionPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    size_t pending = 0;
+    bool stopping = false;
+
+    // Job of the current frame
+    const ZoneExtractor* extractor = nullptr;
+    const Frame* frame = nullptr;
+    uint8_t* ledData = nullptr;
+    std::vector<size_t> bounds; // Zone range of thread i is [bounds[i], bounds[i+1])
+
+    void workerLoop(size_t index);
+    void partition(const std::vector<Zone>& zones);
+public:
+    // threadCount includes the calling thread, so 1 means no extra threads. Helper thread i is pinned to cpus[i - 1], if given, and
+    // scheduled with schedule (which can't be SCHED_DEADLINE, as that can only be set from within a thread).
+    explicit ExtractionPool(int threadCount, const std::vector<int>& cpus = {}, const ThreadSchedule& schedule = {});
+    ~ExtractionPool();
+
+    ExtractionPool(const ExtractionPool&) = delete;
+    ExtractionPool& operator=(const ExtractionPool&) = delete;
+
+    void extract(const ZoneExtractor& zoneExtractor, const Frame& frame, uint8_t* ledData);
+    size_t getThreadCount() const { return threads.size() + 1; }
+};
@@ -0,0 +1,153 @@
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <ctime>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "FileOutput.h"
+
+FileOutput::FileOutput(const OutputTarget& target, size_t ledCount, const ThreadSchedule& schedule) :
+    target(target),
+    intervalUs(target.fps > 0 ? 1000000 / target.fps : 0),
+    frame(ledCount * 3) {
+    if (target.ledCount == 0 || target.firstLed + target.ledCount > ledCount) {
+        throw std::invalid_argument("Invalid file output: " + target.address);
+    }
+    struct stat info{};
+    if (stat(target.address.c_str(), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode))) {
+        // A FIFO can only be opened for writing once there is a reader, which the writer thread checks for every frame
+        stream = true;
+    }
+    else {
+        fd = open(target.address.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd == -1 || ftruncate(fd, static_cast<off_t>(target.ledCount * 3)) == -1) {
+            if (fd != -1) {
+                close(fd);
+            }
+            throw std::runtime_error("Can't open output file: " + target.address);
+        }
+    }
+
+    thread = std::thread(&FileOutput::writerLoop, this);
+    std::string error = Realtime::setSchedule(schedule, thread.native_handle());
+    if (!error.empty()) {
+        std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for the writer of " << target.address << ": " << error << std::endl;
+    }
+}
+
+FileOutput::~FileOutput() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameCondition.notify_all();
+    thread.join();
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+void FileOutput::submit(const uint8_t* colors) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::copy(colors, colors + frame.size(), frame.begin());
+        sequence++;
+    }
+    frameCondition.notify_all();
+}
+
+bool FileOutput::write(const std::vector<uint8_t>& colors) {
+    if (!stream) {
+        return pwrite(fd, colors.data(), colors.size(), 0) == static_cast<ssize_t>(colors.size());
+    }
+
+    if (fd == -1) {
+        fd = open(target.address.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            return false; // No reader yet
+        }
+    }
+    // Only write frames that fit completely, so the reader stays in step with the frame boundaries
+    int unread = 0;
+    const int capacity = fcntl(fd, F_GETPIPE_SZ);
+    if (capacity > 0 && ioctl(fd, FIONREAD, &unread) == 0 && static_cast<size_t>(capacity - unread) < colors.size()) {
+        return false;
+    }
+    if (::write(fd, colors.data(), colors.size()) == static_cast<ssize_t>(colors.size())) {
+        return true;
+    }
+    if (errno == EPIPE) {
+        // The reader went away. Take the SIGPIPE this thread has blocked, and wait for the next reader.
+        sigset_t pipeSignal;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        const timespec noWait{0, 0};
+        sigtimedwait(&pipeSignal, nullptr, &noWait);
+        close(fd);
+        fd = -1;
+    }
+    return false;
+}
+
+void FileOutput::writerLoop() {
+    // Writing to a FIFO without a reader raises SIGPIPE, which would end the process
+    sigset_t pipeSignal;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+    std::vector<uint8_t> colors(target.ledCount * 3);
+    auto nextWrite = std::chrono::steady_clock::now();
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameCondition.wait(lock, [&] { return stopping || sequence != writtenSequence; });
+            if (stopping) {
+                return;
+            }
+        }
+
+        // A newer frame may arrive until the interval is over, which is then written instead
+        std::this_thread::sleep_until(nextWrite);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (writtenSequence != 0 && sequence - writtenSequence > 1) {
+                framesSkipped += sequence - writtenSequence - 1;
+            }
+            writtenSequence = sequence;
+            copyRange(target, frame.data(), colors.data());
+        }
+
+        if (write(colors)) {
+            framesWritten++;
+        }
+        else {
+            framesDropped++;
+        }
+        nextWrite = std::chrono::steady_clock::now() + std::chrono::microseconds(intervalUs);
+    }
+}
+
+std::string FileOutput::statusLine() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastStatusTime).count();
+    if (seconds < 1.0) {
+        return lastStatus;
+    }
+    lastStatusTime = now;
+
+    uint64_t frames = framesWritten;
+    std::stringstream status;
+    status << " | " << target.address.substr(target.address.find_last_of('/') + 1) << ": " << static_cast<int>((frames - lastFramesWritten) / seconds)
+           << "fps skipped " << framesSkipped;
+    if (framesDropped > 0) {
+        status << " dropped " << framesDropped;
+    }
+    lastFramesWritten = frames;
+    lastStatus = status.str();
+    return lastStatus;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include "OutputSink.h"
+#include "Realtime.h"
+
+// Writes the LED colors of a range to a file, as raw RGB bytes. A regular file always holds the newest frame, rewritten in place, so
+// other programs can read the current colors. A FIFO gets a stream of frames; frames that don't fit into the pipe because the reader
+// is behind, or there is none, are dropped whole, so the reader never sees a partial one.
+class FileOutput : public OutputSink {
+    OutputTarget target;
+    int fd = -1;
+    bool stream = false; // FIFO or character device, written in sequence
+    int64_t intervalUs;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable frameCondition;
+    std::vector<uint8_t> frame;
+    uint64_t sequence = 0;
+    uint64_t writtenSequence = 0;
+    bool stopping = false;
+
+    // Statistics, read by statusLine()
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesSkipped{0}; // Frames replaced by a newer one before they were due
+    std::atomic<uint64_t> framesDropped{0}; // Frames the FIFO had no room for, or that failed to write
+    std::chrono::steady_clock::time_point lastStatusTime = std::chrono::steady_clock::now();
+    uint64_t lastFramesWritten = 0;
+    std::string lastStatus;
+
+    void writerLoop();
+    bool write(const std::vector<uint8_t>& colors);
+public:
+    // target of type File, with a range of a chain of ledCount LEDs. Regular files are created if missing.
+    FileOutput(const OutputTarget& target, size_t ledCount, const ThreadSchedule& schedule = {});
+    ~FileOutput() override;
+
+    FileOutput(const FileOutput&) = delete;
+    FileOutput& operator=(const FileOutput&) = delete;
+
+    void submit(const uint8_t* colors) override;
+    std::string statusLine() override;
+};
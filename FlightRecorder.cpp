@@ -0,0 +1,230 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include "Realtime.h"
+#include "FlightRecorder.h"
+
+namespace {
+    constexpr int keyframeInterval = 64;
+    constexpr size_t runHeader = 4; // uint16_t skip, uint16_t count
+    constexpr size_t maxRun = 0xffff;
+
+    size_t alignRecord(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    int64_t clockUs(clockid_t clock) {
+        timespec now{};
+        clock_gettime(clock, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    }
+}
+
+const char* FlightFormat::eventName(Event event) {
+    switch (event) {
+        case Event::Sleep: return "sleep";
+        case Event::Wake: return "wake";
+        case Event::DecodeError: return "decode_error";
+        case Event::QueueRetry: return "queue_retry";
+        case Event::QueueFailed: return "queue_failed";
+        case Event::ConfigApplied: return "config_applied";
+        case Event::FramesSkipped: return "frames_skipped";
+        case Event::CaptureLost: return "capture_lost";
+        case Event::CaptureRestored: return "capture_restored";
+    }
+    return "unknown";
+}
+
+bool FlightFormat::applyDelta(const uint8_t* payload, size_t payloadSize, uint8_t* leds, size_t ledBytes) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in + runHeader <= payloadSize) {
+        uint16_t skip, count;
+        std::memcpy(&skip, payload + in, 2);
+        std::memcpy(&count, payload + in + 2, 2);
+        in += runHeader;
+        out += skip;
+        if (out + count > ledBytes || in + count > payloadSize) {
+            return false;
+        }
+        std::memcpy(leds + out, payload + in, count);
+        in += count;
+        out += count;
+    }
+    return in == payloadSize;
+}
+
+FlightRecorder::FlightRecorder(const std::string& path, size_t dataSize, bool delta) : delta(delta) {
+    dataSize &= ~static_cast<size_t>(7);
+    if (dataSize < 4096) {
+        throw std::invalid_argument("Flight recorder needs at least 4KB");
+    }
+    if (access(path.c_str(), F_OK) == 0) {
+        std::rename(path.c_str(), (path + ".1").c_str());
+    }
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to create flight recording " + path + ": " + strerror(errno));
+    }
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mappedSize = pageSize + dataSize;
+    // Allocate the blocks now, so writing to the mapping never has to wait for the file system to find space
+    if (posix_fallocate(fd, 0, static_cast<off_t>(mappedSize)) != 0 && ftruncate(fd, static_cast<off_t>(mappedSize)) == -1) {
+        close(fd);
+        throw std::runtime_error("Failed to size flight recording " + path + ": " + strerror(errno));
+    }
+    void* mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Failed to map flight recording " + path + ": " + strerror(errno));
+    }
+    // Fault in every page up front, a page fault on a shared file mapping can block on I/O
+    Realtime::prefault(mapping, mappedSize);
+
+    header = static_cast<FlightFormat::Header*>(mapping);
+    ring = static_cast<uint8_t*>(mapping) + pageSize;
+    std::memcpy(header->magic, FlightFormat::magic, sizeof(header->magic));
+    header->version = FlightFormat::version;
+    header->headerSize = static_cast<uint32_t>(pageSize);
+    header->dataSize = dataSize;
+    header->realtimeOffsetUs = clockUs(CLOCK_REALTIME) - clockUs(CLOCK_MONOTONIC);
+    header->tail = 0;
+    header->head = 0;
+    header->records = 0;
+}
+
+FlightRecorder::~FlightRecorder() {
+    msync(header, mappedSize, MS_ASYNC);
+    munmap(header, mappedSize);
+    close(fd);
+}
+
+uint8_t* FlightRecorder::reserve(size_t size) {
+    const uint64_t dataSize = header->dataSize;
+    uint64_t head = header->head;
+    uint64_t tail = header->tail;
+    const size_t untilEnd = dataSize - head % dataSize;
+    const size_t padding = untilEnd < size ? untilEnd : 0;
+
+    // Drop the oldest records until there is room, and publish the new tail before their memory is reused
+    while (head + padding + size - tail > dataSize) {
+        const size_t offset = tail % dataSize;
+        if (dataSize - offset < sizeof(FlightFormat::Record)) {
+            tail += dataSize - offset;
+        }
+        else {
+            tail += reinterpret_cast<const FlightFormat::Record*>(ring + offset)->size;
+        }
+    }
+    __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+
+    if (padding > 0) {
+        if (padding >= sizeof(FlightFormat::Record)) {
+            auto* record = reinterpret_cast<FlightFormat::Record*>(ring + head % dataSize);
+            record->size = static_cast<uint32_t>(padding);
+            record->type = FlightFormat::RecordType::Padding;
+            record->flags = 0;
+            record->number = header->records++;
+        }
+        head += padding;
+        __atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+    }
+    return ring + head % dataSize;
+}
+
+void FlightRecorder::commit(size_t size) {
+    // Plain stores on x86, the release only keeps the compiler from moving the record's contents after it
+    __atomic_store_n(&header->head, header->head + size, __ATOMIC_RELEASE);
+}
+
+bool FlightRecorder::encodeDelta(const uint8_t* leds, size_t length) {
+    encoded.clear();
+    size_t i = 0;
+    while (i < length) {
+        size_t start = i;
+        while (start < length && leds[start] == previous[start] && start - i < maxRun) {
+            start++;
+        }
+        if (start == length) {
+            break;
+        }
+        // Extend the run over short unchanged gaps, which are cheaper to copy than to start a new run for
+        size_t end = start;
+        size_t same = 0;
+        while (end < length && end - start < maxRun && same < runHeader) {
+            same = leds[end] == previous[end] ? same + 1 : 0;
+            end++;
+        }
+        end -= same;
+        const uint16_t skip = static_cast<uint16_t>(start - i);
+        const uint16_t count = static_cast<uint16_t>(end - start);
+        if (encoded.size() + runHeader + count >= length) {
+            return false;
+        }
+        const size_t pos = encoded.size();
+        encoded.resize(pos + runHeader + count);
+        std::memcpy(encoded.data() + pos, &skip, 2);
+        std::memcpy(encoded.data() + pos + 2, &count, 2);
+        std::memcpy(encoded.data() + pos + runHeader, leds + start, count);
+        i = end;
+    }
+    return true;
+}
+
+void FlightRecorder::frame(const FlightFormat::FrameTimes& times, const uint8_t* leds, size_t length, int horizontalLeds, int verticalLeds) {
+    // A delta is only used when it's smaller, so if the raw colors fit, any record of this frame does
+    if (alignRecord(sizeof(FlightFormat::Record) + sizeof(FlightFormat::FrameBody) + length) > header->dataSize / 2) {
+        // Wouldn't fit next to the padding at the end of the ring. The next frame that is recorded has no base and becomes a keyframe.
+        previous.clear();
+        framesSinceKey = 0;
+        return;
+    }
+
+    // A delta needs the previous frame, and the dump has to find a complete one within the ring every now and then
+    bool useDelta = delta && previous.size() == length && framesSinceKey + 1 < keyframeInterval && encodeDelta(leds, length);
+    framesSinceKey = useDelta ? framesSinceKey + 1 : 0;
+    const uint8_t* payload = useDelta ? encoded.data() : leds;
+    const size_t payloadSize = useDelta ? encoded.size() : length;
+
+    const size_t size = alignRecord(sizeof(FlightFormat::Record) + sizeof(FlightFormat::FrameBody) + payloadSize);
+    uint8_t* target = reserve(size);
+    auto* record = reinterpret_cast<FlightFormat::Record*>(target);
+    record->size = static_cast<uint32_t>(size);
+    record->type = FlightFormat::RecordType::Frame;
+    record->flags = useDelta ? FlightFormat::flagDelta : 0;
+    record->number = header->records++;
+    auto* body = reinterpret_cast<FlightFormat::FrameBody*>(target + sizeof(FlightFormat::Record));
+    body->times = times;
+    body->horizontalLeds = static_cast<uint16_t>(horizontalLeds);
+    body->verticalLeds = static_cast<uint16_t>(verticalLeds);
+    body->ledBytes = static_cast<uint32_t>(length);
+    body->payloadSize = static_cast<uint32_t>(payloadSize);
+    body->reserved = 0;
+    std::memcpy(target + sizeof(FlightFormat::Record) + sizeof(FlightFormat::FrameBody), payload, payloadSize);
+    commit(size);
+
+    if (delta) {
+        previous.assign(leds, leds + length);
+    }
+}
+
+void FlightRecorder::event(FlightFormat::Event event, int64_t value) {
+    const size_t size = alignRecord(sizeof(FlightFormat::Record) + sizeof(FlightFormat::EventBody));
+    uint8_t* target = reserve(size);
+    auto* record = reinterpret_cast<FlightFormat::Record*>(target);
+    record->size = static_cast<uint32_t>(size);
+    record->type = FlightFormat::RecordType::Event;
+    record->flags = 0;
+    record->number = header->records++;
+    auto* body = reinterpret_cast<FlightFormat::EventBody*>(target + sizeof(FlightFormat::Record));
+    body->timeUs = micros(std::chrono::steady_clock::now());
+    body->value = value;
+    body->event = event;
+    std::memset(body->reserved, 0, sizeof(body->reserved));
+    commit(size);
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// File layout of a flight recording. The file is a header followed by a ring of variable-size records, addressed by
+// ever-increasing byte positions (a position's offset in the ring is position % dataSize). Records never wrap around the end
+// of the ring: the rest is filled with a padding record instead, or skipped if it's smaller than a record header.
+namespace FlightFormat {
+    constexpr char magic[8] = {'A', 'M', 'B', 'I', 'F', 'L', 'T', 'R'};
+    constexpr uint32_t version = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerSize;      // Offset of the ring in the file
+        uint64_t dataSize;        // Size of the ring in bytes
+        int64_t realtimeOffsetUs; // CLOCK_REALTIME - CLOCK_MONOTONIC when the recording started, to turn timestamps into dates
+        uint64_t tail;            // Position of the oldest record
+        uint64_t head;            // Position after the newest record
+        uint64_t records;         // Records written, including overwritten ones
+    };
+
+    enum class RecordType : uint16_t {
+        Padding = 1,
+        Frame = 2,
+        Event = 3,
+    };
+
+    constexpr uint16_t flagDelta = 1; // Frame payload is a delta to the previous frame, otherwise the raw LED colors
+
+    struct Record {
+        uint32_t size; // Including this header, a multiple of 8
+        RecordType type;
+        uint16_t flags;
+        uint64_t number; // Counts up by one from record to record
+    };
+
+    // Timestamps of one frame in us on CLOCK_MONOTONIC, 0 where a stage doesn't apply
+    struct FrameTimes {
+        int64_t captureUs;   // Driver timestamp of the capture
+        int64_t dequeueUs;   // Frame dequeued or read from the pipe
+        int64_t decodedUs;
+        int64_t extractedUs;
+        int64_t correctedUs;
+        int64_t sentUs;      // Handed to the serial ports or the output clock
+        uint32_t sequence;   // V4L2 sequence number, or a frame counter
+    };
+
+    // Followed by the payload: ledBytes raw LED colors, or with flagDelta runs of {uint16_t skip, uint16_t count, count bytes}
+    struct FrameBody {
+        FrameTimes times;
+        uint16_t horizontalLeds; // Layout, for drawing the frame
+        uint16_t verticalLeds;
+        uint32_t ledBytes;       // Decoded payload size
+        uint32_t payloadSize;    // Stored payload size
+        uint32_t reserved;
+    };
+
+    enum class Event : uint16_t {
+        Sleep = 1,         // Input blank, value is the sleep frame rate
+        Wake = 2,          // Input back, value is the number of stale frames dropped
+        DecodeError = 3,   // Value is the compressed size
+        QueueRetry = 4,    // Requeueing a V4L2 buffer failed, value is the attempt
+        QueueFailed = 5,   // Gave up requeueing, the capture device is reopened
+        ConfigApplied = 6,
+        FramesSkipped = 7, // Older frames that were never processed, value is how many
+        CaptureLost = 8,
+        CaptureRestored = 9, // Value is how long the capture device was gone in ms
+    };
+
+    struct EventBody {
+        int64_t timeUs;
+        int64_t value;
+        Event event;
+        uint16_t reserved[3];
+    };
+
+    const char* eventName(Event event);
+
+    // Apply a delta payload to the previous frame's colors
+    bool applyDelta(const uint8_t* payload, size_t payloadSize, uint8_t* leds, size_t ledBytes);
+}
+
+// Always-on recording of the last frames into a memory-mapped ring file, for looking at flicker or lag after the fact.
+// Recording only writes to the mapping, without system calls: the kernel writes the pages back, and they survive a crash of the process.
+// Not thread safe, frames and events are recorded by the capture thread.
+class FlightRecorder {
+    int fd = -1;
+    FlightFormat::Header* header = nullptr;
+    uint8_t* ring = nullptr;
+    size_t mappedSize = 0;
+    bool delta;
+    int framesSinceKey = 0;
+    std::vector<uint8_t> previous; // Colors of the last recorded frame, the base of the next delta
+    std::vector<uint8_t> encoded;
+
+    // Make room for a record and return where it goes. The caller fills it in and calls commit().
+    uint8_t* reserve(size_t size);
+    void commit(size_t size);
+    // Delta-encode leds against previous into encoded. Returns false if that isn't smaller than the raw colors.
+    bool encodeDelta(const uint8_t* leds, size_t length);
+public:
+    // Creates the file with a ring of dataSize bytes. An existing recording is kept as path + ".1", so a crash and a restart don't lose it.
+    // With delta, frames are stored as the changes to the one before, with all colors every 64 frames.
+    FlightRecorder(const std::string& path, size_t dataSize, bool delta);
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    void frame(const FlightFormat::FrameTimes& times, const uint8_t* leds, size_t length, int horizontalLeds, int verticalLeds);
+    void event(FlightFormat::Event event, int64_t value = 0);
+
+    // Timestamp in the recording's time base
+    static int64_t micros(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+    }
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+enum class PixelFormat {
+    RGB24,  // Packed R,G,B, as decoded by turbojpeg with TJPF_RGB
+    BGRX32, // Packed B,G,R,X, the native X11 layout (ffmpeg bgr0)
+    NV12,   // Limited range BT.601 Y plane, followed by a half resolution plane of interleaved Cb,Cr
+    YUYV,   // Limited range BT.601 packed Y,Cb,Y,Cr pixel pairs, the raw format of most USB capture devices
+    YCbCrPlanar, // Full range (JFIF) Y, Cb and Cr planes, as stored in a JPEG. Chroma is subsampled by chromaScaleX/Y, grayscale has no chroma.
+};
+
+// Non-owning view of a captured image
+struct Frame {
+    PixelFormat format;
+    const uint8_t* data; // Packed pixels, or the Y plane of YUV formats
+    int width;
+    int height;
+    int stride; // Length of one row of data in bytes
+    const uint8_t* chroma = nullptr; // Chroma plane of YUV formats, the Cb plane of YCbCrPlanar
+    int chromaStride = 0;
+    const uint8_t* chromaCr = nullptr; // Cr plane of YCbCrPlanar
+    int chromaScaleX = 2; // Luma pixels per chroma sample of YCbCrPlanar
+    int chromaScaleY = 2;
+};
@@ -0,0 +1,235 @@
+#include <turbojpeg.h>
+#include <stdexcept>
+#include "JpegDecoder.h"
+
+// Plane rows start on 32 byte boundaries
+static int alignedStride(int width) {
+    return (width + 31) & ~31;
+}
+
+JpegDecoder::JpegDecoder(int threads) : handle(tjInitDecompress()) {
+    if (handle == nullptr) {
+        throw std::runtime_error("Failed to create JPEG decompressor");
+    }
+    if (threads < 1) {
+        throw std::invalid_argument("threads must be at least 1");
+    }
+    strips.resize(threads > 1 ? threads : 0);
+    for (size_t i = 0; i < strips.size(); i++) {
+        strips[i].handle = i == 0 ? handle : tjInitDecompress();
+        if (strips[i].handle == nullptr) {
+            throw std::runtime_error("Failed to create JPEG decompressor");
+        }
+    }
+    for (size_t i = 1; i < strips.size(); i++) {
+        workerThreads.emplace_back(&JpegDecoder::workerLoop, this, i);
+    }
+}
+
+JpegDecoder::~JpegDecoder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (std::thread& thread : workerThreads) {
+        thread.join();
+    }
+    for (size_t i = 1; i < strips.size(); i++) {
+        tjDestroy(strips[i].handle);
+    }
+    tjDestroy(handle);
+}
+
+void JpegDecoder::reserve(int width, int height, bool planar) {
+    if (planar) {
+        // 4:4:4 is the largest layout
+        planeBuffer.grow(static_cast<size_t>(alignedStride(width)) * height * 3);
+    } else {
+        rgbBuffer.grow(static_cast<size_t>(width) * height * 3 + 16); // extra padding needed for SIMD optimizations in colorOfBlock
+    }
+}
+
+bool JpegDecoder::decode(const uint8_t* jpeg, size_t length, bool wantPlanar, Frame& frame) {
+    int width, height, subsampling, colorspace;
+    if (tjDecompressHeader3(handle, jpeg, length, &width, &height, &subsampling, &colorspace) == -1) {
+        return false;
+    }
+
+    // CMYK and RGB-coded JPEGs have no YCbCr planes to average
+    planar = wantPlanar && (colorspace == TJCS_YCbCr || colorspace == TJCS_GRAY);
+    frameWidth = width;
+    if (!planar) {
+        rgbBuffer.grow(static_cast<size_t>(width) * height * 3 + 16); // extra padding needed for SIMD optimizations in colorOfBlock
+        outputPlanes[0] = rgbBuffer.get();
+        outputStrides[0] = width * 3;
+    }
+    else {
+        // Planes at the JPEG's own chroma resolution, one after the other
+        const bool gray = subsampling == TJSAMP_GRAY;
+        const int lumaStride = alignedStride(tjPlaneWidth(0, width, subsampling));
+        const int lumaHeight = tjPlaneHeight(0, height, subsampling);
+        const int chromaStride = gray ? 0 : alignedStride(tjPlaneWidth(1, width, subsampling));
+        const int chromaHeight = gray ? 0 : tjPlaneHeight(1, height, subsampling);
+        const size_t lumaSize = static_cast<size_t>(lumaStride) * lumaHeight;
+        const size_t chromaSize = static_cast<size_t>(chromaStride) * chromaHeight;
+        planeBuffer.grow(lumaSize + 2 * chromaSize);
+        outputPlanes[0] = planeBuffer.get();
+        outputPlanes[1] = gray ? nullptr : planeBuffer.get() + lumaSize;
+        outputPlanes[2] = gray ? nullptr : planeBuffer.get() + lumaSize + chromaSize;
+        outputStrides[0] = lumaStride;
+        outputStrides[1] = chromaStride;
+        outputStrides[2] = chromaStride;
+        chromaScaleY = tjMCUHeight[subsampling] / 8;
+    }
+
+    // A strip that fails to decode may just be an encoder quirk, the whole frame gets another chance
+    bool decoded = false;
+    if (!strips.empty() && split(jpeg, length, width, height, subsampling)) {
+        decoded = decodeStrips();
+        splitFrames += decoded;
+    }
+    if (!decoded) {
+        if (!decodeWhole(jpeg, length)) {
+            return false;
+        }
+        wholeFrames++;
+    }
+
+    if (!planar) {
+        frame = Frame{PixelFormat::RGB24, rgbBuffer.get(), width, height, width * 3};
+        return true;
+    }
+    frame = Frame{PixelFormat::YCbCrPlanar, outputPlanes[0], width, height, outputStrides[0], outputPlanes[1], outputStrides[1]};
+    frame.chromaCr = outputPlanes[2];
+    frame.chromaScaleX = tjMCUWidth[subsampling] / 8;
+    frame.chromaScaleY = tjMCUHeight[subsampling] / 8;
+    return true;
+}
+
+bool JpegDecoder::decodeWhole(const uint8_t* jpeg, size_t length) {
+    if (!planar) {
+        return tjDecompress2(handle, jpeg, length, outputPlanes[0], frameWidth, 0, 0, TJPF_RGB, 0) != -1;
+    }
+    unsigned char* destination[3] = {outputPlanes[0], outputPlanes[1], outputPlanes[2]};
+    int destinationStrides[3] = {outputStrides[0], outputStrides[1], outputStrides[2]};
+    return tjDecompressToYUVPlanes(handle, jpeg, length, destination, frameWidth, destinationStrides, 0, 0) != -1;
+}
+
+bool JpegDecoder::split(const uint8_t* jpeg, size_t length, int width, int height, int subsampling) {
+    if (subsampling < 0 || subsampling >= static_cast<int>(sizeof(tjMCUWidth) / sizeof(tjMCUWidth[0])) || !JpegScanner::findRestarts(jpeg, length, restarts)) {
+        return false;
+    }
+    const int mcuWidth = tjMCUWidth[subsampling];
+    const int mcuHeight = tjMCUHeight[subsampling];
+    if (!planar && mcuHeight > 8) {
+        return false; // Upsampling vertically subsampled chroma to RGB blends rows across the cut, the strip edges would differ
+    }
+    const int64_t mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+    const int64_t mcuRows = (height + mcuHeight - 1) / mcuHeight;
+    const int64_t intervals = static_cast<int64_t>(restarts.markers.size()) + 1;
+    if (intervals != (mcusPerRow * mcuRows + restarts.interval - 1) / restarts.interval) {
+        return false; // Not the restart markers the header promises
+    }
+
+    // Cut where an interval starts at the beginning of an MCU row, as close to an even share of the rows per strip as possible
+    std::vector<int64_t> cuts = {0}; // First interval of every strip
+    std::vector<int64_t> cutRows = {0};
+    for (size_t k = 1; k < strips.size(); k++) {
+        const int64_t target = mcuRows * k / strips.size();
+        for (int64_t i = cuts.back() + 1; i < intervals; i++) {
+            const int64_t mcu = i * restarts.interval;
+            if (mcu % mcusPerRow == 0 && mcu / mcusPerRow >= target) {
+                cuts.push_back(i);
+                cutRows.push_back(mcu / mcusPerRow);
+                break;
+            }
+        }
+    }
+    if (cuts.size() < 2) {
+        return false;
+    }
+
+    // Every strip is the headers with its own height, its intervals with the RSTn markers counted from 0 again, and EOI
+    const size_t headerLength = restarts.scanData;
+    stripCount = cuts.size();
+    for (size_t k = 0; k < stripCount; k++) {
+        Strip& strip = strips[k];
+        const int64_t first = cuts[k];
+        const int64_t last = k + 1 < stripCount ? cuts[k + 1] : intervals; // Exclusive
+        strip.row = static_cast<int>(cutRows[k] * mcuHeight);
+        strip.height = k + 1 < stripCount ? static_cast<int>(cutRows[k + 1] * mcuHeight) - strip.row : height - strip.row;
+        const size_t begin = first == 0 ? restarts.scanData : restarts.markers[first - 1] + 2;
+        const size_t end = last == intervals ? restarts.scanEnd : restarts.markers[last - 1];
+
+        strip.jpeg.assign(jpeg, jpeg + headerLength);
+        strip.jpeg.insert(strip.jpeg.end(), jpeg + begin, jpeg + end);
+        strip.jpeg.push_back(0xFF);
+        strip.jpeg.push_back(0xD9);
+        strip.jpeg[restarts.frameHeader + 5] = static_cast<uint8_t>(strip.height >> 8);
+        strip.jpeg[restarts.frameHeader + 6] = static_cast<uint8_t>(strip.height & 0xFF);
+        for (int64_t i = first; i + 1 < last; i++) {
+            strip.jpeg[headerLength + restarts.markers[i] - begin + 1] = static_cast<uint8_t>(0xD0 + (i - first) % 8);
+        }
+    }
+    return true;
+}
+
+void JpegDecoder::decodeStrip(Strip& strip) {
+    if (!planar) {
+        strip.ok = tjDecompress2(strip.handle, strip.jpeg.data(), strip.jpeg.size(), outputPlanes[0] + static_cast<size_t>(strip.row) * outputStrides[0], frameWidth, outputStrides[0],
+                                 strip.height, TJPF_RGB, 0) != -1;
+        return;
+    }
+    const int chromaRow = strip.row / chromaScaleY;
+    unsigned char* destination[3] = {
+        outputPlanes[0] + static_cast<size_t>(strip.row) * outputStrides[0],
+        outputPlanes[1] != nullptr ? outputPlanes[1] + static_cast<size_t>(chromaRow) * outputStrides[1] : nullptr,
+        outputPlanes[2] != nullptr ? outputPlanes[2] + static_cast<size_t>(chromaRow) * outputStrides[2] : nullptr,
+    };
+    int destinationStrides[3] = {outputStrides[0], outputStrides[1], outputStrides[2]};
+    strip.ok = tjDecompressToYUVPlanes(strip.handle, strip.jpeg.data(), strip.jpeg.size(), destination, frameWidth, destinationStrides, strip.height, 0) != -1;
+}
+
+bool JpegDecoder::decodeStrips() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = stripCount - 1;
+        generation++;
+    }
+    startCondition.notify_all();
+
+    // The calling thread takes the first strip
+    decodeStrip(strips[0]);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this] { return pending == 0; });
+    for (size_t k = 0; k < stripCount; k++) {
+        if (!strips[k].ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void JpegDecoder::workerLoop(size_t index) {
+    uint64_t seenGeneration = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        startCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+        // Frames with fewer cuts than threads leave the last threads idle
+        if (index >= stripCount) {
+            continue;
+        }
+        lock.unlock();
+        decodeStrip(strips[index]);
+        lock.lock();
+        if (--pending == 0) {
+            doneCondition.notify_one();
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include "AlignedBuffer.h"
+#include "JpegScanner.h"
+#include "Frame.h"
+
+// Decodes MJPEG frames into buffers that are kept from frame to frame. Besides packed RGB, frames can be decoded to the Y, Cb and
+// Cr planes as they are stored in the JPEG, which skips chroma upsampling and color conversion, by far the largest part of
+// decoding after the entropy decoding and IDCT. Zones are then averaged on the planes and converted to RGB once per LED.
+//
+// With more than one thread, JPEGs with restart markers are cut into horizontal strips at the markers that fall on MCU row
+// boundaries. Every strip becomes a JPEG of its own (the headers with the strip's height, and its restart intervals) and is decoded
+// by its own thread straight into its rows of the output, which cuts the time per frame rather than just raising the frame rate.
+// JPEGs without usable restart markers, and RGB decoding of JPEGs with vertically subsampled chroma (4:2:0), whose upsampling
+// reads chroma rows across the cut, are decoded as a whole.
+class JpegDecoder {
+    // One horizontal strip of the frame and the thread decoding it
+    struct Strip {
+        void* handle = nullptr;
+        std::vector<uint8_t> jpeg; // The strip as a JPEG of its own
+        int row = 0;               // First row in the frame
+        int height = 0;
+        bool ok = false;
+    };
+
+    void* handle;
+    AlignedBuffer rgbBuffer;
+    AlignedBuffer planeBuffer;
+    JpegRestarts restarts;
+
+    // Strip decoding. strips[0] is decoded by the calling thread, strips[i] by workerThreads[i - 1].
+    std::vector<Strip> strips;
+    std::vector<std::thread> workerThreads;
+    std::mutex mutex;
+    std::condition_variable startCondition;
+    std::condition_variable doneCondition;
+    uint64_t generation = 0;
+    size_t pending = 0;
+    size_t stripCount = 0; // Strips of the current frame
+    bool stopping = false;
+    // Destination of the current frame, for decodeStrip()
+    bool planar = false;
+    int frameWidth = 0;
+    uint8_t* outputPlanes[3] = {};
+    int outputStrides[3] = {};
+    int chromaScaleY = 1;
+
+    void workerLoop(size_t index);
+    void decodeStrip(Strip& strip);
+    // Cut the JPEG into strips at restart markers on MCU row boundaries. Returns false if there aren't any.
+    bool split(const uint8_t* jpeg, size_t length, int width, int height, int subsampling);
+    bool decodeWhole(const uint8_t* jpeg, size_t length);
+    bool decodeStrips();
+public:
+    // threads decode the strips of one frame in parallel, 1 decodes every frame as a whole
+    explicit JpegDecoder(int threads = 1);
+    ~JpegDecoder();
+
+    JpegDecoder(const JpegDecoder&) = delete;
+    JpegDecoder& operator=(const JpegDecoder&) = delete;
+
+    // Allocate the buffers for frames of this size up front, so the first frames don't have to
+    void reserve(int width, int height, bool planar);
+
+    // Decode a JPEG into frame, which stays valid until the next call. With planar, YCbCr and grayscale JPEGs become a
+    // YCbCrPlanar frame, anything else RGB24. Returns false if the data isn't a JPEG that can be decoded.
+    bool decode(const uint8_t* jpeg, size_t length, bool planar, Frame& frame);
+
+    // Frames decoded in strips and as a whole
+    uint64_t splitFrames = 0;
+    uint64_t wholeFrames = 0;
+
+    // The buffers, for pre-faulting them
+    const AlignedBuffer& rgb() const { return rgbBuffer; }
+    const AlignedBuffer& planes() const { return planeBuffer; }
+};
@@ -0,0 +1,123 @@
+#include <cstring>
+#include "JpegScanner.h"
+
+size_t JpegScanner::findStart(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (data[i] == 0xFF && data[i + 1] == 0xD8) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+size_t JpegScanner::findEnd(const uint8_t* data, size_t len) {
+    size_t pos = 2; // Skip SOI
+    while (pos + 1 < len) {
+        if (data[pos] != 0xFF) {
+            // Not at a marker, the stream is corrupt. Resynchronize at the next marker.
+            pos++;
+            continue;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++; // Fill byte
+            continue;
+        }
+        if (marker == 0xD9) {
+            return pos + 2; // EOI
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2; // Markers without a length
+            continue;
+        }
+        if (pos + 3 >= len) {
+            return 0;
+        }
+        size_t segmentLength = (data[pos + 2] << 8) | data[pos + 3];
+        pos += 2 + segmentLength;
+        if (marker == 0xDA) {
+            // Entropy coded data follows SOS. 0xFF is always stuffed with 0x00 there, and RSTn markers are part of the scan, so the scan ends at the first other marker.
+            while (pos + 1 < len) {
+                const void* ff = std::memchr(data + pos, 0xFF, len - pos - 1);
+                if (ff == nullptr) {
+                    return 0;
+                }
+                pos = static_cast<const uint8_t*>(ff) - data;
+                uint8_t next = data[pos + 1];
+                if (next == 0xFF) {
+                    pos++; // Fill byte before a marker
+                }
+                else if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+                    pos += 2;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+bool JpegScanner::findRestarts(const uint8_t* data, size_t len, JpegRestarts& restarts) {
+    restarts.markers.clear();
+    restarts.interval = 0;
+    bool sequential = false;
+    size_t pos = 2; // Skip SOI
+    while (pos + 3 < len) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        size_t segmentLength = (data[pos + 2] << 8) | data[pos + 3];
+        if (marker == 0xC0 || marker == 0xC1) {
+            // Baseline and extended sequential Huffman. Everything else (progressive, lossless, arithmetic) is decoded as a whole.
+            restarts.frameHeader = pos;
+            sequential = true;
+        }
+        else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            return false;
+        }
+        else if (marker == 0xDD && segmentLength == 4) {
+            restarts.interval = (data[pos + 4] << 8) | data[pos + 5];
+        }
+        else if (marker == 0xDA) {
+            // The scan has to contain every component of the frame, otherwise more scans follow
+            const size_t frame = restarts.frameHeader;
+            if (!sequential || restarts.interval == 0 || pos + 4 >= len || frame + 9 >= len || data[pos + 4] != data[frame + 9]) {
+                return false;
+            }
+            pos += 2 + segmentLength;
+            restarts.scanData = pos;
+            while (pos + 1 < len) {
+                const void* ff = std::memchr(data + pos, 0xFF, len - pos - 1);
+                if (ff == nullptr) {
+                    return false;
+                }
+                pos = static_cast<const uint8_t*>(ff) - data;
+                uint8_t next = data[pos + 1];
+                if (next == 0xFF) {
+                    pos++;
+                }
+                else if (next == 0x00) {
+                    pos += 2;
+                }
+                else if (next >= 0xD0 && next <= 0xD7) {
+                    restarts.markers.push_back(pos);
+                    pos += 2;
+                }
+                else {
+                    restarts.scanEnd = pos;
+                    return next == 0xD9 && !restarts.markers.empty();
+                }
+            }
+            return false;
+        }
+        pos += 2 + segmentLength;
+    }
+    return false;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Structure of a sequential, single scan JPEG with restart markers, which can be cut into pieces that decode independently
+struct JpegRestarts {
+    size_t frameHeader = 0;     // Offset of the SOF segment
+    size_t scanData = 0;        // Offset of the entropy coded data, right after the SOS segment
+    size_t scanEnd = 0;         // Offset of the EOI marker
+    int interval = 0;           // MCUs between two restart markers
+    std::vector<size_t> markers; // Offset of every RSTn marker in the scan
+};
+
+// Finds JPEG image boundaries in a byte stream by walking the marker structure, so MJPEG streams can be split without decoding them
+class JpegScanner {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Offset of the next SOI marker, or npos if there is none
+    static size_t findStart(const uint8_t* data, size_t len);
+    // Length of the complete JPEG image starting at data (which must begin with SOI), or 0 if the image is not complete yet
+    static size_t findEnd(const uint8_t* data, size_t len);
+    // Locate the restart markers of a complete JPEG. Returns false if it has none, or can't be cut at them: progressive or
+    // multi-scan images, where every scan covers the whole picture.
+    static bool findRestarts(const uint8_t* data, size_t len, JpegRestarts& restarts);
+};
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include <stdexcept>
+#include "LatencyTracker.h"
+
+LatencyTracker::LatencyTracker(size_t window) : samples(window) {
+    if (window == 0) {
+        throw std::invalid_argument("window must be greater than 0");
+    }
+    sorted.reserve(window);
+}
+
+void LatencyTracker::add(int64_t value) {
+    samples[pos] = value;
+    pos = (pos + 1) % samples.size();
+    count = std::min(count + 1, samples.size());
+}
+
+int64_t LatencyTracker::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    sorted.assign(samples.begin(), samples.begin() + count);
+    auto nth = sorted.begin() + std::min(count - 1, static_cast<size_t>(fraction * count));
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
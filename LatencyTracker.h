@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// The most recent latency samples, for percentiles in the status line. Unlike Averager, a few slow frames among many fast ones stay visible.
+class LatencyTracker {
+    std::vector<int64_t> samples;
+    size_t pos = 0;
+    size_t count = 0;
+    mutable std::vector<int64_t> sorted;
+public:
+    explicit LatencyTracker(size_t window = 512);
+
+    void add(int64_t value);
+    // Value below which the given fraction of the samples lies, like 0.99 for p99. 0 without samples.
+    int64_t percentile(double fraction) const;
+};
@@ -0,0 +1,9 @@
+#include "LedFraming.h"
+
+void LedFraming::escape(uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == delimiter) {
+            data[i] -= 1;
+        }
+    }
+}
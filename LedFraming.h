@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Serial/network message framing: x*3 brightness bytes followed by a delimiter
+class LedFraming {
+public:
+    static constexpr uint8_t delimiter = '\n';
+
+    // Replace delimiter values in the LED data with the closest brightness that is not the delimiter
+    static void escape(uint8_t* data, size_t len);
+};
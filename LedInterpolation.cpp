@@ -0,0 +1,59 @@
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <algorithm>
+#include "ColorOfBlock.hpp"
+#include "LedInterpolation.h"
+
+// from * (256 - w) + to * w is at most 255 * 256, so the products and their sum fit into 16 bits unsigned, rounding included
+template <typename SIMDType>
+struct BlendImpl {
+    static size_t blend(const uint8_t* from, const uint8_t* to, uint32_t weight, uint8_t* out, size_t len, size_t i) {
+        for (; i < len; i++) {
+            out[i] = static_cast<uint8_t>((from[i] * (LedInterpolation::weightOne - weight) + to[i] * weight + 128) >> 8);
+        }
+        return i;
+    }
+};
+
+// Specialization for SSE2, 16 bytes at a time
+template <>
+struct BlendImpl<SSE2> {
+    static size_t blend(const uint8_t* from, const uint8_t* to, uint32_t weight, uint8_t* out, size_t len, size_t i) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wTo = _mm_set1_epi16(static_cast<short>(weight));
+        const __m128i wFrom = _mm_set1_epi16(static_cast<short>(LedInterpolation::weightOne - weight));
+        const __m128i round = _mm_set1_epi16(128);
+        for (; i + 16 <= len; i += 16) {
+            __m128i f = _mm_loadu_si128((const __m128i*)(from + i));
+            __m128i t = _mm_loadu_si128((const __m128i*)(to + i));
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), wFrom), _mm_mullo_epi16(_mm_unpacklo_epi8(t, zero), wTo)), round);
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), wFrom), _mm_mullo_epi16(_mm_unpackhi_epi8(t, zero), wTo)), round);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+        }
+        return BlendImpl<void>::blend(from, to, weight, out, len, i);
+    }
+};
+
+// Specialization for AVX2, 32 bytes at a time. Unpacking and packing both work within 128 bit lanes, so the byte order is preserved.
+template <>
+struct BlendImpl<AVX2> {
+    static size_t blend(const uint8_t* from, const uint8_t* to, uint32_t weight, uint8_t* out, size_t len, size_t i) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i wTo = _mm256_set1_epi16(static_cast<short>(weight));
+        const __m256i wFrom = _mm256_set1_epi16(static_cast<short>(LedInterpolation::weightOne - weight));
+        const __m256i round = _mm256_set1_epi16(128);
+        for (; i + 32 <= len; i += 32) {
+            __m256i f = _mm256_loadu_si256((const __m256i*)(from + i));
+            __m256i t = _mm256_loadu_si256((const __m256i*)(to + i));
+            __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(f, zero), wFrom), _mm256_mullo_epi16(_mm256_unpacklo_epi8(t, zero), wTo)), round);
+            __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(f, zero), wFrom), _mm256_mullo_epi16(_mm256_unpackhi_epi8(t, zero), wTo)), round);
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+        }
+        return BlendImpl<SSE2>::blend(from, to, weight, out, len, i);
+    }
+};
+
+void LedInterpolation::blend(const uint8_t* from, const uint8_t* to, uint32_t weight, uint8_t* out, size_t len) {
+    weight = std::min(weight, weightOne);
+    BlendImpl<BestSIMD>::blend(from, to, weight, out, len, 0);
+}
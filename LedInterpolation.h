@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Blending between two LED frames, for output rates above the capture rate
+class LedInterpolation {
+public:
+    static constexpr uint32_t weightOne = 256; // Weight of a blend that is entirely "to"
+
+    // out = from * (1 - weight / weightOne) + to * weight / weightOne, rounded, in 8.8 fixed point. out may be from or to.
+    static void blend(const uint8_t* from, const uint8_t* to, uint32_t weight, uint8_t* out, size_t len);
+};
@@ -0,0 +1,75 @@
+#include <stdexcept>
+#include <algorithm>
+#include "LedLayout.h"
+
+// Keep a zone inside the area and at least one pixel large, whatever the border size and LED count. The area can be smaller
+// than the layout was made for: a smaller capture mode, or the picture inside black bars.
+static Zone clampZone(Zone zone, int left, int top, int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    zone.x = std::clamp(zone.x, left, left + width - 1);
+    zone.y = std::clamp(zone.y, top, top + height - 1);
+    zone.width = std::clamp(zone.width, 1, left + width - zone.x);
+    zone.height = std::clamp(zone.height, 1, top + height - zone.y);
+    return zone;
+}
+
+LedLayout::LedLayout(int horizontalLeds, int verticalLeds, int borderSize)
+        : horizontalLeds(horizontalLeds), verticalLeds(verticalLeds), borderSize(borderSize) {
+    if (horizontalLeds <= 0 || verticalLeds <= 0 || borderSize <= 0) {
+        throw std::invalid_argument("LED counts and border size must be greater than 0");
+    }
+}
+
+std::vector<Zone> LedLayout::edgeZones(Edge edge, int left, int top, int width, int height) const {
+    const float columnBlockHeight = (float)height / (float)verticalLeds;
+    const float rowBlockWidth = (float)width / (float)horizontalLeds;
+
+    std::vector<Zone> result;
+    switch (edge) {
+        case Edge::Right:
+            for (int i = verticalLeds - 1; i >= 0; i--) {
+                result.push_back({left + width - borderSize, top + static_cast<int>(static_cast<float>(i) * columnBlockHeight), borderSize, (int)columnBlockHeight});
+            }
+            break;
+        case Edge::Top:
+            for (int i = horizontalLeds - 1; i >= 0; i--) {
+                result.push_back({left + static_cast<int>(static_cast<float>(i) * rowBlockWidth), top, (int)rowBlockWidth, borderSize});
+            }
+            break;
+        case Edge::Left:
+            for (int i = 0; i < verticalLeds; i++) {
+                result.push_back({left, top + static_cast<int>(static_cast<float>(i) * columnBlockHeight), borderSize, (int)columnBlockHeight});
+            }
+            break;
+        case Edge::Bottom:
+            for (int i = 0; i < horizontalLeds; i++) {
+                result.push_back({left + static_cast<int>(static_cast<float>(i) * rowBlockWidth), top + height - borderSize, (int)rowBlockWidth, borderSize});
+            }
+            break;
+    }
+    for (Zone& zone : result) {
+        zone = clampZone(zone, left, top, width, height);
+    }
+    return result;
+}
+
+std::vector<Zone> LedLayout::zones(int left, int top, int width, int height) const {
+    std::vector<Zone> result;
+    result.reserve(ledCount());
+    for (Edge edge : {Edge::Right, Edge::Top, Edge::Left, Edge::Bottom}) {
+        std::vector<Zone> edge_zones = edgeZones(edge, left, top, width, height);
+        result.insert(result.end(), edge_zones.begin(), edge_zones.end());
+    }
+    return result;
+}
+
+size_t LedLayout::edgeOffset(Edge edge) const {
+    switch (edge) {
+        case Edge::Right: return 0;
+        case Edge::Top: return verticalLeds;
+        case Edge::Left: return verticalLeds + horizontalLeds;
+        case Edge::Bottom: return verticalLeds * 2 + horizontalLeds;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+// Rectangle of the image that is averaged into the color of one LED
+struct Zone {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Edges in the order the LED strip runs along them
+enum class Edge {
+    Right,  // bottom to top
+    Top,    // right to left
+    Left,   // top to bottom
+    Bottom, // left to right
+};
+
+class LedLayout {
+    int horizontalLeds;
+    int verticalLeds;
+    int borderSize;
+public:
+    LedLayout(int horizontalLeds, int verticalLeds, int borderSize);
+
+    // Zones along one edge of an image area, in LED order. Every zone lies within the area and is at least one pixel large.
+    std::vector<Zone> edgeZones(Edge edge, int left, int top, int width, int height) const;
+    // Zones of all four edges of an image area, in LED order
+    std::vector<Zone> zones(int left, int top, int width, int height) const;
+
+    size_t edgeOffset(Edge edge) const; // Index of the first LED of the edge
+    size_t ledCount() const { return static_cast<size_t>(horizontalLeds + verticalLeds) * 2; }
+    int getBorderSize() const { return borderSize; }
+};
@@ -0,0 +1,262 @@
+#include <iostream>
+#include <algorithm>
+#include <optional>
+#include "LedPipeline.h"
+
+ZoneMode LedPipeline::zoneModeFromName(const std::string& name) {
+    if (name == "dominant") return ZoneMode::Dominant;
+    if (name == "saturation") return ZoneMode::Saturation;
+    if (name == "trimmed") return ZoneMode::Trimmed;
+    return ZoneMode::Mean;
+}
+
+void LedPipeline::checkRawYuvZoneMode(const std::string& zoneMode, const std::string& source) {
+    if (zoneModeFromName(zoneMode) != ZoneMode::Mean) {
+        std::cout << std::endl << source << " delivers YUYV or NV12, zone_mode " << zoneMode << " has no effect on it and the mean is used."
+                  << " It needs MJPEG or packed RGB input." << std::endl;
+    }
+}
+
+void LedPipeline::enterRealtime(const Config& config) {
+    if (config.rt_policy == "off" && config.capture_cpu < 0 && !config.lock_memory) {
+        return;
+    }
+    std::cout << "Real-time profile: " << Realtime::privileges() << std::endl;
+    if (config.capture_cpu >= 0) {
+        if (config.rt_policy == "deadline") {
+            std::cout << "  capture_cpu is ignored with SCHED_DEADLINE, which needs the thread to be allowed on all cores" << std::endl;
+        }
+        else {
+            std::cout << "  capture thread on CPU " << config.capture_cpu << ": " << (Realtime::pin(config.capture_cpu) ? "ok" : "failed") << std::endl;
+        }
+    }
+    const ThreadSchedule schedule = config.threadSchedule(Config::ThreadRole::Capture);
+    if (schedule.policy != ThreadSchedule::Policy::Normal) {
+        std::string error = Realtime::setSchedule(schedule);
+        std::cout << "  capture thread " << Realtime::policyName(schedule.policy);
+        if (schedule.policy == ThreadSchedule::Policy::Deadline) {
+            std::cout << " " << schedule.runtimeUs << "us every " << schedule.periodUs << "us";
+        }
+        else {
+            std::cout << " priority " << schedule.priority;
+        }
+        std::cout << ": " << (error.empty() ? "ok" : error) << std::endl;
+    }
+    if (config.lock_memory) {
+        std::string error = Realtime::lockMemory();
+        std::cout << "  memory locked: " << (error.empty() ? "ok" : error) << std::endl;
+    }
+}
+
+std::unique_ptr<FlightRecorder> LedPipeline::openRecorder(const Config& config) {
+    if (config.flight_recorder.empty()) {
+        return nullptr;
+    }
+    auto recorder = std::make_unique<FlightRecorder>(config.flight_recorder, static_cast<size_t>(config.flight_recorder_size) << 20, config.flight_recorder_delta);
+    std::cout << "Flight recorder: " << config.flight_recorder << " (" << config.flight_recorder_size << "MB" << (config.flight_recorder_delta ? ", delta-encoded" : "") << ")" << std::endl;
+    return recorder;
+}
+
+LedPipeline::LedPipeline(const Config& config, int frameWidth, int frameHeight) :
+    startConfig(config),
+    config(config),
+    frameWidth(frameWidth),
+    frameHeight(frameHeight),
+    layout(config.horizontal_leds, config.vertical_leds, config.border_size),
+    zoneExtractor(layout.zones(0, 0, frameWidth, frameHeight), zoneModeFromName(config.zone_mode)),
+    colorCorrection(config.gamma_correction),
+    ledDataAverager(config.averaging_samples, layout.ledCount() * 3),
+    extractionPool(std::make_unique<ExtractionPool>(config.extract_threads, config.extract_cpus, config.threadSchedule(Config::ThreadRole::Extract))),
+    output(OutputSink::fromConfig(config, layout.ledCount(), startConfig.threadSchedule(Config::ThreadRole::Serial), startConfig.serial_cpus)),
+    ledData(layout.ledCount() * 3),
+    ledDataAvg(layout.ledCount() * 3) {
+    if (config.letterbox_detect) {
+        barDetector.emplace(config.letterbox_interval, config.letterbox_threshold);
+    }
+    zoneExtractor.setSampling(config.sample_rows, config.sample_cols);
+    if (config.output_fps > 0) {
+        outputClock = std::make_unique<OutputClock>(*output, layout.ledCount(), config.output_fps, config.threadSchedule(Config::ThreadRole::Serial));
+    }
+}
+
+std::string LedPipeline::apply(const Config& newConfig) {
+    // Only report settings that changed with this update and differ from what the capture stream is running with
+    const std::vector<std::string> running = startConfig.restartRequired(newConfig);
+    for (const std::string& key : config.restartRequired(newConfig)) {
+        if (std::find(running.begin(), running.end(), key) != running.end()) {
+            std::cout << std::endl << key << " changed, this only takes effect after a restart" << std::endl;
+        }
+    }
+
+    const bool ledsChanged = newConfig.vertical_leds != config.vertical_leds || newConfig.horizontal_leds != config.horizontal_leds;
+    const bool layoutChanged = ledsChanged || newConfig.border_size != config.border_size;
+    const bool gammaChanged = newConfig.gamma_correction != config.gamma_correction;
+    const bool averagingChanged = ledsChanged || newConfig.averaging_samples != config.averaging_samples;
+    const bool detectorChanged = newConfig.letterbox_detect != config.letterbox_detect || newConfig.letterbox_interval != config.letterbox_interval ||
+                                 newConfig.letterbox_threshold != config.letterbox_threshold;
+    const bool poolChanged = newConfig.extract_threads != config.extract_threads || newConfig.extract_cpus != config.extract_cpus;
+    // Outputs that couldn't be restored after a failed change are retried with every change
+    const bool outputChanged = !output || ledsChanged || newConfig.serial_port != config.serial_port || newConfig.baud != config.baud ||
+                               newConfig.serial_segments != config.serial_segments || newConfig.serial_calibrate != config.serial_calibrate ||
+                               newConfig.outputs != config.outputs;
+    const bool clockChanged = outputChanged || newConfig.output_fps != config.output_fps;
+
+    // Build everything first and only swap it in once nothing can fail anymore
+    std::optional<LedLayout> newLayout;
+    std::unique_ptr<ExtractionPool> newPool;
+    std::unique_ptr<OutputSink> newOutput;
+    std::unique_ptr<OutputClock> newClock;
+    try {
+        newLayout.emplace(newConfig.horizontal_leds, newConfig.vertical_leds, newConfig.border_size);
+        const Zone area = pictureArea();
+        if (newConfig.border_size != config.border_size && newConfig.border_size * 2 > std::min(area.width, area.height)) {
+            throw std::invalid_argument("border_size " + std::to_string(newConfig.border_size) + " is more than half of the " + std::to_string(area.width) + "x" +
+                                        std::to_string(area.height) + " picture");
+        }
+        if (poolChanged) {
+            newPool = std::make_unique<ExtractionPool>(newConfig.extract_threads, newConfig.extract_cpus, startConfig.threadSchedule(Config::ThreadRole::Extract));
+        }
+        if (clockChanged) {
+            outputClock.reset(); // Sends to the old output
+        }
+        if (outputChanged) {
+            // The old ports have to be closed before they can be opened again
+            output.reset();
+            newOutput = OutputSink::fromConfig(newConfig, newLayout->ledCount(), startConfig.threadSchedule(Config::ThreadRole::Serial), startConfig.serial_cpus);
+        }
+        if (clockChanged && newConfig.output_fps > 0) {
+            newClock = std::make_unique<OutputClock>(newOutput ? *newOutput : *output, newLayout->ledCount(), newConfig.output_fps, startConfig.threadSchedule(Config::ThreadRole::Serial));
+        }
+    }
+    catch (const std::exception& e) {
+        std::cout << std::endl << "Can't apply config change: " << e.what() << std::endl;
+        // Put back what was torn down for the new settings. The clock goes first, it sends to the output.
+        newClock.reset();
+        newOutput.reset();
+        try {
+            if (!output) {
+                output = OutputSink::fromConfig(config, layout.ledCount(), startConfig.threadSchedule(Config::ThreadRole::Serial), startConfig.serial_cpus);
+            }
+            if (!outputClock && config.output_fps > 0) {
+                outputClock = std::make_unique<OutputClock>(*output, layout.ledCount(), config.output_fps, startConfig.threadSchedule(Config::ThreadRole::Serial));
+            }
+        }
+        catch (const std::exception& restoreError) {
+            std::cout << "Can't restore the outputs: " << restoreError.what() << ", trying again with the next config change" << std::endl;
+        }
+        return e.what();
+    }
+    const size_t newLedCount = newLayout->ledCount();
+
+    if (detectorChanged) {
+        barDetector.reset();
+        if (newConfig.letterbox_detect) {
+            barDetector.emplace(newConfig.letterbox_interval, newConfig.letterbox_threshold);
+        }
+    }
+    if (layoutChanged) {
+        layout = *newLayout;
+        ledData.assign(newLedCount * 3, 0);
+        ledDataAvg.assign(newLedCount * 3, 0);
+    }
+    if (layoutChanged || detectorChanged) {
+        updateZones();
+    }
+    if (newConfig.zone_mode != config.zone_mode) {
+        zoneExtractor.setMode(zoneModeFromName(newConfig.zone_mode));
+        if (!rawYuvSource.empty()) {
+            checkRawYuvZoneMode(newConfig.zone_mode, rawYuvSource);
+        }
+    }
+    if (newConfig.sample_rows != config.sample_rows || newConfig.sample_cols != config.sample_cols) {
+        zoneExtractor.setSampling(newConfig.sample_rows, newConfig.sample_cols);
+    }
+    if (gammaChanged) {
+        colorCorrection = ColorCorrection(newConfig.gamma_correction);
+    }
+    if (averagingChanged) {
+        ledDataAverager = ArrayAverager<uint8_t>(newConfig.averaging_samples, newLedCount * 3);
+    }
+    if (newPool) {
+        extractionPool = std::move(newPool);
+    }
+    if (newOutput) {
+        output = std::move(newOutput);
+    }
+    if (newClock) {
+        outputClock = std::move(newClock);
+    }
+    config = newConfig;
+    std::cout << std::endl << "Config updated" << std::endl;
+    return "";
+}
+
+void LedPipeline::setRawYuv(bool yuv, const std::string& source) {
+    if (yuv && rawYuvSource.empty()) {
+        checkRawYuvZoneMode(config.zone_mode, source);
+    }
+    rawYuvSource = yuv ? source : "";
+}
+
+void LedPipeline::setFrameSize(int width, int height) {
+    if (width != frameWidth || height != frameHeight) {
+        frameWidth = width;
+        frameHeight = height;
+        updateZones();
+    }
+}
+
+Zone LedPipeline::pictureArea() const {
+    if (barDetector && barDetector->activeArea().width > 0) {
+        return barDetector->activeArea();
+    }
+    return Zone{0, 0, frameWidth, frameHeight};
+}
+
+void LedPipeline::updateZones() {
+    const Zone area = pictureArea();
+    zoneExtractor.setZones(layout.zones(area.x, area.y, area.width, area.height));
+}
+
+void LedPipeline::extract(const Frame& frame) {
+    setFrameSize(frame.width, frame.height);
+    if (barDetector && barDetector->update(frame)) {
+        const Zone& area = barDetector->activeArea();
+        std::cout << std::endl << "Picture area: " << area.width << "x" << area.height << " at " << area.x << "," << area.y << std::endl;
+        updateZones();
+    }
+    extractionPool->extract(zoneExtractor, frame, ledData.data());
+}
+
+void LedPipeline::setColors(const uint8_t* colors) {
+    std::copy(colors, colors + ledData.size(), ledData.begin());
+}
+
+const std::vector<uint8_t>& LedPipeline::correct() {
+    colorCorrection.apply(ledData.data(), ledData.size());
+    ledDataAverager.add(ledData.data());
+    ledDataAverager.getAverage<uint64_t>(ledDataAvg.data()); // Use uint64_t for summing internally to prevent overflow
+    return ledDataAvg;
+}
+
+void LedPipeline::send() {
+    submit(ledDataAvg.data());
+}
+
+void LedPipeline::sendDimmed(uint32_t weight) {
+    ledDataDimmed.resize(ledDataAvg.size());
+    for (size_t i = 0; i < ledDataAvg.size(); i++) {
+        ledDataDimmed[i] = static_cast<uint8_t>((ledDataAvg[i] * weight + 128) >> 8);
+    }
+    submit(ledDataDimmed.data());
+}
+
+void LedPipeline::submit(const uint8_t* colors) {
+    if (outputClock) {
+        outputClock->push(colors);
+        return;
+    }
+    if (output) {
+        output->submit(colors);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <optional>
+#include <string>
+#include <cstdint>
+#include "Config.h"
+#include "Frame.h"
+#include "LedLayout.h"
+#include "ZoneExtractor.h"
+#include "ExtractionPool.h"
+#include "BarDetector.h"
+#include "ColorCorrection.h"
+#include "ArrayAverager.h"
+#include "OutputSink.h"
+#include "OutputClock.h"
+#include "FlightRecorder.h"
+
+// Everything between a captured frame and the outputs: zone extraction, gamma correction, averaging and output.
+// Owns the tables built from the config, so a config change only rebuilds the ones it affects.
+class LedPipeline {
+    const Config startConfig; // Settings the capture stream was opened with
+    Config config;            // Settings the tables were built from
+    int frameWidth;
+    int frameHeight;
+    std::string rawYuvSource; // Device or pipe delivering YUYV or NV12 frames, which only support the mean zone mode. Empty for other formats.
+
+    LedLayout layout;
+    ZoneExtractor zoneExtractor;
+    ColorCorrection colorCorrection;
+    ArrayAverager<uint8_t> ledDataAverager;
+    std::unique_ptr<ExtractionPool> extractionPool;
+    std::unique_ptr<OutputSink> output;
+    std::unique_ptr<OutputClock> outputClock; // Only with output_fps. Uses output, so it's declared (and destroyed) after it.
+    std::optional<BarDetector> barDetector; // Only with letterbox_detect
+
+    std::vector<uint8_t> ledData;    // Colors of the current frame
+    std::vector<uint8_t> ledDataAvg; // Corrected and averaged
+    std::vector<uint8_t> ledDataDimmed;
+
+    // Hand colors to the output clock, or submit them to the outputs
+    void submit(const uint8_t* colors);
+
+    // The picture area found by the bar detector, or the whole frame
+    Zone pictureArea() const;
+    // Place the zones along the picture area
+    void updateZones();
+public:
+    // Apply the real-time profile to the calling thread, which captures, decodes and extracts: CPU pinning, the scheduling policy, and
+    // mlockall() when lock_memory is set. Call it once the capture device and the buffers are set up. Prints what was granted.
+    // The pipeline's own threads get theirs when they are created.
+    static void enterRealtime(const Config& config);
+
+    // zone_mode config values, like "dominant"
+    static ZoneMode zoneModeFromName(const std::string& name);
+    // Print a warning if zoneMode has no effect on the raw YUV frames of source
+    static void checkRawYuvZoneMode(const std::string& zoneMode, const std::string& source);
+
+    // The flight recorder configured by flight_recorder, or nullptr. Prints where it records.
+    static std::unique_ptr<FlightRecorder> openRecorder(const Config& config);
+
+    LedPipeline(const Config& config, int frameWidth, int frameHeight);
+
+    // Switch to new settings between two frames. Zones, the gamma table, the averager, the extraction threads and the
+    // outputs are each only rebuilt if a setting they depend on changed. If anything fails, the old settings stay active and the
+    // error is returned, otherwise an empty string.
+    std::string apply(const Config& newConfig);
+
+    // Recalculate the zones if the frame size changed
+    void setFrameSize(int width, int height);
+    // Whether source delivers raw YUV frames. The zone mode then falls back to the mean, which is printed here and by apply().
+    void setRawYuv(bool yuv, const std::string& source);
+
+    // Calculate the colors of the LEDs based on the image
+    void extract(const Frame& frame);
+    // Whether MJPEG frames should be decoded to their YCbCr planes rather than RGB: configured, and the zone mode can use them
+    bool decodesPlanar() const { return config.jpeg_decode == "yuv" && zoneExtractor.acceptsYUV(); }
+
+    // Use colors extracted elsewhere, like the composite of several capture sources, instead of extract(). ledCount() * 3 bytes.
+    void setColors(const uint8_t* colors);
+    size_t ledCount() const { return layout.ledCount(); }
+
+    // Gamma correction and averaging. Returns the LED colors send() will submit.
+    const std::vector<uint8_t>& correct();
+
+    // Send the corrected data to the outputs, or hand it to the output clock which fades to it
+    void send();
+    // Send the last corrected colors again at weight / 256 of their brightness, for fading out while the input is gone
+    void sendDimmed(uint32_t weight);
+
+    std::string statusLine() { return (output ? output->statusLine() : " | no outputs") + (outputClock ? outputClock->statusLine() : ""); }
+    const Config& getConfig() const { return config; }
+};
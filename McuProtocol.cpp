@@ -0,0 +1,53 @@
+#include <chrono>
+#include "McuProtocol.h"
+
+std::optional<int64_t> McuProtocol::field(const std::string& line, const std::string& key) {
+    size_t pos = line.find(" " + key + "=");
+    if (pos == std::string::npos) {
+        return std::nullopt;
+    }
+    try {
+        return std::stoll(line.substr(pos + key.size() + 2));
+    }
+    catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+std::optional<McuCapabilities> McuProtocol::handshake(SerialPort& port, int timeoutMs) {
+    // The leading delimiter terminates whatever partial line the MCU may still have buffered
+    const char request[] = "\nAMBI?\n";
+    port.write(request, sizeof(request) - 1);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::string line;
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0 || !port.pollLine(line, static_cast<int>(remaining))) {
+            return std::nullopt;
+        }
+        if (line.rfind("AMBI ", 0) != 0) {
+            continue; // Stale stats or other output from before the handshake
+        }
+
+        McuCapabilities capabilities;
+        capabilities.protocolVersion = static_cast<int>(field(line, "proto").value_or(0));
+        capabilities.ledCount = static_cast<size_t>(field(line, "leds").value_or(0));
+        capabilities.bufferSize = static_cast<size_t>(field(line, "buf").value_or(0));
+        capabilities.showUs = field(line, "show_us").value_or(0);
+        if (capabilities.protocolVersion < 1 || capabilities.ledCount == 0) {
+            return std::nullopt;
+        }
+        return capabilities;
+    }
+}
+
+bool McuProtocol::parseStats(const std::string& line, McuStats& stats) {
+    if (line.rfind("STAT ", 0) != 0) {
+        return false;
+    }
+    stats.accepted = static_cast<uint64_t>(field(line, "accepted").value_or(0));
+    stats.rejected = static_cast<uint64_t>(field(line, "rejected").value_or(0));
+    stats.showUs = field(line, "show_us").value_or(0);
+    return true;
+}
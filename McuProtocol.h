@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
+#include "SerialPort.hpp"
+
+// What the MCU firmware reported in the startup handshake
+struct McuCapabilities {
+    int protocolVersion = 0;
+    size_t ledCount = 0;
+    size_t bufferSize = 0;
+    int64_t showUs = 0; // Measured duration of pixels.show()
+};
+
+// Frame counters the MCU reports periodically
+struct McuStats {
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    int64_t showUs = 0;
+};
+
+// Host side of the MCU control messages. They are lines like the LED frames, but of a length no LED frame has, so older firmware just drops them as malformed.
+class McuProtocol {
+    static std::optional<int64_t> field(const std::string& line, const std::string& key);
+public:
+    // Ask the MCU for its capabilities. Returns nothing if it doesn't answer, like firmware predating the handshake.
+    static std::optional<McuCapabilities> handshake(SerialPort& port, int timeoutMs = 500);
+    // Parse a "STAT ..." line, returns false for any other line
+    static bool parseStats(const std::string& line, McuStats& stats);
+};
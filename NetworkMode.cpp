@@ -2,19 +2,60 @@
 #include <iostream>
 #include <cstdint>
 #include <complex>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
 #include <sys/socket.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
-#include "SerialPort.hpp"
+#include "OutputSink.h"
+#include "UringReceiver.h"
 #include "NetworkMode.hpp"
 
-void NetworkMode::start(std::map<std::string, std::string> config) {
-    const int baudrate = std::stoi(config["baud"]);
-    const int port = std::stoi(config["port"]);
-    const int verticalLeds = std::stoi(config["verticalLeds"]);
-    const int horizontalLeds = std::stoi(config["horizontalLeds"]);
+namespace {
+    // Frames, syscalls and CPU time of the receiving thread, printed once a second so the I/O engines can be compared
+    class ReceiveStats {
+        std::chrono::steady_clock::time_point lastTime = std::chrono::steady_clock::now();
+        uint64_t lastFrames = 0;
+        uint64_t lastSyscalls = 0;
+        int64_t lastCpuUs = cpuUs();
 
-    // Initialize serial port
-    SerialPort mcu = SerialPort(config["serial_port"], baudrate);
+        static int64_t cpuUs() {
+            rusage usage{};
+            getrusage(RUSAGE_THREAD, &usage);
+            return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+        }
+    public:
+        uint64_t frames = 0;
+        uint64_t syscalls = 0; // recv() or io_uring_enter()
+
+        void print(const char* engine, OutputSink& output) {
+            auto now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - lastTime).count();
+            if (seconds < 1.0) {
+                return;
+            }
+            const int64_t cpu = cpuUs();
+            const uint64_t newFrames = std::max<uint64_t>(frames - lastFrames, 1);
+            std::cout << "\r\033[K" << engine << ": " << static_cast<int>((frames - lastFrames) / seconds) << "fps, "
+                      << static_cast<double>(syscalls - lastSyscalls) / newFrames << " syscalls/frame, " << (cpu - lastCpuUs) / static_cast<int64_t>(newFrames) << "us CPU/frame"
+                      << output.statusLine();
+            std::cout.flush();
+            lastTime = now;
+            lastFrames = frames;
+            lastSyscalls = syscalls;
+            lastCpuUs = cpu;
+        }
+    };
+}
+
+void NetworkMode::start(const Config& config) {
+    const int port = config.port;
+    const size_t ledCount = config.ledCount();
+
+    // Initialize serial ports and network nodes
+    std::unique_ptr<OutputSink> output = OutputSink::fromConfig(config, ledCount);
 
     // Initialize socket
     int serverSocket = ::socket(AF_INET, SOCK_STREAM, 0);
@@ -37,10 +78,48 @@ void NetworkMode::start(std::map<std::string, std::string> config) {
         throw std::runtime_error("Error listening on socket");
     }
 
-    const size_t dataCount = verticalLeds * horizontalLeds * 2 * 3;
+    const size_t dataCount = ledCount * 3;
     std::unique_ptr<char[]> receiveBuf = std::make_unique<char[]>(dataCount * 2);
     std::unique_ptr<char[]> ledBuf = std::make_unique<char[]>(dataCount * 2);
     ssize_t ledBufPos = 0;
+    ReceiveStats stats;
+
+    // Split the received bytes into frames at the delimiter
+    auto onData = [&](const char* data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] == '\n') {
+                // Send the frame to the outputs. Frames of the wrong length would be ignored by the MCU, so they are not sent at all.
+                if (static_cast<size_t>(ledBufPos) == dataCount) {
+                    output->submit(reinterpret_cast<const uint8_t*>(ledBuf.get()));
+                    stats.frames++;
+                }
+                ledBufPos = 0;
+            }
+            else {
+                ledBuf[ledBufPos++] = data[i];
+                if(static_cast<size_t>(ledBufPos) >= static_cast<size_t>(dataCount * 2 - 1)) {
+                    ledBufPos = 0;
+                }
+            }
+        }
+    };
+
+    // Optional io_uring receive, falling back to blocking recv() where it isn't available
+#ifdef AMBILIGHT_IO_URING
+    std::unique_ptr<UringReceiver> uring;
+    if (config.io_engine == "io_uring") {
+        try {
+            uring = std::make_unique<UringReceiver>(dataCount * 2);
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << "Can't use io_uring, falling back to blocking receive: " << e.what() << std::endl;
+        }
+    }
+#else
+    if (config.io_engine == "io_uring") {
+        std::cout << "Built without liburing, falling back to blocking receive" << std::endl;
+    }
+#endif
 
     while(true) {
         // Accept connection
@@ -50,31 +129,44 @@ void NetworkMode::start(std::map<std::string, std::string> config) {
             std::cout << "Error accepting connection" << std::endl;
             exit(EXIT_FAILURE);
         }
+        ledBufPos = 0;
+
+#ifdef AMBILIGHT_IO_URING
+        if (uring) {
+            // Stats are printed after every batch of completions, as the receiver only returns on disconnect
+            auto onUringData = [&](const char* data, size_t len) {
+                onData(data, len);
+                stats.print("io_uring", *output);
+            };
+            if (uring->receive(clientSocket, onUringData, stats.syscalls)) {
+                std::cout << std::endl << "Client disconnected" << std::endl;
+                close(clientSocket);
+                continue;
+            }
+            std::cout << "This kernel has no multishot receive into provided buffers, falling back to blocking receive" << std::endl;
+            uring.reset();
+        }
+#endif
 
         while(true) {
+            stats.syscalls++;
             ssize_t len = ::recv(clientSocket, receiveBuf.get(), dataCount * 2, 0);
             if(len == 0) {
-                std::cout << "Client disconnected" << std::endl;
+                std::cout << std::endl << "Client disconnected" << std::endl;
+                close(clientSocket);
                 break;
             }
             if (len == -1) {
-                std::cout << "Error reading from socket" << std::endl;
-                continue;
-            }
-            for(int i = 0; i < len; i++) {
-                if (receiveBuf[i] == '\n') {
-                    // Write data to serial port
-                    mcu.write(ledBuf.get(), ledBufPos);
-                    mcu.write("\n", 1);
-                    ledBufPos = 0;
-                }
-                else {
-                    ledBuf[ledBufPos++] = receiveBuf[i];
-                    if(static_cast<size_t>(ledBufPos) >= static_cast<size_t>(dataCount * 2 - 1)) {
-                        ledBufPos = 0;
-                    }
+                if (errno == EINTR) {
+                    continue;
                 }
+                // Like a reset connection. Retrying would fail the same way forever, so wait for the next client instead.
+                std::cout << std::endl << "Error reading from socket: " << strerror(errno) << std::endl;
+                close(clientSocket);
+                break;
             }
+            onData(receiveBuf.get(), len);
+            stats.print("recv", *output);
         }
     }
-}
\ No newline at end of file
+}
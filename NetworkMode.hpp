@@ -1,9 +1,9 @@
 #pragma once
 #include <string>
-#include <map>
+#include "Config.h"
 
 class NetworkMode {
 public:
-    static void start(std::map<std::string, std::string> config);
+    static void start(const Config& config);
 };
 
@@ -0,0 +1,137 @@
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include "LedInterpolation.h"
+#include "OutputClock.h"
+
+OutputClock::OutputClock(OutputSink& output, size_t ledCount, int fps, const ThreadSchedule& schedule) :
+    output(output),
+    periodUs(1000000 / std::max(fps, 1)),
+    pending(ledCount * 3),
+    captureIntervalUs(1000000 / 30),
+    from(ledCount * 3),
+    to(ledCount * 3),
+    current(ledCount * 3),
+    fadeUs(captureIntervalUs) {
+    if (fps < 1) {
+        throw std::invalid_argument("Output rate must be at least 1 fps");
+    }
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd == -1) {
+        throw std::runtime_error("Error creating output timer");
+    }
+    itimerspec period{};
+    period.it_interval.tv_sec = periodUs / 1000000;
+    period.it_interval.tv_nsec = periodUs % 1000000 * 1000;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(timerFd, 0, &period, nullptr) == -1 || pipe2(wakePipe, O_CLOEXEC) == -1) {
+        close(timerFd);
+        throw std::runtime_error("Error starting output timer");
+    }
+    fadeStart = std::chrono::steady_clock::now();
+    thread = std::thread(&OutputClock::run, this);
+    std::string error = Realtime::setSchedule(schedule, thread.native_handle());
+    if (!error.empty()) {
+        std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for the output clock: " << error << std::endl;
+    }
+}
+
+OutputClock::~OutputClock() {
+    char wake = 0;
+    (void)!write(wakePipe[1], &wake, 1);
+    thread.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    close(timerFd);
+}
+
+void OutputClock::push(const uint8_t* ledData) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    std::copy(ledData, ledData + pending.size(), pending.begin());
+    hasPending = true;
+
+    // Follow the capture rate, but leave out gaps from hiccups or sleep mode, which would make every following fade sluggish
+    if (lastPush.time_since_epoch().count() != 0) {
+        const int64_t intervalUs = std::chrono::duration_cast<std::chrono::microseconds>(now - lastPush).count();
+        if (intervalUs < captureIntervalUs * 4) {
+            captureIntervalUs = std::max<int64_t>((captureIntervalUs * 7 + intervalUs) / 8, periodUs);
+        }
+    }
+    lastPush = now;
+}
+
+void OutputClock::run() {
+    pollfd fds[2] = {{wakePipe[0], POLLIN, 0}, {timerFd, POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            std::cout << "Output clock stopped: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (fds[0].revents) {
+            return;
+        }
+        uint64_t expirations = 0;
+        if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            if (expirations > 1) {
+                missedTicks += expirations - 1;
+            }
+            tick();
+        }
+    }
+}
+
+void OutputClock::tick() {
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hasPending) {
+            // Fade from what is shown right now, so a new frame never makes the LEDs jump, even if the previous fade isn't done
+            from.swap(current);
+            to.swap(pending);
+            hasPending = false;
+            fadeStart = now;
+            fadeUs = captureIntervalUs;
+        }
+    }
+
+    const int64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(now - fadeStart).count();
+    const uint32_t weight = static_cast<uint32_t>(std::min<int64_t>(elapsedUs * LedInterpolation::weightOne / std::max<int64_t>(fadeUs, 1), LedInterpolation::weightOne));
+    // Once the fade is done, the frame doesn't change anymore. Repeat it once a second only, instead of at the full output rate.
+    if (weight == LedInterpolation::weightOne) {
+        if (now < nextRepeat) {
+            return;
+        }
+        nextRepeat = now + std::chrono::seconds(1);
+    }
+    else {
+        nextRepeat = now;
+    }
+
+    LedInterpolation::blend(from.data(), to.data(), weight, current.data(), current.size());
+    output.submit(current.data());
+    framesSent++;
+}
+
+std::string OutputClock::statusLine() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastStatusTime).count();
+    if (seconds < 1.0) {
+        return lastStatus;
+    }
+    lastStatusTime = now;
+    uint64_t frames = framesSent;
+    std::stringstream status;
+    status << " | clock: " << static_cast<int>((frames - lastFramesSent) / seconds) << "fps missed " << missedTicks;
+    lastFramesSent = frames;
+    lastStatus = status.str();
+    return lastStatus;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "Realtime.h"
+#include "OutputSink.h"
+
+// Sends LED frames at its own rate, ticked by a timerfd, instead of one per captured frame. Every new captured frame starts a fade from
+// what is currently shown to it, lasting about one capture interval, so slow sources don't step and a late frame doesn't stop the fade
+// in progress or make the LEDs jump when it finally arrives.
+class OutputClock {
+    OutputSink& output;
+    const int64_t periodUs;
+
+    std::mutex mutex;
+    std::vector<uint8_t> pending; // Newest captured frame, not picked up by the clock thread yet
+    bool hasPending = false;
+    std::chrono::steady_clock::time_point lastPush;
+    int64_t captureIntervalUs; // Typical time between captured frames, the length of a fade
+
+    // Only used by the clock thread
+    std::vector<uint8_t> from;
+    std::vector<uint8_t> to;
+    std::vector<uint8_t> current; // As last sent
+    std::chrono::steady_clock::time_point fadeStart;
+    int64_t fadeUs;
+    std::chrono::steady_clock::time_point nextRepeat; // When to send the finished fade again
+
+    int timerFd = -1;
+    int wakePipe[2] = {-1, -1};
+    std::thread thread;
+
+    // Statistics, read by statusLine()
+    std::atomic<uint64_t> framesSent{0};
+    std::atomic<uint64_t> missedTicks{0}; // Ticks the thread woke up too late for
+    std::chrono::steady_clock::time_point lastStatusTime = std::chrono::steady_clock::now();
+    uint64_t lastFramesSent = 0;
+    std::string lastStatus;
+
+    void run();
+    void tick();
+public:
+    // fps is the output rate. ledData of push() has ledCount * 3 bytes. schedule is applied to the clock thread.
+    OutputClock(OutputSink& output, size_t ledCount, int fps, const ThreadSchedule& schedule = {});
+    ~OutputClock();
+
+    OutputClock(const OutputClock&) = delete;
+    OutputClock& operator=(const OutputClock&) = delete;
+
+    // Hand over a new captured frame, corrected
+    void push(const uint8_t* ledData);
+
+    // Output rate and missed ticks, updated once a second
+    std::string statusLine();
+};
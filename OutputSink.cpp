@@ -0,0 +1,117 @@
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include "ConfigParser.h"
+#include "SerialOutput.h"
+#include "UdpOutput.h"
+#include "FileOutput.h"
+#include "OutputSink.h"
+
+std::vector<OutputTarget> OutputSink::targetsFromConfig(const Config& config, size_t ledCount) {
+    std::vector<OutputTarget> targets;
+    std::stringstream list(config.outputs);
+    std::string item;
+    while (std::getline(list, item, ';')) {
+        std::vector<std::string> fields;
+        std::stringstream fieldList(item);
+        std::string field;
+        while (std::getline(fieldList, field, ',')) {
+            ConfigParser::trim(field);
+            fields.push_back(field);
+        }
+        if (fields.empty() || (fields.size() == 1 && fields[0].empty())) {
+            continue; // Trailing ;
+        }
+        if (fields.size() < 3 || fields.size() > 5 || fields[1].empty()) {
+            throw std::invalid_argument("Invalid output: " + item);
+        }
+
+        OutputTarget target{};
+        if (fields[0] == "ddp") target.type = OutputTarget::Type::Ddp;
+        else if (fields[0] == "e131") target.type = OutputTarget::Type::E131;
+        else if (fields[0] == "file") target.type = OutputTarget::Type::File;
+        else throw std::invalid_argument("Invalid output type: " + fields[0]);
+        target.address = fields[1];
+
+        std::vector<int> leds;
+        try {
+            std::string range = fields[2];
+            const size_t dash = range.find('-');
+            leds = ConfigParser::parseIntList(dash == std::string::npos ? range : range.replace(dash, 1, ","));
+            if (fields.size() > 3) {
+                target.fps = std::stoi(fields[3]);
+            }
+            if (fields.size() > 4) {
+                target.universe = std::stoi(fields[4]);
+            }
+        }
+        catch (const std::logic_error&) {
+            throw std::invalid_argument("Invalid output: " + item);
+        }
+        if (leds.size() != 2 || leds[0] < 0 || leds[1] < 0 || static_cast<size_t>(std::max(leds[0], leds[1])) >= ledCount) {
+            throw std::invalid_argument("Invalid LED range in output: " + item);
+        }
+        if (target.fps < 0 || target.universe < 1 || target.universe > 63999) {
+            throw std::invalid_argument("Invalid output: " + item);
+        }
+        target.reversed = leds[1] < leds[0];
+        target.firstLed = static_cast<size_t>(std::min(leds[0], leds[1]));
+        target.ledCount = static_cast<size_t>(std::abs(leds[1] - leds[0]) + 1);
+        targets.push_back(target);
+    }
+    return targets;
+}
+
+std::unique_ptr<OutputSink> OutputSink::fromConfig(const Config& config, size_t ledCount, const ThreadSchedule& schedule, const std::vector<int>& cpus) {
+    std::vector<std::unique_ptr<OutputSink>> sinks;
+    if (!config.serial_port.empty() || !config.serial_segments.empty()) {
+        sinks.push_back(std::make_unique<SerialOutput>(SerialOutput::segmentsFromConfig(config, ledCount), ledCount, schedule, cpus));
+    }
+
+    // The network nodes share one socket and thread, so a frame for all of them is a single sendmmsg()
+    std::vector<OutputTarget> nodes;
+    for (const OutputTarget& target : targetsFromConfig(config, ledCount)) {
+        if (target.type == OutputTarget::Type::File) {
+            sinks.push_back(std::make_unique<FileOutput>(target, ledCount, schedule));
+        }
+        else {
+            nodes.push_back(target);
+        }
+    }
+    if (!nodes.empty()) {
+        sinks.push_back(std::make_unique<UdpOutput>(nodes, ledCount, schedule));
+    }
+
+    if (sinks.empty()) {
+        throw std::invalid_argument("No output configured");
+    }
+    if (sinks.size() == 1) {
+        return std::move(sinks.front());
+    }
+    return std::make_unique<SinkGroup>(std::move(sinks));
+}
+
+void OutputSink::copyRange(const OutputTarget& target, const uint8_t* colors, uint8_t* destination) {
+    const uint8_t* first = colors + target.firstLed * 3;
+    if (!target.reversed) {
+        std::copy(first, first + target.ledCount * 3, destination);
+        return;
+    }
+    for (size_t i = 0; i < target.ledCount; i++) {
+        std::copy(first + (target.ledCount - 1 - i) * 3, first + (target.ledCount - i) * 3, destination + i * 3);
+    }
+}
+
+void SinkGroup::submit(const uint8_t* colors) {
+    for (auto& sink : sinks) {
+        sink->submit(colors);
+    }
+}
+
+std::string SinkGroup::statusLine() {
+    std::string status;
+    for (auto& sink : sinks) {
+        status += sink->statusLine();
+    }
+    return status;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "Config.h"
+#include "Realtime.h"
+
+// One entry of outputs: a LED node on the network or a file, fed a range of the LED chain
+struct OutputTarget {
+    enum class Type { Ddp, E131, File };
+    Type type;
+    std::string address; // host[:port] for the UDP types, a path for File
+    size_t firstLed;
+    size_t ledCount;
+    bool reversed = false; // The range was given as last-first, the node's first LED is the chain's last
+    int fps = 0;           // Send at most this often, 0 sends every frame
+    int universe = 1;      // First E1.31 universe
+};
+
+// Where LED frames go. submit() only hands a frame over; the sink sends it on its own threads, so a slow or unreachable device never
+// holds up the capture loop, and skips to the newest frame when it falls behind.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Queue a frame of ledCount * 3 color bytes, not escaped
+    virtual void submit(const uint8_t* colors) = 0;
+    // Per-device rates and counters, updated once a second
+    virtual std::string statusLine() = 0;
+
+    // outputs, like "ddp,192.168.1.50,0-59; e131,192.168.1.51:5568,119-60,40,3; file,/tmp/leds,0-119,10": type, address, inclusive
+    // LED range (reversed if last < first), then optionally fps and the first E1.31 universe
+    static std::vector<OutputTarget> targetsFromConfig(const Config& config, size_t ledCount);
+
+    // The serial ports, if serial_port or serial_segments is set, and every entry of outputs. Several sinks are fed as a group.
+    // The serial writers are scheduled with schedule and pinned to cpus, the other sinks' threads only get schedule.
+    static std::unique_ptr<OutputSink> fromConfig(const Config& config, size_t ledCount, const ThreadSchedule& schedule = {}, const std::vector<int>& cpus = {});
+
+    // Copy the range of a target out of a frame of colors, in the order of the target's LEDs
+    static void copyRange(const OutputTarget& target, const uint8_t* colors, uint8_t* destination);
+};
+
+// Several sinks fed the same frames
+class SinkGroup : public OutputSink {
+    std::vector<std::unique_ptr<OutputSink>> sinks;
+public:
+    explicit SinkGroup(std::vector<std::unique_ptr<OutputSink>> sinks) : sinks(std::move(sinks)) {}
+
+    void submit(const uint8_t* colors) override;
+    std::string statusLine() override;
+};
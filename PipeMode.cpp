@@ -0,0 +1,264 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "Averager.h"
+#include "LatencyTracker.h"
+#include "AlignedBuffer.h"
+#include "JpegScanner.h"
+#include "JpegDecoder.h"
+#include "LedPipeline.h"
+#include "PipeMode.hpp"
+
+bool PipeMode::PipeRun = true;
+
+void PipeMode::PipeSighandler(int signum) {
+    std::cout << "Caught signal " << signum << ", exiting" << std::endl;
+    PipeMode::PipeRun = false;
+}
+
+// Read exactly len bytes, in as few read() calls as the pipe allows. Returns false on end of input.
+bool PipeMode::readFully(int fd, uint8_t* buf, size_t len) {
+    size_t filled = 0;
+    while (filled < len) {
+        ssize_t n = ::read(fd, buf + filled, len - filled);
+        if (n == 0) {
+            return false;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                if (!PipeMode::PipeRun) return false;
+                continue;
+            }
+            throw std::runtime_error("Error reading from pipe");
+        }
+        filled += n;
+    }
+    return true;
+}
+
+void PipeMode::start(const Config& config, ConfigWatcher& watcher) {
+    // Without SA_RESTART, so a read() waiting on a stalled pipe returns EINTR and the loop can stop
+    struct sigaction action{};
+    action.sa_handler = PipeMode::PipeSighandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGINT, &action, nullptr);
+
+    // Size of one frame for the raw formats, MJPEG frames are found by scanning for their markers
+    const bool mjpeg = config.pipe_format == "mjpeg";
+    const int frame_width = config.pipe_width;
+    const int frame_height = config.pipe_height;
+    PixelFormat pixelFormat = PixelFormat::RGB24;
+    size_t frameSize = static_cast<size_t>(frame_width) * frame_height * 3;
+    if (config.pipe_format == "bgr0") {
+        pixelFormat = PixelFormat::BGRX32;
+        frameSize = static_cast<size_t>(frame_width) * frame_height * 4;
+    } else if (config.pipe_format == "nv12") {
+        pixelFormat = PixelFormat::NV12;
+        frameSize = static_cast<size_t>(frame_width) * frame_height * 3 / 2;
+    } else if (config.pipe_format == "yuyv422") {
+        pixelFormat = PixelFormat::YUYV;
+        frameSize = static_cast<size_t>(frame_width) * frame_height * 2;
+    }
+
+    // Open the input
+    int fd = STDIN_FILENO;
+    if (config.pipe_path != "-") {
+        fd = open(config.pipe_path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw std::runtime_error("Failed to open pipe: " + config.pipe_path);
+        }
+    }
+    // A bigger pipe lets each read() return a whole frame, or several compressed ones. This fails harmlessly if the input is not a pipe.
+    fcntl(fd, F_SETPIPE_SZ, 1024 * 1024);
+
+    // Input buffers, allocated once. The 16 bytes of padding are needed by the SIMD optimizations in colorOfBlock.
+    AlignedBuffer frameBuffer(mjpeg ? 4 * 1024 * 1024 : frameSize + 16);
+    size_t streamFill = 0; // Bytes of MJPEG stream data in frameBuffer
+    std::unique_ptr<JpegDecoder> decoder(mjpeg ? new JpegDecoder(config.decode_split) : nullptr);
+
+    // Zone extraction, color correction and the outputs, rebuilt in place when the config changes
+    LedPipeline pipeline(config, frame_width, frame_height);
+    pipeline.setRawYuv(pixelFormat == PixelFormat::NV12 || pixelFormat == PixelFormat::YUYV, config.pipe_path == "-" ? "stdin" : config.pipe_path);
+
+    // Recording of every frame and event, if configured
+    std::unique_ptr<FlightRecorder> recorder = LedPipeline::openRecorder(config);
+    uint32_t frameNumber = 0;
+
+    // Real-time scheduling and locked memory, if configured
+    LedPipeline::enterRealtime(config);
+    if (config.lock_memory) {
+        Realtime::prefault(frameBuffer.get(), frameBuffer.size());
+        Realtime::prefaultStack();
+    }
+
+    // Averagers for timing debug info
+    Averager<int64_t> readtimeAverager(20);
+    Averager<int64_t> decomptimeAverager(20);
+    Averager<int64_t> extracttimeAverager(20);
+    Averager<int64_t> proctimeAverager(20);
+    Averager<int64_t> writetimeAverager(20);
+    Averager<int64_t> totaldurationAverager(20);
+    LatencyTracker frameLatency; // From a complete frame in the buffer until it's submitted to the outputs
+    int64_t skippedFrames = 0;
+
+    while (PipeRun) {
+        // Apply config changes between frames
+        if (std::optional<Config> update = watcher.takeUpdate()) {
+            watcher.applied(pipeline.apply(*update));
+            if (recorder) {
+                recorder->event(FlightFormat::Event::ConfigApplied);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        Frame frame{pixelFormat, frameBuffer.get(), frame_width, frame_height, 0};
+        if (!mjpeg) {
+            if (!PipeMode::readFully(fd, frameBuffer.get(), frameSize)) {
+                break;
+            }
+            if (pixelFormat == PixelFormat::NV12) {
+                frame.stride = frame_width;
+                frame.chroma = frameBuffer.get() + static_cast<size_t>(frame_width) * frame_height;
+                frame.chromaStride = frame_width;
+            } else {
+                frame.stride = static_cast<int>(frameSize / frame_height);
+            }
+        }
+        auto readtime = std::chrono::steady_clock::now();
+
+        if (mjpeg) {
+            // Keep reading until at least one complete JPEG is in the buffer. If several arrived, only the newest one is decoded.
+            const uint8_t* jpeg = nullptr;
+            size_t jpegLength = 0;
+            size_t consumed = 0;
+            const int64_t skippedBefore = skippedFrames;
+            while (jpeg == nullptr) {
+                if (consumed > 0) {
+                    // Nothing complete yet. Drop what came before the start of the next image, so only a partial image is kept.
+                    std::memmove(frameBuffer.get(), frameBuffer.get() + consumed, streamFill - consumed);
+                    streamFill -= consumed;
+                    consumed = 0;
+                }
+                if (streamFill >= maxJpegSize) {
+                    // An image without an end, the stream is corrupt. Keep the last byte in case it's the first half of a SOI marker.
+                    std::cout << "No end of the JPEG after " << streamFill << " bytes, dropping it" << std::endl;
+                    if (recorder) {
+                        recorder->event(FlightFormat::Event::DecodeError, static_cast<int64_t>(streamFill));
+                    }
+                    frameBuffer.get()[0] = frameBuffer.get()[streamFill - 1];
+                    streamFill = 1;
+                }
+                if (streamFill == frameBuffer.size()) {
+                    frameBuffer.grow(frameBuffer.size() * 2, streamFill);
+                }
+                ssize_t n = ::read(fd, frameBuffer.get() + streamFill, frameBuffer.size() - streamFill);
+                if (n == 0 || (n == -1 && errno != EINTR)) {
+                    PipeRun = false;
+                    break;
+                }
+                if (n == -1) {
+                    if (!PipeRun) {
+                        break; // Interrupted by SIGINT
+                    }
+                    continue;
+                }
+                streamFill += n;
+
+                while (true) {
+                    size_t begin = JpegScanner::findStart(frameBuffer.get() + consumed, streamFill - consumed);
+                    if (begin == JpegScanner::npos) {
+                        // Nothing but garbage, keep the last byte in case it's the first half of a SOI marker
+                        consumed = std::max(consumed, streamFill - 1);
+                        break;
+                    }
+                    size_t length = JpegScanner::findEnd(frameBuffer.get() + consumed + begin, streamFill - consumed - begin);
+                    if (length == 0) {
+                        consumed += begin;
+                        break;
+                    }
+                    if (jpeg != nullptr) {
+                        skippedFrames++;
+                    }
+                    jpeg = frameBuffer.get() + consumed + begin;
+                    jpegLength = length;
+                    consumed += begin + length;
+                }
+            }
+            if (jpeg == nullptr) {
+                break;
+            }
+            readtime = std::chrono::steady_clock::now();
+            if (recorder && skippedFrames != skippedBefore) {
+                recorder->event(FlightFormat::Event::FramesSkipped, skippedFrames - skippedBefore);
+            }
+
+            // Decoded to the YCbCr planes if the zones can be averaged on them
+            const bool decoded = decoder->decode(jpeg, jpegLength, pipeline.decodesPlanar(), frame);
+
+            // Drop the consumed stream data, the rest is the start of the next frame
+            std::memmove(frameBuffer.get(), frameBuffer.get() + consumed, streamFill - consumed);
+            streamFill -= consumed;
+
+            if (!decoded) {
+                std::cout << "Error decompressing frame, skipping" << std::endl;
+                if (recorder) {
+                    recorder->event(FlightFormat::Event::DecodeError, static_cast<int64_t>(jpegLength));
+                }
+                continue;
+            }
+        }
+        auto decomptime = std::chrono::steady_clock::now();
+
+        // Calculate the colors of the LEDs based on the image
+        pipeline.extract(frame);
+
+        auto extracttime = std::chrono::steady_clock::now();
+
+        // Do gamma correction and averaging
+        const std::vector<uint8_t>& ledDataAvg = pipeline.correct();
+
+        auto proctime = std::chrono::steady_clock::now();
+
+        // Send data to the MCUs
+        pipeline.send();
+
+        // Timing info output
+        auto stop = std::chrono::steady_clock::now();
+        if (recorder) {
+            const FlightFormat::FrameTimes times{0, FlightRecorder::micros(readtime), FlightRecorder::micros(decomptime), FlightRecorder::micros(extracttime),
+                                                 FlightRecorder::micros(proctime), FlightRecorder::micros(stop), frameNumber};
+            recorder->frame(times, ledDataAvg.data(), ledDataAvg.size(), pipeline.getConfig().horizontal_leds, pipeline.getConfig().vertical_leds);
+        }
+        frameNumber++;
+        readtimeAverager.add(std::chrono::duration_cast<std::chrono::microseconds>(readtime - start).count());
+        decomptimeAverager.add(std::chrono::duration_cast<std::chrono::microseconds>(decomptime - readtime).count());
+        extracttimeAverager.add(std::chrono::duration_cast<std::chrono::microseconds>(extracttime - decomptime).count());
+        proctimeAverager.add(std::chrono::duration_cast<std::chrono::microseconds>(proctime - extracttime).count());
+        writetimeAverager.add(std::chrono::duration_cast<std::chrono::microseconds>(stop - proctime).count());
+        totaldurationAverager.add(std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()));
+        frameLatency.add(std::chrono::duration_cast<std::chrono::microseconds>(stop - readtime).count());
+        std::cout << "\r\033[Kread: " << readtimeAverager.getAverage() << "us \t| decomp: " << decomptimeAverager.getAverage() << "us\t | extract: " << extracttimeAverager.getAverage() << "us\t | proc: " << proctimeAverager.getAverage() << "us\t | write: " << writetimeAverager.getAverage() << "us\t | total: " << totaldurationAverager.getAverage() << "us / " << 1000000 / std::max<int64_t>(1, totaldurationAverager.getAverage()) << "fps"
+                  << "\t | latency p50 " << frameLatency.percentile(0.5) << "us p99 " << frameLatency.percentile(0.99) << "us";
+        if (mjpeg) {
+            std::cout << "\t | skipped: " << skippedFrames;
+            if (config.decode_split > 1) {
+                std::cout << ", split " << decoder->splitFrames << ", whole " << decoder->wholeFrames;
+            }
+        }
+        std::cout << pipeline.statusLine();
+        std::cout.flush();
+    }
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    std::cout << std::endl << "Stopping" << std::endl;
+}
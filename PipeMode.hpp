@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "Config.h"
+#include "ConfigWatcher.h"
+
+class PipeMode {
+    static bool PipeRun;
+    static constexpr size_t maxJpegSize = 32 * 1024 * 1024; // An MJPEG image without an end by then is dropped as corrupt
+    static bool readFully(int fd, uint8_t* buf, size_t len);
+public:
+    static void PipeSighandler(int signum);
+    static void start(const Config& config, ConfigWatcher& watcher);
+};
@@ -0,0 +1,127 @@
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <alloca.h>
+#include "Realtime.h"
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+namespace {
+    // Layout of struct sched_attr, which older C libraries don't declare
+    struct DeadlineAttr {
+        uint32_t size;
+        uint32_t sched_policy;
+        uint64_t sched_flags;
+        int32_t sched_nice;
+        uint32_t sched_priority;
+        uint64_t sched_runtime;
+        uint64_t sched_deadline;
+        uint64_t sched_period;
+    };
+
+    // Effective capability bits from /proc, so the report doesn't need libcap
+    uint64_t effectiveCapabilities() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("CapEff:", 0) == 0) {
+                return std::stoull(line.substr(7), nullptr, 16);
+            }
+        }
+        return 0;
+    }
+
+    std::string limitString(int resource) {
+        rlimit limit{};
+        if (getrlimit(resource, &limit) == -1) {
+            return "unknown";
+        }
+        return limit.rlim_cur == RLIM_INFINITY ? "unlimited" : std::to_string(limit.rlim_cur);
+    }
+}
+
+const char* Realtime::policyName(ThreadSchedule::Policy policy) {
+    switch (policy) {
+        case ThreadSchedule::Policy::Fifo: return "SCHED_FIFO";
+        case ThreadSchedule::Policy::Deadline: return "SCHED_DEADLINE";
+        default: return "SCHED_OTHER";
+    }
+}
+
+std::string Realtime::setSchedule(const ThreadSchedule& schedule, pthread_t thread) {
+    switch (schedule.policy) {
+        case ThreadSchedule::Policy::Normal:
+            return "";
+        case ThreadSchedule::Policy::Fifo: {
+            sched_param param{};
+            param.sched_priority = schedule.priority;
+            int result = pthread_setschedparam(thread, SCHED_FIFO, &param);
+            return result == 0 ? "" : strerror(result);
+        }
+        case ThreadSchedule::Policy::Deadline: {
+            if (!pthread_equal(thread, pthread_self())) {
+                return "SCHED_DEADLINE can only be set by the thread itself";
+            }
+            DeadlineAttr attr{};
+            attr.size = sizeof(attr);
+            attr.sched_policy = SCHED_DEADLINE;
+            attr.sched_flags = 0x01; // SCHED_FLAG_RESET_ON_FORK, without it the thread can't start new threads (like a rebuilt extraction pool)
+            attr.sched_runtime = static_cast<uint64_t>(schedule.runtimeUs) * 1000;
+            attr.sched_deadline = static_cast<uint64_t>(schedule.periodUs) * 1000;
+            attr.sched_period = static_cast<uint64_t>(schedule.periodUs) * 1000;
+            if (syscall(SYS_sched_setattr, 0, &attr, 0) == -1) {
+                return strerror(errno);
+            }
+            return "";
+        }
+    }
+    return "unknown policy";
+}
+
+bool Realtime::pin(int cpu, pthread_t thread) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset) == 0;
+}
+
+std::string Realtime::lockMemory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+        return strerror(errno);
+    }
+    return "";
+}
+
+void Realtime::prefault(void* data, size_t length) {
+    auto* bytes = static_cast<volatile uint8_t*>(data);
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i < length; i += pageSize) {
+        bytes[i] = bytes[i]; // A write, so copy-on-write zero pages get their own page too
+    }
+}
+
+void Realtime::prefaultStack(size_t length) {
+    auto* stack = static_cast<uint8_t*>(alloca(length));
+    prefault(stack, length);
+}
+
+std::string Realtime::privileges() {
+    const uint64_t capabilities = effectiveCapabilities();
+    const bool sysNice = capabilities & (1ull << 23); // CAP_SYS_NICE
+    const bool ipcLock = capabilities & (1ull << 14); // CAP_IPC_LOCK
+    std::stringstream report;
+    report << "CAP_SYS_NICE " << (sysNice ? "yes" : "no") << ", RLIMIT_RTPRIO " << limitString(RLIMIT_RTPRIO)
+           << ", CAP_IPC_LOCK " << (ipcLock ? "yes" : "no") << ", RLIMIT_MEMLOCK " << limitString(RLIMIT_MEMLOCK);
+    return report.str();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <pthread.h>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Scheduling of one thread of the real-time profile
+struct ThreadSchedule {
+    enum class Policy {
+        Normal,   // Leave the thread to the default scheduler
+        Fifo,     // SCHED_FIFO at priority
+        Deadline, // SCHED_DEADLINE reservation of runtimeUs every periodUs. Only for the calling thread, and not together with CPU pinning.
+    };
+    Policy policy = Policy::Normal;
+    int priority = 0;
+    int64_t runtimeUs = 0;
+    int64_t periodUs = 0;
+};
+
+// Real-time helpers: scheduling policies, CPU pinning and locked, pre-faulted memory.
+// Failures are returned as messages rather than thrown, as running without the privileges is still useful.
+class Realtime {
+public:
+    // Apply a policy to a thread, the calling one by default. Returns an empty string on success, otherwise the reason.
+    static std::string setSchedule(const ThreadSchedule& schedule, pthread_t thread = pthread_self());
+    // Pin a thread to one CPU core. Returns false if that isn't possible.
+    static bool pin(int cpu, pthread_t thread = pthread_self());
+
+    // mlockall() for the current and all future mappings. Returns an empty string on success, otherwise the reason.
+    static std::string lockMemory();
+    // Touch every page of a buffer, so the first frame doesn't pay for the page faults
+    static void prefault(void* data, size_t length);
+    // Same for the stack of the calling thread
+    static void prefaultStack(size_t length = 256 * 1024);
+
+    // What the process may do: CAP_SYS_NICE, CAP_IPC_LOCK and the RLIMIT_RTPRIO/RLIMIT_MEMLOCK limits, for the startup report
+    static std::string privileges();
+
+    static const char* policyName(ThreadSchedule::Policy policy);
+};
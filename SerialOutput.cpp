@@ -0,0 +1,295 @@
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include "ConfigParser.h"
+#include "LedFraming.h"
+#include "DeviceWatcher.h"
+#include "SerialOutput.h"
+
+SerialOutput::SerialOutput(const std::vector<SerialSegment>& segments, size_t ledCount, const ThreadSchedule& schedule, const std::vector<int>& cpus) : frame(ledCount * 3), roundFrame(ledCount * 3) {
+    if (segments.empty()) {
+        throw std::invalid_argument("At least one serial segment is required");
+    }
+    for (const SerialSegment& segment : segments) {
+        if (segment.ledCount == 0 || segment.firstLed + segment.ledCount > ledCount) {
+            throw std::invalid_argument("Serial segment of " + segment.port + " is outside of the LED chain");
+        }
+        writers.push_back(std::make_unique<Writer>(segment));
+        negotiate(*writers.back(), segment.calibrate);
+    }
+    lastFramesWritten.resize(writers.size());
+    lastBytesWritten.resize(writers.size());
+    for (size_t i = 0; i < writers.size(); i++) {
+        Writer& writer = *writers[i];
+        writer.thread = std::thread(&SerialOutput::writerLoop, this, std::ref(writer));
+        if (i < cpus.size() && !Realtime::pin(cpus[i], writer.thread.native_handle())) {
+            std::cout << "Can't pin the writer of " << writer.segment.port << " to CPU " << cpus[i] << std::endl;
+        }
+        std::string error = Realtime::setSchedule(schedule, writer.thread.native_handle());
+        if (!error.empty()) {
+            std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for the writer of " << writer.segment.port << ": " << error << std::endl;
+        }
+    }
+}
+
+SerialOutput::~SerialOutput() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameCondition.notify_all();
+    for (auto& writer : writers) {
+        writer->thread.join();
+    }
+}
+
+// Size frames and cap the frame rate based on what the MCU reports
+void SerialOutput::negotiate(Writer& writer, bool calibrate) {
+    writer.capabilities = McuProtocol::handshake(writer.port);
+    writer.messageLeds = writer.segment.ledCount;
+    int64_t showUs = 0;
+    if (writer.capabilities) {
+        const McuCapabilities& capabilities = *writer.capabilities;
+        std::cout << writer.segment.port << ": protocol " << capabilities.protocolVersion << ", " << capabilities.ledCount << " LEDs, " << capabilities.bufferSize << " byte buffer, show() takes " << capabilities.showUs << "us" << std::endl;
+        if (capabilities.ledCount != writer.segment.ledCount) {
+            std::cout << writer.segment.port << ": segment has " << writer.segment.ledCount << " LEDs, but the MCU drives " << capabilities.ledCount << ", " << (capabilities.ledCount > writer.segment.ledCount ? "padding with black" : "truncating") << std::endl;
+        }
+        writer.messageLeds = capabilities.ledCount;
+        showUs = capabilities.showUs;
+    }
+    else {
+        std::cout << writer.segment.port << ": no handshake reply, assuming legacy firmware" << std::endl;
+    }
+
+    // Budget the frame rate from the measured link capacity. USB CDC ignores the baud rate entirely, and adapters may not reach it.
+    // Without calibration, assume 10 bits per byte on the wire (start + 8 data + stop) at the configured baud rate.
+    if (calibrate) {
+        writer.bytesPerSecond = writer.port.measureThroughput(300);
+        std::cout << writer.segment.port << ": measured " << static_cast<int64_t>(writer.bytesPerSecond) << " bytes/s (" << writer.segment.baudrate / 10 << " expected from the baud rate)" << std::endl;
+    }
+    const double bytesPerSecond = writer.bytesPerSecond > 0 ? writer.bytesPerSecond : writer.segment.baudrate / 10.0;
+    const int64_t transmitUs = static_cast<int64_t>((writer.messageLeds * 3 + 1) * 1000000.0 / bytesPerSecond);
+    writer.baseIntervalUs = std::max(showUs, transmitUs);
+    writer.minIntervalUs = writer.baseIntervalUs;
+}
+
+std::vector<SerialSegment> SerialOutput::segmentsFromConfig(const Config& config, size_t ledCount) {
+    std::vector<SerialSegment> segments;
+    if (config.serial_segments.empty()) {
+        segments.push_back({config.serial_port, config.baud, 0, ledCount, config.serial_calibrate});
+        return segments;
+    }
+
+    std::stringstream list(config.serial_segments);
+    std::string item;
+    while (std::getline(list, item, ';')) {
+        std::stringstream fields(item);
+        std::string port, baud, range;
+        if (!std::getline(fields, port, ',') || !std::getline(fields, baud, ',') || !std::getline(fields, range)) {
+            throw std::invalid_argument("Invalid serial segment: " + item);
+        }
+        port.erase(0, port.find_first_not_of(' '));
+        std::vector<int> leds = ConfigParser::parseIntList(range.replace(range.find('-'), 1, ","));
+        if (leds.size() != 2 || leds[0] < 0 || leds[1] < leds[0]) {
+            throw std::invalid_argument("Invalid LED range in serial segment: " + item);
+        }
+        segments.push_back({port, std::stoi(baud), static_cast<size_t>(leds[0]), static_cast<size_t>(leds[1] - leds[0] + 1), config.serial_calibrate});
+    }
+    return segments;
+}
+
+void SerialOutput::submit(const uint8_t* colors) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::copy(colors, colors + frame.size(), frame.begin());
+        sequence++;
+        submitTime = std::chrono::steady_clock::now();
+        if (!startRound()) {
+            return;
+        }
+    }
+    frameCondition.notify_all();
+}
+
+bool SerialOutput::startRound() {
+    if (roundPending > 0 || roundSequence == sequence) {
+        return false;
+    }
+    roundFrame = frame;
+    roundSequence = sequence;
+    roundSubmitTime = submitTime;
+    for (const auto& writer : writers) {
+        roundPending += writer->connected;
+    }
+    return true;
+}
+
+bool SerialOutput::finishRound() {
+    return --roundPending == 0 && startRound();
+}
+
+bool SerialOutput::reconnect(Writer& writer) {
+    const auto lost = std::chrono::steady_clock::now();
+    writer.port.close();
+    std::cout << std::endl << writer.segment.port << ": lost, waiting for it to come back" << std::endl;
+    DeviceWatcher watcher;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                return false;
+            }
+        }
+        if (!watcher.waitFor(writer.segment.port, 250)) {
+            continue;
+        }
+        try {
+            // The link was measured at startup already, only the handshake is repeated in case the firmware changed
+            writer.port = SerialPort(writer.segment.port, writer.segment.baudrate);
+            negotiate(writer, false);
+            break;
+        }
+        catch (const std::exception&) {
+            // The node can show up before the device is ready
+            writer.port.close();
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        }
+    }
+    writer.recoveryMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
+    writer.reconnects++;
+    std::cout << std::endl << writer.segment.port << ": reconnected after " << writer.recoveryMs << "ms" << std::endl;
+    return true;
+}
+
+void SerialOutput::writerLoop(Writer& writer) {
+    // The slice of the frame this port sends, followed by the delimiter, so each frame is a single write(). LEDs the segment doesn't have stay black.
+    std::vector<char> message(writer.messageLeds * 3 + 1, 0);
+    message.back() = LedFraming::delimiter;
+    size_t copyLeds = std::min(writer.segment.ledCount, writer.messageLeds);
+
+    auto nextWrite = std::chrono::steady_clock::now();
+    std::string line;
+    McuStats stats;
+    uint64_t framesAtLastStats = 0, acceptedAtLastStats = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frameCondition.wait(lock, [&] { return stopping || roundSequence != writer.writtenSequence; });
+            if (roundSequence == writer.writtenSequence) {
+                return; // Stopping, and the last round has been sent
+            }
+        }
+
+        // Don't send faster than the MCU can latch frames
+        std::this_thread::sleep_until(nextWrite);
+
+        std::chrono::steady_clock::time_point frameSubmitTime;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (writer.writtenSequence != 0 && roundSequence - writer.writtenSequence > 1) {
+                writer.framesSkipped += roundSequence - writer.writtenSequence - 1;
+            }
+            writer.writtenSequence = roundSequence;
+            frameSubmitTime = roundSubmitTime;
+            auto first = roundFrame.begin() + writer.segment.firstLed * 3;
+            std::copy(first, first + copyLeds * 3, message.begin());
+        }
+        // \n ends a message. Replace it in the colors with the closest brightness that is not \n.
+        LedFraming::escape(reinterpret_cast<uint8_t*>(message.data()), copyLeds * 3);
+
+        try {
+            writer.port.write(message.data(), message.size());
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << std::endl << "Error writing to " << writer.segment.port << ": " << e.what() << std::endl;
+            // The other ports go on without this one meanwhile
+            bool started;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writer.connected = false;
+                started = finishRound();
+            }
+            if (started) {
+                frameCondition.notify_all();
+            }
+            if (!reconnect(writer)) {
+                return;
+            }
+            // The MCU may have come back with other firmware. It joins in again with the next round.
+            message.assign(writer.messageLeds * 3 + 1, 0);
+            message.back() = LedFraming::delimiter;
+            copyLeds = std::min(writer.segment.ledCount, writer.messageLeds);
+            framesAtLastStats = 0;
+            acceptedAtLastStats = 0;
+            nextWrite = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            writer.connected = true;
+            writer.writtenSequence = roundSequence;
+            continue;
+        }
+        bool started;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            started = finishRound();
+        }
+        if (started) {
+            frameCondition.notify_all();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        nextWrite = now + std::chrono::microseconds(writer.minIntervalUs);
+        writer.framesWritten++;
+        writer.bytesWritten += message.size();
+        writer.lagUs = std::chrono::duration_cast<std::chrono::microseconds>(now - frameSubmitTime).count();
+
+        // Frame counters reported by the MCU. If it displays noticeably fewer frames than it's sent, slow down instead of wasting link bandwidth; otherwise creep back towards the base rate.
+        while (writer.capabilities && writer.port.pollLine(line, 0)) {
+            if (!McuProtocol::parseStats(line, stats)) {
+                continue;
+            }
+            uint64_t sent = writer.framesWritten - framesAtLastStats;
+            uint64_t accepted = stats.accepted - std::min(stats.accepted, acceptedAtLastStats);
+            if (framesAtLastStats != 0 && sent > accepted + 2 + sent / 20) {
+                writer.minIntervalUs = std::min<int64_t>(writer.minIntervalUs * 11 / 10 + 100, 1000000);
+            }
+            else {
+                writer.minIntervalUs = std::max(writer.baseIntervalUs, writer.minIntervalUs * 19 / 20);
+            }
+            framesAtLastStats = writer.framesWritten;
+            acceptedAtLastStats = stats.accepted;
+            writer.mcuAccepted = stats.accepted;
+            writer.mcuRejected = stats.rejected;
+        }
+    }
+}
+
+std::string SerialOutput::statusLine() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastStatusTime).count();
+    if (seconds < 1.0) {
+        return lastStatus;
+    }
+    lastStatusTime = now;
+
+    std::stringstream status;
+    for (size_t i = 0; i < writers.size(); i++) {
+        const Writer& writer = *writers[i];
+        uint64_t frames = writer.framesWritten;
+        uint64_t bytes = writer.bytesWritten;
+        std::string name = writer.segment.port.substr(writer.segment.port.find_last_of('/') + 1);
+        status << " | " << name << ": " << static_cast<int>((frames - lastFramesWritten[i]) / seconds) << "fps "
+               << static_cast<int>((bytes - lastBytesWritten[i]) / seconds / 1024) << "KB/s lag " << writer.lagUs << "us skipped " << writer.framesSkipped;
+        if (writer.capabilities) {
+            status << " mcu accepted " << writer.mcuAccepted << " rejected " << writer.mcuRejected;
+        }
+        if (writer.reconnects > 0) {
+            status << " reconnects " << writer.reconnects << " (last " << writer.recoveryMs << "ms)";
+        }
+        lastFramesWritten[i] = frames;
+        lastBytesWritten[i] = bytes;
+    }
+    lastStatus = status.str();
+    return lastStatus;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <optional>
+#include "SerialPort.hpp"
+#include "McuProtocol.h"
+#include "Config.h"
+#include "Realtime.h"
+#include "OutputSink.h"
+
+// Part of the LED chain driven by one MCU
+struct SerialSegment {
+    std::string port;
+    int baudrate;
+    size_t firstLed;
+    size_t ledCount;
+    bool calibrate = true; // Measure the link throughput at startup instead of trusting the baud rate
+};
+
+// Sends LED frames to one or more MCUs. Every serial port has its own writer thread, so the segments are written concurrently from one shared frame.
+// The writers send frames in rounds: every port sends its slice of the same frame, and the next round, with the newest frame, only starts
+// once all of them are done, so the segments never show different frames for longer than one write. The slowest port sets the pace.
+// A port that is lost drops out of the rounds until it is back.
+class SerialOutput : public OutputSink {
+    struct Writer {
+        SerialSegment segment;
+        SerialPort port;
+        std::thread thread;
+        uint64_t writtenSequence = 0; // Round last sent
+        bool connected = true;        // Taking part in rounds
+
+        std::optional<McuCapabilities> capabilities; // From the startup handshake, empty for legacy firmware
+        size_t messageLeds;          // LEDs per frame sent to this MCU, its own LED count if it reported one
+        double bytesPerSecond = 0;   // Measured link throughput, 0 if not calibrated
+        int64_t baseIntervalUs = 0;  // Shortest time between frames the strip and the link can keep up with
+        int64_t minIntervalUs = 0;   // Current rate cap, raised when the MCU reports frames it didn't display
+
+        // Statistics, read by statusLine()
+        std::atomic<uint64_t> framesWritten{0};
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> framesSkipped{0}; // Frames replaced by a newer one before this port got to them
+        std::atomic<int64_t> lagUs{0};          // Time from submit() until the last frame was written
+        std::atomic<uint64_t> mcuAccepted{0};   // Counters reported by the MCU
+        std::atomic<uint64_t> mcuRejected{0};
+        std::atomic<uint64_t> reconnects{0};    // Times the port was lost and opened again
+        std::atomic<int64_t> recoveryMs{0};     // How long the last reconnect took
+
+        Writer(SerialSegment segment) : segment(std::move(segment)), port(this->segment.port, this->segment.baudrate) {}
+    };
+
+    std::vector<std::unique_ptr<Writer>> writers;
+    std::mutex mutex;
+    std::condition_variable frameCondition;
+    std::vector<uint8_t> frame;
+    uint64_t sequence = 0;
+    std::chrono::steady_clock::time_point submitTime;
+    bool stopping = false;
+    // The frame of the current round, and how many writers still have to send it
+    std::vector<uint8_t> roundFrame;
+    uint64_t roundSequence = 0;
+    std::chrono::steady_clock::time_point roundSubmitTime;
+    size_t roundPending = 0;
+
+    // For rates in statusLine()
+    std::chrono::steady_clock::time_point lastStatusTime = std::chrono::steady_clock::now();
+    std::vector<uint64_t> lastFramesWritten;
+    std::vector<uint64_t> lastBytesWritten;
+    std::string lastStatus;
+
+    void writerLoop(Writer& writer);
+    // Start a round with the newest frame, if the last one is done and there is a newer frame. Called with the mutex held.
+    bool startRound();
+    // A writer sent its slice of the current round, or dropped out of it. Called with the mutex held.
+    bool finishRound();
+    // Handshake, and measure the link if calibrate is set
+    static void negotiate(Writer& writer, bool calibrate);
+    // Reopen the port of a writer after an error, waiting for the device to come back if it was unplugged. Returns false when stopping.
+    bool reconnect(Writer& writer);
+public:
+    // Writer thread i is pinned to cpus[i], if given, and scheduled with schedule
+    SerialOutput(const std::vector<SerialSegment>& segments, size_t ledCount, const ThreadSchedule& schedule = {}, const std::vector<int>& cpus = {});
+    ~SerialOutput() override;
+
+    SerialOutput(const SerialOutput&) = delete;
+    SerialOutput& operator=(const SerialOutput&) = delete;
+
+    // serial_segments if set, like "/dev/ttyACM0,921600,0-63; /dev/ttyACM1,921600,64-127" (LED ranges are inclusive), otherwise serial_port and baud driving the whole chain.
+    // serial_calibrate: 0 skips the throughput measurement.
+    static std::vector<SerialSegment> segmentsFromConfig(const Config& config, size_t ledCount);
+
+    // Queue a frame of ledCount * 3 color bytes, escaped by the writers. While a round is still being sent, the next one starts with the newest frame.
+    void submit(const uint8_t* colors) override;
+
+    // Per-port frame rate, throughput and lag, updated once a second
+    std::string statusLine() override;
+};
@@ -3,6 +3,12 @@
 #include <termios.h>
 #include <stdexcept>
 #include <system_error>
+#include <vector>
+#include <cerrno>
+#include <chrono>
+#include <poll.h>
+#include <algorithm>
+#include "Termios2.h"
 
 
 // Baudrate map (using const instead of constexpr)
@@ -16,66 +22,94 @@ const std::unordered_map<int, speed_t> SerialPort::baudrateMap = {
 };
 
 SerialPort::SerialPort(std::string_view port, int baudrate) {
+    if (baudrate <= 0) {
+        throw std::invalid_argument("Unsupported baud rate");
+    }
     fp = open(std::string(port).c_str(), O_RDWR | O_NOCTTY | O_NDELAY);
     if (fp < 0) {
         throw std::runtime_error("Failed to open serial port");
     }
 
-    struct termios tty;
-    if (tcgetattr(fp, &tty) != 0) {
-        throw std::runtime_error("Failed to get terminal attributes");
-    }
+    // The destructor doesn't run if the constructor throws. A reconnecting writer retries while the adapter is still
+    // initializing, and would leak a descriptor on every attempt.
+    try {
+        struct termios tty;
+        if (tcgetattr(fp, &tty) != 0) {
+            throw std::runtime_error("Failed to get terminal attributes");
+        }
 
-    // Set up serial port configuration
-    tty.c_cflag &= ~PARENB;  // Parity off
-    tty.c_cflag &= ~CSTOPB;  // Stop bits one
-    tty.c_cflag &= ~CSIZE;   // Clear size
-    tty.c_cflag |= CS8;      // 8 bits per byte
-    tty.c_cflag &= ~CRTSCTS; // Disable flow control
-    tty.c_cflag |= CREAD | CLOCAL; // Enable read
+        // Set up serial port configuration
+        tty.c_cflag &= ~PARENB;  // Parity off
+        tty.c_cflag &= ~CSTOPB;  // Stop bits one
+        tty.c_cflag &= ~CSIZE;   // Clear size
+        tty.c_cflag |= CS8;      // 8 bits per byte
+        tty.c_cflag &= ~CRTSCTS; // Disable flow control
+        tty.c_cflag |= CREAD | CLOCAL; // Enable read
 
-    tty.c_lflag &= ~ICANON;  // Disable canonical mode
-    tty.c_lflag &= ~ECHO;    // Disable echo
-    tty.c_lflag &= ~ECHOE;   // Disable erasure
-    tty.c_lflag &= ~ECHONL;  // Disable new-line echo
-    tty.c_lflag &= ~ISIG;    // Disable interpretation of INTR, QUIT, and SUSP
+        tty.c_lflag &= ~ICANON;  // Disable canonical mode
+        tty.c_lflag &= ~ECHO;    // Disable echo
+        tty.c_lflag &= ~ECHOE;   // Disable erasure
+        tty.c_lflag &= ~ECHONL;  // Disable new-line echo
+        tty.c_lflag &= ~ISIG;    // Disable interpretation of INTR, QUIT, and SUSP
 
-    tty.c_iflag &= ~(IXON | IXOFF | IXANY); // Disable flow control
-    tty.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL); // Disable special byte handling
+        tty.c_iflag &= ~(IXON | IXOFF | IXANY); // Disable flow control
+        tty.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL); // Disable special byte handling
 
-    tty.c_oflag &= ~OPOST;   // Disable output processing
-    tty.c_oflag &= ~ONLCR;   // Disable newline translation
+        tty.c_oflag &= ~OPOST;   // Disable output processing
+        tty.c_oflag &= ~ONLCR;   // Disable newline translation
 
-    tty.c_cc[VTIME] = 0;
-    tty.c_cc[VMIN] = 0;
+        tty.c_cc[VTIME] = 0;
+        tty.c_cc[VMIN] = 0;
 
-    try {
-        auto baudrateConstant = getBaudrateConstant(baudrate);
-        if (baudrateConstant) {
+        const bool standardBaudrate = baudrateMap.count(baudrate) != 0;
+        if (standardBaudrate) {
+            auto baudrateConstant = getBaudrateConstant(baudrate);
             cfsetospeed(&tty, baudrateConstant);
             cfsetispeed(&tty, baudrateConstant);
-        } else {
-            throw std::invalid_argument("Unsupported baud rate");
         }
-    } catch (const std::exception& e) {
-        throw std::system_error(errno, std::system_category(), e.what());
-    }
 
-    if (tcsetattr(fp, TCSANOW, &tty) != 0) {
-        throw std::system_error(errno, std::system_category(), "Failed to set terminal attributes");
+        if (tcsetattr(fp, TCSANOW, &tty) != 0) {
+            throw std::system_error(errno, std::system_category(), "Failed to set terminal attributes");
+        }
+
+        // Non-standard rates, like 1.8M or 6M on CP2102/FTDI adapters, have no Bxxx constant
+        if (!standardBaudrate) {
+            Termios2::setBaudrate(fp, baudrate);
+        }
+    }
+    catch (...) {
+        close();
+        throw;
     }
 }
 
 SerialPort::~SerialPort() {
+    close();
+}
+
+void SerialPort::close() {
     if (fp >= 0) {
         ::close(fp);
+        fp = -1;
     }
+    lineBuffer.clear();
 }
 
 void SerialPort::write(const char* data, size_t len) const {
     if (fp >= 0) {
-        if(::write(fp, data, len) == -1) {
-            throw std::runtime_error("Failed to write to serial port");
+        // The port is non-blocking, so a full output buffer results in short writes or EAGAIN. Wait for room instead of dropping the rest of the frame.
+        while (len > 0) {
+            ssize_t written = ::write(fp, data, len);
+            if (written == -1) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    struct pollfd pfd{fp, POLLOUT, 0};
+                    ::poll(&pfd, 1, 100);
+                    continue;
+                }
+                throw std::runtime_error("Failed to write to serial port");
+            }
+            data += written;
+            len -= written;
         }
     } else {
         throw std::runtime_error("Serial port not initialized");
@@ -124,6 +158,56 @@ std::string SerialPort::readLine() const {
     return result;
 }
 
+bool SerialPort::pollLine(std::string& line, int timeoutMs) {
+    if (fp < 0) {
+        throw std::runtime_error("Serial port not initialized");
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        size_t newline = lineBuffer.find('\n');
+        if (newline != std::string::npos) {
+            line = lineBuffer.substr(0, newline);
+            lineBuffer.erase(0, newline + 1);
+            return true;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd{fp, POLLIN, 0};
+        if (::poll(&pfd, 1, static_cast<int>(std::max<int64_t>(0, remaining))) <= 0) {
+            return false;
+        }
+        char buf[256];
+        ssize_t len = ::read(fp, buf, sizeof(buf));
+        if (len <= 0) {
+            return false;
+        }
+        lineBuffer.append(buf, len);
+    }
+}
+
+double SerialPort::measureThroughput(int durationMs) const {
+    if (fp < 0) {
+        throw std::runtime_error("Serial port not initialized");
+    }
+
+    // Nothing but delimiters. Empty lines can't have the length of a frame, however the MCU's receive buffer is sized, and the firmware
+    // ignores them without counting a rejected frame.
+    const std::vector<char> filler(4096, '\n');
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(durationMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+        write(filler.data(), filler.size());
+        bytes += filler.size();
+    }
+
+    // Only count the time until everything actually left the port
+    tcdrain(fp);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return bytes / seconds;
+}
+
 speed_t SerialPort::getBaudrateConstant(int baudrate) {
     auto it = baudrateMap.find(baudrate);
     if (it == baudrateMap.end()) {
@@ -135,12 +219,15 @@ speed_t SerialPort::getBaudrateConstant(int baudrate) {
 
 SerialPort::SerialPort(SerialPort&& other) noexcept {
     fp = other.fp;
+    lineBuffer = std::move(other.lineBuffer);
     other.fp = -1;
 }
 
 SerialPort& SerialPort::operator=(SerialPort&& other) noexcept {
     if (this != &other) {
+        close();
         fp = other.fp;
+        lineBuffer = std::move(other.lineBuffer);
         other.fp = -1;
     }
     return *this;
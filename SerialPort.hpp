@@ -5,18 +5,27 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string_view>
+#include <string>
 
 class SerialPort {
 public:
     SerialPort(std::string_view port, int baudrate);
     ~SerialPort();
 
+    // Release the device, like after it was unplugged. Writing afterwards throws.
+    void close();
+
     void write(const char* data, size_t len) const;
     void write(char c) const;
     char read() const;
 
     void flush() const;
     std::string readLine() const;
+    // Buffered line reader that waits up to timeoutMs for a complete line. Returns false on timeout, keeping partial data for the next call.
+    bool pollLine(std::string& line, int timeoutMs);
+
+    // Sustained bytes/sec the link actually achieves, measured by writing filler for about durationMs
+    double measureThroughput(int durationMs) const;
 
     SerialPort(SerialPort&& other) noexcept;
     SerialPort& operator=(SerialPort&& other) noexcept;
@@ -31,5 +40,6 @@ private:
     static speed_t getBaudrateConstant(int baudrate) ;
 
     int fp{-1};
+    std::string lineBuffer;
     static const std::unordered_map<int, speed_t> baudrateMap;
 };
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include <asm/termbits.h>
+#include <asm/ioctls.h>
+#include <sys/ioctl.h>
+#include <cerrno>
+#include <system_error>
+#include "Termios2.h"
+
+void Termios2::setBaudrate(int fd, int baudrate) {
+    struct termios2 tty;
+    if (ioctl(fd, TCGETS2, &tty) != 0) {
+        throw std::system_error(errno, std::system_category(), "Failed to get termios2 attributes");
+    }
+
+    tty.c_cflag &= ~CBAUD;
+    tty.c_cflag |= BOTHER;
+    tty.c_cflag &= ~(CBAUD << IBSHIFT);
+    tty.c_cflag |= BOTHER << IBSHIFT;
+    tty.c_ispeed = baudrate;
+    tty.c_ospeed = baudrate;
+
+    if (ioctl(fd, TCSETS2, &tty) != 0) {
+        throw std::system_error(errno, std::system_category(), "Failed to set custom baud rate");
+    }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+// Arbitrary serial baud rates through the Linux termios2 interface. Kept apart from SerialPort, because <asm/termbits.h> can't be included together with <termios.h>.
+class Termios2 {
+public:
+    // Set the input and output speed of an already configured tty to any rate the driver supports, using BOTHER
+    static void setBaudrate(int fd, int baudrate);
+};
@@ -0,0 +1,302 @@
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include "UdpOutput.h"
+
+namespace {
+    // DDP, as spoken by WLED and xLights: a 10 byte header, then up to 1440 bytes of RGB data at a byte offset into the node's LEDs
+    constexpr size_t ddpHeaderSize = 10;
+    constexpr uint8_t ddpVersion1 = 0x40;
+    constexpr uint8_t ddpPush = 0x01; // Show the frame, set on its last packet
+    constexpr uint8_t ddpTypeRgb24 = 0x0B;
+    constexpr uint8_t ddpIdDisplay = 1;
+
+    // E1.31 data packet: root, framing and DMP layer headers, then the DMX start code and up to 512 channels
+    constexpr size_t e131HeaderSize = 126;
+    constexpr size_t e131SequenceOffset = 111;
+    const char e131PacketId[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+
+    void put16(uint8_t* p, uint32_t value) {
+        p[0] = static_cast<uint8_t>(value >> 8);
+        p[1] = static_cast<uint8_t>(value);
+    }
+
+    void put32(uint8_t* p, uint32_t value) {
+        put16(p, value >> 16);
+        put16(p + 2, value);
+    }
+
+    // host or host:port
+    sockaddr_in resolve(const std::string& address, uint16_t defaultPort) {
+        std::string host = address;
+        uint16_t port = defaultPort;
+        const size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0, colon);
+            try {
+                const int value = std::stoi(address.substr(colon + 1));
+                if (value < 1 || value > 65535) {
+                    throw std::out_of_range("port");
+                }
+                port = static_cast<uint16_t>(value);
+            }
+            catch (const std::logic_error&) {
+                throw std::invalid_argument("Invalid port in output address: " + address);
+            }
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || result == nullptr) {
+            throw std::invalid_argument("Can't resolve output address: " + host);
+        }
+        sockaddr_in resolved = *reinterpret_cast<const sockaddr_in*>(result->ai_addr);
+        freeaddrinfo(result);
+        resolved.sin_port = htons(port);
+        return resolved;
+    }
+}
+
+UdpOutput::UdpOutput(const std::vector<OutputTarget>& targets, size_t ledCount, const ThreadSchedule& schedule) : frame(ledCount * 3) {
+    std::random_device random;
+    for (uint8_t& byte : cid) {
+        byte = static_cast<uint8_t>(random());
+    }
+    for (const OutputTarget& target : targets) {
+        if (target.type == OutputTarget::Type::File || target.ledCount == 0 || target.firstLed + target.ledCount > ledCount) {
+            throw std::invalid_argument("Invalid network output: " + target.address);
+        }
+        auto node = std::make_unique<Node>();
+        node->target = target;
+        node->address = resolve(target.address, target.type == OutputTarget::Type::Ddp ? ddpPort : e131Port);
+        node->intervalUs = target.fps > 0 ? 1000000 / target.fps : 0;
+        node->colors.resize(target.ledCount * 3);
+        buildPackets(*node);
+        nodes.push_back(std::move(node));
+    }
+    lastFramesSent.resize(nodes.size());
+
+    socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (socketFd == -1) {
+        throw std::runtime_error("Error creating UDP socket");
+    }
+    // Nodes may be given as a broadcast address
+    const int enable = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+    thread = std::thread(&UdpOutput::senderLoop, this);
+    std::string error = Realtime::setSchedule(schedule, thread.native_handle());
+    if (!error.empty()) {
+        std::cout << "Can't use " << Realtime::policyName(schedule.policy) << " for the network sender: " << error << std::endl;
+    }
+}
+
+UdpOutput::~UdpOutput() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frameCondition.notify_all();
+    thread.join();
+    close(socketFd);
+}
+
+void UdpOutput::buildPackets(Node& node) {
+    const size_t bytes = node.target.ledCount * 3;
+    if (node.target.type == OutputTarget::Type::Ddp) {
+        for (size_t offset = 0; offset < bytes; offset += ddpMaxData) {
+            const size_t length = std::min(ddpMaxData, bytes - offset);
+            std::vector<uint8_t> packet(ddpHeaderSize + length, 0);
+            packet[0] = ddpVersion1 | (offset + length == bytes ? ddpPush : 0);
+            packet[2] = ddpTypeRgb24;
+            packet[3] = ddpIdDisplay;
+            put32(&packet[4], static_cast<uint32_t>(offset));
+            put16(&packet[8], static_cast<uint32_t>(length));
+            node.packets.push_back(std::move(packet));
+        }
+        return;
+    }
+
+    // One universe per 170 LEDs, numbered on from the target's first universe
+    for (size_t first = 0; first < node.target.ledCount; first += e131UniverseLeds) {
+        const size_t channels = std::min(e131UniverseLeds, node.target.ledCount - first) * 3;
+        const size_t length = e131HeaderSize + channels;
+        std::vector<uint8_t> packet(length, 0);
+        uint8_t* p = packet.data();
+        // Root layer
+        put16(p + 0, 0x0010); // Preamble size
+        std::memcpy(p + 4, e131PacketId, sizeof(e131PacketId));
+        put16(p + 16, 0x7000 | static_cast<uint32_t>(length - 16));
+        put32(p + 18, 0x00000004); // VECTOR_ROOT_E131_DATA
+        std::memcpy(p + 22, cid, sizeof(cid));
+        // Framing layer
+        put16(p + 38, 0x7000 | static_cast<uint32_t>(length - 38));
+        put32(p + 40, 0x00000002); // VECTOR_E131_DATA_PACKET
+        std::strncpy(reinterpret_cast<char*>(p + 44), "ambilight", 63);
+        p[108] = 100; // Priority
+        put16(p + 113, static_cast<uint32_t>(node.target.universe + first / e131UniverseLeds));
+        // DMP layer
+        put16(p + 115, 0x7000 | static_cast<uint32_t>(length - 115));
+        p[117] = 0x02; // VECTOR_DMP_SET_PROPERTY
+        p[118] = 0xA1; // Address and data type
+        put16(p + 121, 1); // Address increment
+        put16(p + 123, static_cast<uint32_t>(channels + 1));
+        node.packets.push_back(std::move(packet));
+    }
+}
+
+void UdpOutput::fillPackets(Node& node) {
+    if (node.target.type == OutputTarget::Type::Ddp) {
+        // Sequence numbers run from 1 to 15, 0 means the receiver shouldn't check them
+        node.packetSequence = static_cast<uint8_t>(node.packetSequence % 15 + 1);
+        size_t offset = 0;
+        for (std::vector<uint8_t>& packet : node.packets) {
+            packet[1] = node.packetSequence;
+            std::copy(node.colors.begin() + offset, node.colors.begin() + offset + packet.size() - ddpHeaderSize, packet.begin() + ddpHeaderSize);
+            offset += packet.size() - ddpHeaderSize;
+        }
+        return;
+    }
+    node.packetSequence++;
+    size_t offset = 0;
+    for (std::vector<uint8_t>& packet : node.packets) {
+        packet[e131SequenceOffset] = node.packetSequence;
+        std::copy(node.colors.begin() + offset, node.colors.begin() + offset + packet.size() - e131HeaderSize, packet.begin() + e131HeaderSize);
+        offset += packet.size() - e131HeaderSize;
+    }
+}
+
+void UdpOutput::submit(const uint8_t* colors) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::copy(colors, colors + frame.size(), frame.begin());
+        sequence++;
+        submitTime = std::chrono::steady_clock::now();
+    }
+    frameCondition.notify_all();
+}
+
+void UdpOutput::senderLoop() {
+    // Sized for every packet of every node, so sending never allocates
+    size_t packetCount = 0;
+    for (const auto& node : nodes) {
+        packetCount += node->packets.size();
+    }
+    std::vector<mmsghdr> messages(packetCount);
+    std::vector<iovec> vectors(packetCount);
+    std::vector<Node*> packetNodes(packetCount);
+    std::vector<Node*> due;
+    due.reserve(nodes.size());
+
+    while (true) {
+        std::chrono::steady_clock::time_point frameSubmitTime;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Wait for a new frame, and until at least one node that hasn't sent it yet is past its pacing interval
+            while (true) {
+                if (stopping) {
+                    return;
+                }
+                const auto now = std::chrono::steady_clock::now();
+                auto wake = std::chrono::steady_clock::time_point::max();
+                due.clear();
+                for (const auto& node : nodes) {
+                    if (node->sentSequence == sequence) {
+                        continue;
+                    }
+                    if (node->nextSend <= now) {
+                        due.push_back(node.get());
+                    }
+                    else {
+                        wake = std::min(wake, node->nextSend);
+                    }
+                }
+                if (!due.empty()) {
+                    break;
+                }
+                if (wake == std::chrono::steady_clock::time_point::max()) {
+                    frameCondition.wait(lock);
+                }
+                else {
+                    frameCondition.wait_until(lock, wake);
+                }
+            }
+            for (Node* node : due) {
+                if (node->sentSequence != 0 && sequence - node->sentSequence > 1) {
+                    node->framesSkipped += sequence - node->sentSequence - 1;
+                }
+                node->sentSequence = sequence;
+                copyRange(node->target, frame.data(), node->colors.data());
+            }
+            frameSubmitTime = submitTime;
+        }
+
+        size_t count = 0;
+        for (Node* node : due) {
+            fillPackets(*node);
+            for (std::vector<uint8_t>& packet : node->packets) {
+                vectors[count] = {packet.data(), packet.size()};
+                messages[count].msg_hdr = {};
+                messages[count].msg_hdr.msg_name = &node->address;
+                messages[count].msg_hdr.msg_namelen = sizeof(node->address);
+                messages[count].msg_hdr.msg_iov = &vectors[count];
+                messages[count].msg_hdr.msg_iovlen = 1;
+                packetNodes[count] = node;
+                count++;
+            }
+        }
+
+        // sendmmsg() stops at the first packet that fails. That one is dropped, the rest are tried again.
+        size_t sent = 0;
+        while (sent < count) {
+            const int result = sendmmsg(socketFd, messages.data() + sent, static_cast<unsigned int>(count - sent), 0);
+            if (result > 0) {
+                sent += result;
+            }
+            else if (errno != EINTR) {
+                packetNodes[sent]->packetsDropped++;
+                sent++;
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const int64_t lagUs = std::chrono::duration_cast<std::chrono::microseconds>(now - frameSubmitTime).count();
+        for (Node* node : due) {
+            node->nextSend = now + std::chrono::microseconds(node->intervalUs);
+            node->framesSent++;
+            node->lagUs = lagUs;
+        }
+    }
+}
+
+std::string UdpOutput::statusLine() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastStatusTime).count();
+    if (seconds < 1.0) {
+        return lastStatus;
+    }
+    lastStatusTime = now;
+
+    std::stringstream status;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& node = *nodes[i];
+        uint64_t frames = node.framesSent;
+        status << " | " << (node.target.type == OutputTarget::Type::Ddp ? "ddp " : "e131 ") << node.target.address << ": "
+               << static_cast<int>((frames - lastFramesSent[i]) / seconds) << "fps lag " << node.lagUs << "us skipped " << node.framesSkipped;
+        if (node.packetsDropped > 0) {
+            status << " dropped " << node.packetsDropped;
+        }
+        lastFramesSent[i] = frames;
+    }
+    lastStatus = status.str();
+    return lastStatus;
+}
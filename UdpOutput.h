@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <netinet/in.h>
+#include "OutputSink.h"
+#include "Realtime.h"
+
+// Sends LED frames to network nodes, like ESP32 controllers running WLED, as DDP or E1.31 (sACN) over UDP. All nodes share one
+// non-blocking socket and one sender thread, which sends the packets of every node that is due with a single sendmmsg(). A full
+// socket buffer drops packets instead of blocking; the next frame replaces them anyway.
+class UdpOutput : public OutputSink {
+    struct Node {
+        OutputTarget target;
+        sockaddr_in address{};
+        int64_t intervalUs = 0; // From the target's fps
+        uint64_t sentSequence = 0;
+        std::chrono::steady_clock::time_point nextSend;
+        std::vector<std::vector<uint8_t>> packets; // Headers are filled in once, the colors and sequence number every frame
+        std::vector<uint8_t> colors;                // The node's range, in its LED order
+        uint8_t packetSequence = 0;
+
+        // Statistics, read by statusLine()
+        std::atomic<uint64_t> framesSent{0};
+        std::atomic<uint64_t> framesSkipped{0};  // Frames replaced by a newer one before the node was due
+        std::atomic<uint64_t> packetsDropped{0}; // Socket buffer full, or the network unreachable
+        std::atomic<int64_t> lagUs{0};           // Time from submit() until the last frame was sent
+    };
+
+    int socketFd = -1;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable frameCondition;
+    std::vector<uint8_t> frame;
+    uint64_t sequence = 0;
+    std::chrono::steady_clock::time_point submitTime;
+    bool stopping = false;
+    uint8_t cid[16]; // E1.31 source identifier, random per process
+
+    // For rates in statusLine()
+    std::chrono::steady_clock::time_point lastStatusTime = std::chrono::steady_clock::now();
+    std::vector<uint64_t> lastFramesSent;
+    std::string lastStatus;
+
+    void senderLoop();
+    // Put the colors and sequence number of the current frame into the node's packets
+    void fillPackets(Node& node);
+    void buildPackets(Node& node);
+public:
+    static constexpr uint16_t ddpPort = 4048;
+    static constexpr uint16_t e131Port = 5568;
+    static constexpr size_t ddpMaxData = 1440;     // RGB bytes per DDP packet, 480 LEDs
+    static constexpr size_t e131UniverseLeds = 170; // 510 of the 512 DMX channels
+
+    // targets of type Ddp or E131, each with a range of a chain of ledCount LEDs. Host names are resolved here, once.
+    UdpOutput(const std::vector<OutputTarget>& targets, size_t ledCount, const ThreadSchedule& schedule = {});
+    ~UdpOutput() override;
+
+    UdpOutput(const UdpOutput&) = delete;
+    UdpOutput& operator=(const UdpOutput&) = delete;
+
+    void submit(const uint8_t* colors) override;
+    std::string statusLine() override;
+};
@@ -0,0 +1,116 @@
+#ifdef AMBILIGHT_IO_URING
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "UringReceiver.h"
+
+UringReceiver::UringReceiver(size_t bufferSize) : bufferSize(bufferSize), buffers(std::make_unique<char[]>(bufferSize * bufferCount)) {
+    // Room for returning every buffer plus the receive in a single submission
+    int result = io_uring_queue_init(bufferCount * 2, &ring, 0);
+    if (result < 0) {
+        throw std::runtime_error(std::string("io_uring_queue_init failed: ") + strerror(-result));
+    }
+
+    // Hand over all buffers at once, and wait for the kernel to confirm it took them
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_provide_buffers(sqe, buffers.get(), static_cast<int>(bufferSize), bufferCount, bufferGroup, 0);
+    io_uring_sqe_set_data64(sqe, provideData);
+    result = io_uring_submit_and_wait(&ring, 1);
+    io_uring_cqe* cqe = nullptr;
+    if (result >= 0) {
+        result = io_uring_peek_cqe(&ring, &cqe);
+    }
+    if (result >= 0) {
+        result = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+    }
+    if (result < 0) {
+        io_uring_queue_exit(&ring);
+        throw std::runtime_error(std::string("io_uring provided buffers failed: ") + strerror(-result));
+    }
+    kernelBuffers = bufferCount;
+}
+
+UringReceiver::~UringReceiver() {
+    io_uring_queue_exit(&ring);
+}
+
+void UringReceiver::arm(int fd) {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroup;
+    io_uring_sqe_set_data64(sqe, 0);
+}
+
+void UringReceiver::provide(unsigned id, unsigned count) {
+    // Only failures complete, successful returns don't take up room in the completion queue
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_provide_buffers(sqe, buffers.get() + id * bufferSize, static_cast<int>(bufferSize), count, bufferGroup, id);
+    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    io_uring_sqe_set_data64(sqe, provideData);
+}
+
+bool UringReceiver::receive(int fd, const std::function<void(const char*, size_t)>& onData, uint64_t& syscalls) {
+    arm(fd);
+    while (true) {
+        syscalls++;
+        int result = io_uring_submit_and_wait(&ring, 1);
+        if (result < 0 && result != -EINTR) {
+            throw std::runtime_error(std::string("io_uring_submit_and_wait failed: ") + strerror(-result));
+        }
+
+        unsigned head;
+        unsigned seen = 0;
+        unsigned returned = 0;
+        bool rearm = false;
+        bool done = false;
+        bool unsupported = false;
+        io_uring_cqe* cqe;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            seen++;
+            if (cqe->user_data == provideData) {
+                const int error = -cqe->res;
+                io_uring_cq_advance(&ring, seen);
+                throw std::runtime_error(std::string("io_uring returning a buffer failed: ") + strerror(error));
+            }
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                // Hand the buffer back to the kernel right after use. The return goes out with the next submission.
+                const unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                kernelBuffers--;
+                onData(buffers.get() + id * bufferSize, cqe->res);
+                provide(id, 1);
+                returned++;
+            }
+            else if (cqe->res == -ENOBUFS) {
+                // All buffers were in use, they are back once this batch is submitted. If the kernel should still have had some,
+                // it doesn't take them from this group at all, and waiting for them would spin forever.
+                if (kernelBuffers > 0) {
+                    unsupported = true;
+                }
+                rearm = true;
+            }
+            else if (cqe->res == -EINVAL) {
+                unsupported = true; // No multishot receive in this kernel
+            }
+            else if (cqe->res <= 0) {
+                done = true; // Disconnected (0) or a socket error
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                rearm = true;
+            }
+        }
+        io_uring_cq_advance(&ring, seen);
+        kernelBuffers += returned;
+        if (done) {
+            return true;
+        }
+        if (unsupported) {
+            return false;
+        }
+        if (rearm) {
+            arm(fd);
+        }
+    }
+}
+#endif
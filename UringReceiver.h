@@ -0,0 +1,38 @@
+#pragma once
+#ifdef AMBILIGHT_IO_URING
+#include <liburing.h>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Receives from a socket through io_uring: one multishot recv draws from a group of kernel-selected (provided) buffers,
+// so a steady stream costs one io_uring_enter() per batch of packets instead of a recv() per packet. Buffers are handed to the
+// kernel with IORING_OP_PROVIDE_BUFFERS, which rides along with the next io_uring_enter(), rather than through a registered
+// buffer ring, which some kernels accept but never take buffers from.
+class UringReceiver {
+    static constexpr unsigned bufferCount = 64;
+    static constexpr int bufferGroup = 0;
+    static constexpr uint64_t provideData = 1; // user_data of buffer returns, receives have 0
+
+    io_uring ring{};
+    size_t bufferSize;
+    std::unique_ptr<char[]> buffers;
+    unsigned kernelBuffers = 0; // Buffers the kernel has to pick from, as far as submitted
+
+    void arm(int fd);
+    void provide(unsigned id, unsigned count);
+public:
+    // Throws if io_uring or provided buffers aren't available (old kernel, seccomp, RLIMIT_MEMLOCK)
+    explicit UringReceiver(size_t bufferSize);
+    ~UringReceiver();
+
+    UringReceiver(const UringReceiver&) = delete;
+    UringReceiver& operator=(const UringReceiver&) = delete;
+
+    // Receive from fd until the peer disconnects, calling onData for every chunk. Returns false if the kernel doesn't support
+    // multishot receive, or runs out of buffers while it should still have some. Whatever wasn't passed to onData yet is then
+    // still in the socket, so the caller can continue with recv(). Every io_uring_enter() is counted in syscalls.
+    bool receive(int fd, const std::function<void(const char*, size_t)>& onData, uint64_t& syscalls);
+};
+#endif
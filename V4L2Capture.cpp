@@ -1,61 +1,268 @@
 #include "V4L2Capture.h"
+#include "DeviceWatcher.h"
 #include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
 #include <stdexcept>
 #include <sys/ioctl.h>
 #include <csignal>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
 
-V4L2Capture::V4L2Capture(std::string_view device, int width, int height, int fps, int buffer_count) : buffer_count(buffer_count) {
+V4L2Capture::V4L2Capture(std::string_view device, const CapturePolicy& policy, int buffer_count) : buffer_count(buffer_count) {
     if (buffer_count < 1) {
         throw std::invalid_argument("Buffer count must be at least 1");
     }
 
     // Open the V4L2 device
-    fd = open(device.data(), O_RDWR);
+    fd = open(device.data(), O_RDWR | O_NONBLOCK); // dequeueBuffer() waits with poll(), tryDequeueBuffer() doesn't
     if (fd == -1) {
         throw std::runtime_error("Failed to open V4L2 device");
     }
 
-    // Set capture format
+    // The destructor doesn't run if setting up the device fails, and a leaked descriptor would keep the node busy
+    try {
+        // Pick a mode from what the device offers
+        const std::vector<CaptureMode> modes = enumerateModes(policy);
+        std::optional<CaptureMode> selected = selectMode(modes, policy);
+        if (!selected) {
+            // Some drivers don't enumerate their modes. Ask for the target directly, the driver adjusts it to something it supports.
+            selected = CaptureMode{policy.pixelFormat != 0 ? policy.pixelFormat : V4L2_PIX_FMT_MJPEG, policy.minWidth, policy.minHeight,
+                                   {1, static_cast<uint32_t>(policy.minFps)}};
+            std::cout << "No usable capture modes enumerated, requesting " << selected->describe() << std::endl;
+        }
+        applyMode(*selected);
+        std::cout << "Capturing " << mode.describe() << " (" << modes.size() << " usable modes)" << std::endl;
+        if (mode.pixelFormat != selected->pixelFormat || mode.width != selected->width || mode.height != selected->height) {
+            std::cout << "The driver changed the requested " << selected->describe() << std::endl;
+        }
+
+        // Request buffers
+        struct v4l2_requestbuffers request_buffers{};
+        request_buffers.count = buffer_count;
+        request_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        request_buffers.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(fd, VIDIOC_REQBUFS, &request_buffers) == -1) {
+            throw std::runtime_error("Failed to request buffers");
+        }
+
+        // Create buffers
+        buffers.reserve(buffer_count);
+        for (int i = 0; i < buffer_count; i++) {
+            struct v4l2_buffer buffer{};
+            buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            buffer.memory = V4L2_MEMORY_MMAP;
+            buffer.index = i;
+            if (ioctl(fd, VIDIOC_QUERYBUF, &buffer) == -1) {
+                throw std::runtime_error("Failed to query buffer");
+            }
+            void* ptr = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+            if (ptr == MAP_FAILED) {
+                throw std::runtime_error("Failed to map buffer");
+            }
+            buffers.emplace_back(ptr, buffer.length, i);
+        }
+
+        queueAll();
+
+        // Start streaming
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (ioctl(fd, VIDIOC_STREAMON, &type) == -1) {
+            throw std::runtime_error("Failed to start streaming");
+        }
+    }
+    catch (...) {
+        release();
+        throw;
+    }
+}
+
+std::string CaptureMode::describe() const {
+    std::ostringstream description;
+    for (int shift = 0; shift < 32; shift += 8) {
+        description << static_cast<char>((pixelFormat >> shift) & 0xff);
+    }
+    description << " " << width << "x" << height << " @ " << fps() << "fps";
+    return description.str();
+}
+
+bool V4L2Capture::isSupported(uint32_t pixelFormat) {
+    return pixelFormat == V4L2_PIX_FMT_MJPEG || pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_NV12 ||
+           pixelFormat == V4L2_PIX_FMT_XBGR32 || pixelFormat == V4L2_PIX_FMT_BGR32;
+}
+
+uint32_t V4L2Capture::formatFromName(const std::string& name) {
+    if (name.empty() || name == "auto") return 0;
+    if (name == "mjpeg") return V4L2_PIX_FMT_MJPEG;
+    if (name == "yuyv") return V4L2_PIX_FMT_YUYV;
+    if (name == "nv12") return V4L2_PIX_FMT_NV12;
+    if (name == "bgrx") return V4L2_PIX_FMT_XBGR32;
+    throw std::invalid_argument("Unknown capture format: " + name);
+}
+
+std::vector<CaptureMode> V4L2Capture::enumerateModes(const CapturePolicy& policy) const {
+    std::vector<CaptureMode> modes;
+
+    // Candidate intervals of one frame size
+    auto addIntervals = [&](uint32_t pixelFormat, int width, int height) {
+        struct v4l2_frmivalenum interval{};
+        interval.pixel_format = pixelFormat;
+        interval.width = width;
+        interval.height = height;
+        for (interval.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0; interval.index++) {
+            if (interval.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+                modes.push_back({pixelFormat, width, height, interval.discrete});
+                continue;
+            }
+            // Stepwise or continuous: the fastest and slowest interval, and the one closest to the target in between
+            const v4l2_fract fastest = interval.stepwise.min;
+            const v4l2_fract slowest = interval.stepwise.max;
+            modes.push_back({pixelFormat, width, height, fastest});
+            modes.push_back({pixelFormat, width, height, slowest});
+            const double target = 1.0 / policy.minFps;
+            if (target > static_cast<double>(fastest.numerator) / fastest.denominator && target < static_cast<double>(slowest.numerator) / slowest.denominator) {
+                modes.push_back({pixelFormat, width, height, {1, static_cast<uint32_t>(policy.minFps)}});
+            }
+            break;
+        }
+    };
+
+    struct v4l2_fmtdesc format{};
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (format.index = 0; ioctl(fd, VIDIOC_ENUM_FMT, &format) == 0; format.index++) {
+        if (!isSupported(format.pixelformat) || (policy.pixelFormat != 0 && format.pixelformat != policy.pixelFormat)) {
+            continue;
+        }
+        struct v4l2_frmsizeenum size{};
+        size.pixel_format = format.pixelformat;
+        for (size.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+            if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                addIntervals(format.pixelformat, size.discrete.width, size.discrete.height);
+                continue;
+            }
+            // Stepwise or continuous: the smallest size on the grid that is at least the target, and the largest one
+            const v4l2_frmsize_stepwise& steps = size.stepwise;
+            auto onGrid = [](uint32_t target, uint32_t min, uint32_t max, uint32_t step) {
+                if (target <= min) return min;
+                step = std::max(1u, step);
+                return std::min(max, min + (target - min + step - 1) / step * step);
+            };
+            addIntervals(format.pixelformat, onGrid(policy.minWidth, steps.min_width, steps.max_width, steps.step_width),
+                         onGrid(policy.minHeight, steps.min_height, steps.max_height, steps.step_height));
+            addIntervals(format.pixelformat, steps.max_width, steps.max_height);
+            break;
+        }
+    }
+    return modes;
+}
+
+std::optional<CaptureMode> V4L2Capture::selectMode(const std::vector<CaptureMode>& modes, const CapturePolicy& policy) {
+    auto pixelRate = [](const CaptureMode& mode) { return static_cast<double>(mode.width) * mode.height * mode.fps(); };
+    // How close a mode gets to the target, 1 if it meets it. The fps tolerance accepts 59.94 for 60.
+    auto closeness = [&](const CaptureMode& mode) {
+        return std::min(1.0, mode.fps() / (policy.minFps - 0.1)) * std::min(1.0, static_cast<double>(mode.width) / policy.minWidth) *
+               std::min(1.0, static_cast<double>(mode.height) / policy.minHeight);
+    };
+
+    const CaptureMode* best = nullptr;
+    for (const CaptureMode& mode : modes) {
+        if (mode.fps() <= 0 || (policy.pixelFormat != 0 && mode.pixelFormat != policy.pixelFormat) || (policy.packedOnly && isRawYuv(mode.pixelFormat))) {
+            continue;
+        }
+        if (best == nullptr) {
+            best = &mode;
+            continue;
+        }
+        double modeCloseness = closeness(mode), bestCloseness = closeness(*best);
+        if (modeCloseness != bestCloseness) {
+            if (modeCloseness > bestCloseness) best = &mode;
+            continue;
+        }
+        // Compressed frames have to be fully decoded, raw frames are only read where the zones are
+        if (isCompressed(mode.pixelFormat) != isCompressed(best->pixelFormat)) {
+            if (!isCompressed(mode.pixelFormat)) best = &mode;
+            continue;
+        }
+        if (pixelRate(mode) != pixelRate(*best)) {
+            if (pixelRate(mode) < pixelRate(*best)) best = &mode;
+            continue;
+        }
+        if (mode.fps() > best->fps()) {
+            best = &mode;
+        }
+    }
+    if (best == nullptr && policy.packedOnly) {
+        CapturePolicy anyFormat = policy;
+        anyFormat.packedOnly = false;
+        std::optional<CaptureMode> yuv = selectMode(modes, anyFormat);
+        if (yuv) {
+            std::cout << "No MJPEG or BGRX capture mode, the zone mode can't be used on the raw YUV frames" << std::endl;
+        }
+        return yuv;
+    }
+    if (best == nullptr) {
+        return std::nullopt;
+    }
+    if (closeness(*best) < 1.0) {
+        std::cout << "No capture mode reaches " << policy.minWidth << "x" << policy.minHeight << " @ " << policy.minFps << "fps, using the closest one" << std::endl;
+    }
+    return *best;
+}
+
+void V4L2Capture::applyMode(const CaptureMode& requested) {
+    // Set capture format. The driver may adjust it, so the result is read back from the same struct.
     struct v4l2_format format{};
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.width = width;
-    format.fmt.pix.height = height;
-    format.fmt.pix.pixelformat = V4L2_PIX_FMT_MJPEG;
+    format.fmt.pix.width = requested.width;
+    format.fmt.pix.height = requested.height;
+    format.fmt.pix.pixelformat = requested.pixelFormat;
     format.fmt.pix.field = V4L2_FIELD_NONE;
     if (ioctl(fd, VIDIOC_S_FMT, &format) == -1) {
         throw std::runtime_error("Failed to set capture format");
     }
+    mode.pixelFormat = format.fmt.pix.pixelformat;
+    mode.width = static_cast<int>(format.fmt.pix.width);
+    mode.height = static_cast<int>(format.fmt.pix.height);
+    mode.stride = static_cast<int>(format.fmt.pix.bytesperline);
+    if (!isSupported(mode.pixelFormat)) {
+        throw std::runtime_error("The device switched to an unsupported pixel format: " + mode.describe());
+    }
+    if (mode.stride == 0) {
+        mode.stride = mode.pixelFormat == V4L2_PIX_FMT_YUYV ? mode.width * 2 : mode.pixelFormat == V4L2_PIX_FMT_NV12 ? mode.width : mode.width * 4;
+    }
 
-    // Set capture FPS
-    setFPS(fps);
-
-    // Request buffers
-    struct v4l2_requestbuffers request_buffers{};
-    request_buffers.count = buffer_count;
-    request_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    request_buffers.memory = V4L2_MEMORY_MMAP;
-    if (ioctl(fd, VIDIOC_REQBUFS, &request_buffers) == -1) {
-        throw std::runtime_error("Failed to request buffers");
+    // Set capture interval, and read back the one the driver settled on
+    struct v4l2_streamparm stream_params{};
+    stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    stream_params.parm.capture.timeperframe = requested.interval;
+    if (ioctl(fd, VIDIOC_S_PARM, &stream_params) == -1) {
+        throw std::runtime_error("Failed to set capture FPS");
     }
+    mode.interval = stream_params.parm.capture.timeperframe.denominator != 0 ? stream_params.parm.capture.timeperframe : requested.interval;
+}
 
-    // Create buffers
-    buffers.reserve(buffer_count);
-    for (int i = 0; i < buffer_count; i++) {
-        struct v4l2_buffer buffer{};
-        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buffer.memory = V4L2_MEMORY_MMAP;
-        buffer.index = i;
-        if (ioctl(fd, VIDIOC_QUERYBUF, &buffer) == -1) {
-            throw std::runtime_error("Failed to query buffer");
-        }
-        void* ptr = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
-        if (ptr == MAP_FAILED) {
-            throw std::runtime_error("Failed to map buffer");
-        }
-        buffers.emplace_back(ptr, buffer.length, i);
+Frame V4L2Capture::frameOf(const V4L2Buffer& buffer) const {
+    Frame frame{PixelFormat::YUYV, static_cast<const uint8_t*>(buffer.get_ptr()), mode.width, mode.height, mode.stride};
+    switch (mode.pixelFormat) {
+        case V4L2_PIX_FMT_YUYV:
+            break;
+        case V4L2_PIX_FMT_NV12:
+            frame.format = PixelFormat::NV12;
+            frame.chroma = frame.data + static_cast<size_t>(mode.stride) * mode.height;
+            frame.chromaStride = mode.stride;
+            break;
+        case V4L2_PIX_FMT_XBGR32:
+        case V4L2_PIX_FMT_BGR32:
+            frame.format = PixelFormat::BGRX32;
+            break;
+        default:
+            throw std::invalid_argument("Compressed frames have to be decoded first");
     }
+    return frame;
+}
 
-    // Queue buffers
+void V4L2Capture::queueAll() const {
     for (int i = 0; i < buffer_count; i++) {
         struct v4l2_buffer buffer{}; // This only serves as a container to pass in an index, the index refers to the memory-mapped buffers in the "buffers" vector
         buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -65,33 +272,56 @@ V4L2Capture::V4L2Capture(std::string_view device, int width, int height, int fps
             throw std::runtime_error("Failed to queue buffer");
         }
     }
-
-    // Start streaming
-    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    if (ioctl(fd, VIDIOC_STREAMON, &type) == -1) {
-        throw std::runtime_error("Failed to start streaming");
-    }
 }
 
-void V4L2Capture::setFPS(int fps) const {
+v4l2_fract V4L2Capture::setInterval(v4l2_fract interval) const {
     struct v4l2_streamparm stream_params{};
     stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    stream_params.parm.capture.timeperframe.numerator = 1;
-    stream_params.parm.capture.timeperframe.denominator = fps;
+    stream_params.parm.capture.timeperframe = interval;
     if (ioctl(fd, VIDIOC_S_PARM, &stream_params) == -1) {
-        throw std::runtime_error("Failed to set capture FPS");
+        if (errno != EBUSY) {
+            throw std::runtime_error("Failed to set capture FPS");
+        }
+        // UVC and others only take a new interval while stopped. Stopping also returns every buffer, with their (now stale) frames.
+        enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (ioctl(fd, VIDIOC_STREAMOFF, &type) == -1) {
+            throw std::runtime_error("Failed to stop streaming");
+        }
+        stream_params = {};
+        stream_params.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        stream_params.parm.capture.timeperframe = interval;
+        const bool set = ioctl(fd, VIDIOC_S_PARM, &stream_params) != -1;
+        queueAll();
+        if (ioctl(fd, VIDIOC_STREAMON, &type) == -1) {
+            throw std::runtime_error("Failed to start streaming");
+        }
+        if (!set) {
+            throw std::runtime_error("Failed to set capture FPS");
+        }
     }
+    return stream_params.parm.capture.timeperframe.denominator != 0 ? stream_params.parm.capture.timeperframe : interval;
+}
+
+double V4L2Capture::setFPS(int fps) const {
+    const v4l2_fract interval = setInterval({1, static_cast<uint32_t>(fps)});
+    return interval.numerator == 0 ? 0 : static_cast<double>(interval.denominator) / interval.numerator;
+}
+
+void V4L2Capture::restoreFPS() const {
+    setInterval(mode.interval);
 }
 
-V4L2Capture::V4L2Capture(V4L2Capture&& other) noexcept : buffer_count(other.buffer_count), buffers(std::move(other.buffers)), fd(other.fd) {
+V4L2Capture::V4L2Capture(V4L2Capture&& other) noexcept : buffer_count(other.buffer_count), buffers(std::move(other.buffers)), fd(other.fd), mode(other.mode) {
     other.fd = -1;
 }
 
 V4L2Capture& V4L2Capture::operator=(V4L2Capture&& other) noexcept {
     if (this != &other) {
+        release();
         buffer_count = other.buffer_count;
         buffers = std::move(other.buffers);
         fd = other.fd;
+        mode = other.mode;
 
         other.fd = -1;
     }
@@ -99,14 +329,63 @@ V4L2Capture& V4L2Capture::operator=(V4L2Capture&& other) noexcept {
 }
 
 V4L2Capture::~V4L2Capture() {
+    release();
+}
+
+void V4L2Capture::release() {
     if (fd != -1) {
         enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         ioctl(fd, VIDIOC_STREAMOFF, &type);
+        buffers.clear();
         close(fd);
+        fd = -1;
+    }
+}
+
+bool V4L2Capture::reopen(const std::string& device, const CapturePolicy& policy, int bufferCount, const std::function<bool()>& waiting) {
+    // Close it right away, a re-enumerated device only gets its old node back once nothing holds the old one
+    release();
+    DeviceWatcher deviceWatcher;
+    while (waiting()) {
+        if (!deviceWatcher.waitFor(device, 40)) {
+            continue;
+        }
+        try {
+            *this = V4L2Capture(device, policy, bufferCount);
+            return true;
+        }
+        catch (const std::runtime_error&) {
+            // The node can show up before the driver is ready
+            usleep(100000);
+        }
     }
+    return false;
 }
 
-const V4L2Buffer& V4L2Capture::dequeueBuffer() const {
+const V4L2Buffer& V4L2Capture::dequeueBuffer() {
+    while (true) {
+        if (const V4L2Buffer* buffer = tryDequeueBuffer()) {
+            return *buffer;
+        }
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            throw std::runtime_error("Failed to wait for buffer");
+        }
+    }
+}
+
+const V4L2Buffer* V4L2Capture::dequeueBuffer(int timeoutMs) {
+    if (const V4L2Buffer* buffer = tryDequeueBuffer()) {
+        return buffer;
+    }
+    pollfd pfd{fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) == -1 && errno != EINTR) {
+        throw std::runtime_error("Failed to wait for buffer");
+    }
+    return tryDequeueBuffer();
+}
+
+const V4L2Buffer* V4L2Capture::tryDequeueBuffer() {
     if (fd == -1) {
         throw std::runtime_error("V4L2 device not initialized");
     }
@@ -114,9 +393,49 @@ const V4L2Buffer& V4L2Capture::dequeueBuffer() const {
     buffer_metadata.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buffer_metadata.memory = V4L2_MEMORY_MMAP;
     if (ioctl(fd, VIDIOC_DQBUF, &buffer_metadata) == -1) {
+        if (errno == EAGAIN) {
+            return nullptr;
+        }
         throw std::runtime_error("Failed to dequeue buffer");
     }
-    return buffers[buffer_metadata.index];
+    V4L2Buffer& buffer = buffers[buffer_metadata.index];
+    buffer.setMetadata(buffer_metadata);
+    return &buffer;
+}
+
+const V4L2Buffer& V4L2Capture::dequeueLatest(int& skipped) {
+    while (true) {
+        if (const V4L2Buffer* buffer = tryDequeueLatest(skipped)) {
+            return *buffer;
+        }
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            throw std::runtime_error("Failed to wait for buffer");
+        }
+    }
+}
+
+const V4L2Buffer* V4L2Capture::tryDequeueLatest(int& skipped) {
+    const V4L2Buffer* latest = tryDequeueBuffer();
+    if (latest == nullptr) {
+        return nullptr;
+    }
+    // An older frame only goes back once a newer one is out of the queue, so there is always one left to return
+    while (const V4L2Buffer* newer = tryDequeueBuffer()) {
+        queueBuffer(*latest);
+        skipped++;
+        latest = newer;
+    }
+    return latest;
+}
+
+int V4L2Capture::drain() {
+    int dropped = 0;
+    while (const V4L2Buffer* buffer = tryDequeueBuffer()) {
+        queueBuffer(*buffer);
+        dropped++;
+    }
+    return dropped;
 }
 
 void V4L2Capture::queueBuffer(const V4L2Buffer& buffer) const {
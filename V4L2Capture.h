@@ -4,12 +4,22 @@
 #include <memory>
 #include <sys/mman.h>
 #include <vector>
+#include <optional>
+#include <functional>
+#include <cstdint>
+#include "Frame.h"
 
 // RAII wrapper for V4L2 buffer(memory mapped ptr)
 class V4L2Buffer {
     void* ptr = nullptr;
     size_t length = 0;
     size_t index = 0; // Index of the buffer within the V4L2 device, used for simpler queueing
+
+    // Metadata of the frame currently in the buffer, set when it's dequeued
+    size_t bytesused = 0;
+    uint32_t sequence = 0;
+    uint32_t flags = 0;
+    timeval timestamp{};
 public:
     V4L2Buffer(void* ptr, size_t length, size_t index) : ptr(ptr), length(length), index(index) {}
     V4L2Buffer(V4L2Buffer&& other) noexcept : ptr(other.ptr), length(other.length), index(other.index) {
@@ -38,14 +48,58 @@ public:
     V4L2Buffer& operator=(const V4L2Buffer&) = delete;
 
     size_t get_index() const { return index; }
+
+    // Size of the frame data, for compressed formats usually much less than the buffer length
+    size_t get_bytesused() const { return bytesused != 0 ? bytesused : length; }
+    // Frame counter of the driver, gaps mean dropped frames
+    uint32_t get_sequence() const { return sequence; }
+    // When the frame was captured (CLOCK_MONOTONIC for most drivers)
+    const timeval& get_timestamp() const { return timestamp; }
+    // V4L2_BUF_FLAG_*, including which clock the timestamp is from
+    uint32_t get_flags() const { return flags; }
+
+    void setMetadata(const v4l2_buffer& metadata) {
+        bytesused = metadata.bytesused;
+        sequence = metadata.sequence;
+        flags = metadata.flags;
+        timestamp = metadata.timestamp;
+    }
+};
+
+// A pixel format, frame size and frame interval the device can capture
+struct CaptureMode {
+    uint32_t pixelFormat = 0; // V4L2_PIX_FMT_*
+    int width = 0;
+    int height = 0;
+    v4l2_fract interval{1, 30}; // Time per frame in seconds
+    int stride = 0; // Bytes per row, only known once the format is set
+
+    double fps() const { return interval.numerator == 0 ? 0 : static_cast<double>(interval.denominator) / interval.numerator; }
+    std::string describe() const; // Like "MJPG 1280x720 @ 60fps"
+};
+
+// What the pipeline needs from the device. The cheapest mode that is at least this large and fast is selected.
+struct CapturePolicy {
+    int minWidth;
+    int minHeight;
+    int minFps;
+    uint32_t pixelFormat = 0; // Only consider this format, 0 for any format the pipeline can process
+    bool packedOnly = false;  // With any format: prefer the ones decoded or delivered as packed pixels, for zone modes other than the mean
 };
 
 class V4L2Capture {
     int buffer_count = 0;
     std::vector<V4L2Buffer> buffers;
     int fd = -1;
+    CaptureMode mode; // As reported back by the driver
+
+    std::vector<CaptureMode> enumerateModes(const CapturePolicy& policy) const;
+    void applyMode(const CaptureMode& requested);
+    void queueAll() const;
+    // Change the frame interval of the running stream, restarting it if the driver refuses while streaming. Returns the interval the driver applied.
+    v4l2_fract setInterval(v4l2_fract interval) const;
 public:
-    V4L2Capture(std::string_view device, int width, int height, int fps = 30, int buffer_count = 4);
+    V4L2Capture(std::string_view device, const CapturePolicy& policy, int buffer_count = 4);
     ~V4L2Capture();
 
     V4L2Capture(const V4L2Capture&) = delete;
@@ -54,8 +108,52 @@ public:
     V4L2Capture(V4L2Capture&& other) noexcept;
     V4L2Capture& operator=(V4L2Capture&& other) noexcept;
 
-    void setFPS(int fps) const;
+    // Stop streaming, unmap the buffers and close the device, like after it was unplugged, so the driver can release it.
+    // Only assignment and destruction are valid afterwards.
+    void release();
+    // After the device was lost: release it, wait for it to come back and open it again with policy. waiting is called about every
+    // 40ms meanwhile and gives up by returning false, in which case this returns false and the device stays released.
+    bool reopen(const std::string& device, const CapturePolicy& policy, int bufferCount, const std::function<bool()>& waiting);
+
+    // Lower (or raise) the frame rate without renegotiating the mode, and go back to the negotiated one.
+    // The driver may restart the stream for this, so no buffer may be dequeued while calling these. setFPS returns the fps actually set.
+    double setFPS(int fps) const;
+    void restoreFPS() const;
+
+    // Format, size and frame rate actually negotiated with the driver. Everything downstream has to use these, not the configured ones.
+    const CaptureMode& getMode() const { return mode; }
+
+    // View of a dequeued buffer of a raw (uncompressed) format
+    Frame frameOf(const V4L2Buffer& buffer) const;
+
+    // Formats the pipeline can process, either directly or after decoding
+    static bool isSupported(uint32_t pixelFormat);
+    static bool isCompressed(uint32_t pixelFormat) { return pixelFormat == V4L2_PIX_FMT_MJPEG; }
+    // YUYV and NV12, which are averaged on their YUV pixels and only support the mean zone mode
+    static bool isRawYuv(uint32_t pixelFormat) { return pixelFormat == V4L2_PIX_FMT_YUYV || pixelFormat == V4L2_PIX_FMT_NV12; }
+    // capture_format config values, like "mjpeg" or "yuyv". "auto" is 0.
+    static uint32_t formatFromName(const std::string& name);
+
+    // Pick the cheapest mode meeting the policy: raw formats over compressed ones (which need decoding), then the fewest pixels per second.
+    // If none meets it, the mode that comes closest. With packedOnly, raw YUV modes are only used if there is nothing else.
+    // Empty if there are no usable modes.
+    static std::optional<CaptureMode> selectMode(const std::vector<CaptureMode>& modes, const CapturePolicy& policy);
+
+    // For waiting on the device together with other events: readable when a frame can be dequeued
+    int getFd() const { return fd; }
 
-    const V4L2Buffer& dequeueBuffer() const;
+    // Wait for the next frame
+    const V4L2Buffer& dequeueBuffer();
+    // Wait at most timeoutMs for the next frame, nullptr if none arrived
+    const V4L2Buffer* dequeueBuffer(int timeoutMs);
+    // The next frame if one is ready, without waiting
+    const V4L2Buffer* tryDequeueBuffer();
+    // Wait for a frame, then take every frame that is ready and give back all but the newest, so a loop that fell behind continues with
+    // the current picture instead of working through the queue. skipped is increased by the frames given back.
+    const V4L2Buffer& dequeueLatest(int& skipped);
+    // Same, without waiting. nullptr if no frame is ready.
+    const V4L2Buffer* tryDequeueLatest(int& skipped);
     void queueBuffer(const V4L2Buffer& buffer) const;
+    // Give back every frame that is already waiting, so the next dequeue returns a fresh one. Returns how many were dropped.
+    int drain();
 };
\ No newline at end of file
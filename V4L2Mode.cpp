@@ -1,16 +1,17 @@
 #include <unistd.h>
-#include <turbojpeg.h>
+#include <poll.h>
+#include <cerrno>
 #include <csignal>
 #include <iostream>
 #include <chrono>
 #include <complex>
-#include <functional>
-#include "SerialPort.hpp"
 #include "Averager.h"
-#include "ColorOfBlock.hpp"
+#include "LatencyTracker.h"
+#include "JpegDecoder.h"
+#include "DecodePool.h"
+#include "LedPipeline.h"
 #include "V4L2Capture.h"
 #include "V4L2Mode.hpp"
-#include "ArrayAverager.h"
 
 bool V4L2Mode::V4L2Run = true;
 
@@ -19,49 +20,52 @@ void V4L2Mode::V4L2Sighandler(int signum) {
     V4L2Mode::V4L2Run = false;
 }
 
-uint8_t V4L2Mode::gammaCorrection(uint8_t inputBrightness, double gamma) {
-    double adjustedBrightness = 255 * std::pow((inputBrightness / 255.0), gamma);
-    adjustedBrightness = std::max(0.0, std::min(adjustedBrightness, 255.0));
-    return static_cast<uint8_t>(adjustedBrightness);
-}
-
-void V4L2Mode::start(std::map<std::string, std::string> config) {
+void V4L2Mode::start(const Config& config, ConfigWatcher& watcher) {
     signal(SIGINT, V4L2Mode::V4L2Sighandler);
 
-    // Parse config
-    const int vertical_leds = std::stoi(config["vertical_leds"]);
-    const int horizontal_leds = std::stoi(config["horizontal_leds"]);
-    const int border_size = std::stoi(config["border_size"]);
-    const int capture_width = std::stoi(config["capture_width"]);
-    const int capture_height = std::stoi(config["capture_height"]);
-    const int capture_fps = std::stoi(config["capture_fps"]);
-    const float column_block_height = (float)capture_height / (float)vertical_leds;
-    const float row_block_width = (float)capture_width / (float)horizontal_leds;
-    const double gamma = std::stod(config["gamma_correction"]);
-    const int buffer_count = std::stoi(config["v4l2_buffer_count"]);
-    const int baudrate = std::stoi(config["baud"]);
-    const int sleep_after = std::stoi(config["sleep_after"]);
-    const int averaging_samples = std::stoi(config["averaging_samples"]);
-
-    // Initialize serial port
-    SerialPort mcu = SerialPort(config["serial_port"], baudrate);
-
-    // Open v4l2 device
-    V4L2Capture v4l2Capture(config["capture_device"], capture_width, capture_height, capture_fps, buffer_count);
-
-    // Create JPEG decompressor
-    tjhandle tjhandle = tjInitDecompress();
+    const std::vector<CaptureSourceSpec> specs = CaptureSource::sourcesFromConfig(config);
+    if (!specs.empty()) {
+        startSources(config, watcher, specs);
+        return;
+    }
 
-    // Buffer for holding the decoded rgb data
-    std::unique_ptr<uint8_t[]> rgbBuffer = nullptr;
+    // Open v4l2 device. The configured size and fps are the minimum, the device picks the cheapest mode that meets them.
+    const uint32_t format = V4L2Capture::formatFromName(config.capture_format);
+    const CapturePolicy policy{config.capture_width, config.capture_height, config.capture_fps, format, format == 0 && config.zone_mode != "mean"};
+    V4L2Capture v4l2Capture(config.capture_device, policy, config.v4l2_buffer_count);
+    const CaptureMode& mode = v4l2Capture.getMode();
+    bool compressed = V4L2Capture::isCompressed(mode.pixelFormat); // Can change when the device comes back after being lost
+
+    // Zone extraction, color correction and the outputs, rebuilt in place when the config changes. The zones follow the negotiated frame size.
+    LedPipeline pipeline(config, mode.width, mode.height);
+    pipeline.setRawYuv(V4L2Capture::isRawYuv(mode.pixelFormat), config.capture_device);
+
+    // JPEG decompressor and the buffers for decoded frames. Sized for the negotiated mode up front, they only grow if the JPEGs turn out larger.
+    JpegDecoder decoder(config.decode_threads == 1 ? config.decode_split : 1);
+    if (compressed && config.decode_threads == 1) {
+        decoder.reserve(mode.width, mode.height, pipeline.decodesPlanar());
+    }
 
-    const size_t ledCount = (horizontal_leds + vertical_leds) * 2 * 3;
+    // With decode_threads, frames are decoded on a pool of threads instead, several at a time
+    std::unique_ptr<DecodePool> decodePool;
+    if (compressed && config.decode_threads > 1) {
+        decodePool = std::make_unique<DecodePool>(config.decode_threads, config.decode_cpus, config.threadSchedule(Config::ThreadRole::Extract));
+        if (config.v4l2_buffer_count < config.decode_threads + 2) {
+            std::cout << "v4l2_buffer_count is " << config.v4l2_buffer_count << ", " << config.decode_threads + 2 << " buffers are needed to keep "
+                      << config.decode_threads << " decode threads busy" << std::endl;
+        }
+    }
 
-    // Buffer to hold LED data for the current frame
-    std::vector<uint8_t> ledData(ledCount);
+    // Recording of every frame and event, if configured
+    std::unique_ptr<FlightRecorder> recorder = LedPipeline::openRecorder(config);
 
-    // Averager for LED data
-    ArrayAverager<uint8_t> ledDataAverager(averaging_samples, ledCount);
+    // Real-time scheduling and locked memory, if configured. Pre-fault what the loop touches, so the first frames don't pay for page faults either.
+    LedPipeline::enterRealtime(config);
+    if (config.lock_memory) {
+        Realtime::prefault(decoder.rgb().get(), decoder.rgb().size());
+        Realtime::prefault(decoder.planes().get(), decoder.planes().size());
+        Realtime::prefaultStack();
+    }
 
     // Averagers for timing debug info
     Averager<int64_t> dqtimeAverager(20);
@@ -71,151 +75,316 @@ void V4L2Mode::start(std::map<std::string, std::string> config) {
     Averager<int64_t> writetimeAverager(20);
     Averager<int64_t> queuedurationAverager(20);
     Averager<int64_t> totaldurationAverager(20);
+    Averager<int64_t> frameAgeAverager(20); // From capture (the driver's timestamp) until the frame was dequeued
+    LatencyTracker frameLatency; // From capture (the driver's timestamp) until the frame is submitted to the outputs
 
     // Sleep mode related variables
     int blankCount = 0; // How many sequential frames have been blank (or more precisely, just the LEDs)
-    bool sleepNow = false; // If true, slow down framerate to 1 FPS
+    bool sleepNow = false; // If true, the device captures at sleep_fps and frames are only probed for activity
+    bool hardwareSleep = false; // If the device itself slowed down. Otherwise frames are fetched at sleep_fps by waiting between them.
+    size_t sleepFrameSize = 0; // Compressed size of the last blank frame, 0 if not known
+    int probeSkips = 0; // Frames skipped by the size probe since the last full decode
+
+    // Hotplug recovery: when the device goes away, wait for it to come back and reopen it in place. The pipeline, with its zones, tables
+    // and serial ports, and the decode buffers stay as they are. Meanwhile the LEDs keep their colors, or fade out over hotplug_fade.
+    int reconnects = 0;
+    int64_t recoveryMs = 0;
+    std::vector<DecodePool::Stale> stale; // Buffers the decode pool is done with, to requeue
+    auto recoverCapture = [&](const std::string& reason) {
+        const auto lost = std::chrono::steady_clock::now();
+        std::cout << std::endl << "Capture device lost (" << reason << "), waiting for " << config.capture_device << " to come back" << std::endl;
+        if (recorder) {
+            recorder->event(FlightFormat::Event::CaptureLost);
+        }
+        // The decoders may still read from the buffers that are about to be unmapped
+        if (decodePool) {
+            decodePool->release();
+            decodePool->finish(stale);
+            stale.clear();
+        }
+        bool fadeDone = false;
+        auto fade = [&] {
+            const int fadeMs = pipeline.getConfig().hotplug_fade;
+            if (fadeMs > 0 && !fadeDone) {
+                const int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
+                const int64_t weight = std::max<int64_t>(0, 256 - elapsedMs * 256 / fadeMs);
+                pipeline.sendDimmed(static_cast<uint32_t>(weight));
+                fadeDone = weight == 0;
+            }
+            return static_cast<bool>(V4L2Run);
+        };
+        if (v4l2Capture.reopen(config.capture_device, policy, config.v4l2_buffer_count, fade)) {
+            if (V4L2Capture::isCompressed(mode.pixelFormat) != compressed) {
+                // Another device on the same node, or one that changed its formats. Set up decoding for the new kind of frames.
+                compressed = !compressed;
+                sleepFrameSize = 0;
+                if (!compressed) {
+                    decodePool.reset();
+                }
+                else if (config.decode_threads > 1) {
+                    decodePool = std::make_unique<DecodePool>(config.decode_threads, config.decode_cpus, config.threadSchedule(Config::ThreadRole::Extract));
+                }
+                else {
+                    decoder.reserve(mode.width, mode.height, pipeline.decodesPlanar());
+                }
+                std::cout << "The capture device came back with " << (compressed ? "compressed" : "raw") << " frames" << std::endl;
+            }
+            recoveryMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
+            reconnects++;
+            std::cout << "Capture device back after " << recoveryMs << "ms: " << v4l2Capture.getMode().describe() << std::endl;
+            pipeline.setRawYuv(V4L2Capture::isRawYuv(mode.pixelFormat), config.capture_device);
+            if (recorder) {
+                recorder->event(FlightFormat::Event::CaptureRestored, recoveryMs);
+            }
+            blankCount = 0;
+            sleepNow = false;
+            hardwareSleep = false;
+        }
+    };
+
+    // While sleeping, a compressed frame is only decoded if its size differs from the blank ones: a black picture compresses to
+    // nearly the same size every time, while any content changes it. Every 10th frame is decoded regardless, in case content happens to match.
+    // Returns true if the frame was skipped and its buffer queued again.
+    auto skipProbe = [&](const V4L2Buffer& buf) {
+        if (!sleepNow || !compressed || sleepFrameSize == 0) {
+            return false;
+        }
+        const size_t size = buf.get_bytesused();
+        const size_t tolerance = sleepFrameSize / 8;
+        if (size + tolerance >= sleepFrameSize && size <= sleepFrameSize + tolerance && ++probeSkips < 10) {
+            v4l2Capture.queueBuffer(buf);
+            std::cout << "\r\033[K" << "SLEEPING, frame size " << size << " bytes" << pipeline.statusLine();
+            std::cout.flush();
+            if (!hardwareSleep) {
+                usleep(1000000 / pipeline.getConfig().sleep_fps);
+            }
+            return true;
+        }
+        probeSkips = 0;
+        return false;
+    };
+
+    // With capture_latest, every frame that is ready is dequeued and all but the newest are queued again right away
+    int64_t latestSkipped = 0;
+    auto dequeueNext = [&](bool wait) {
+        int skipped = 0;
+        const V4L2Buffer* buffer = nullptr;
+        if (pipeline.getConfig().capture_latest) {
+            buffer = wait ? &v4l2Capture.dequeueLatest(skipped) : v4l2Capture.tryDequeueLatest(skipped);
+        }
+        else {
+            buffer = wait ? &v4l2Capture.dequeueBuffer() : v4l2Capture.tryDequeueBuffer();
+        }
+        if (skipped > 0) {
+            latestSkipped += skipped;
+            if (recorder) {
+                recorder->event(FlightFormat::Event::FramesSkipped, skipped);
+            }
+        }
+        return buffer;
+    };
+
+    // Keep every decoder of the pool busy, and wait for the next decoded frame in capture order: whichever comes first, a frame for an idle
+    // decoder or a decoded one, is handled right away. While sleeping, frames are decoded one at a time. Returns false when stopping.
+    int64_t lateFrames = 0;
+    int64_t decodeErrors = 0;
+    DecodePool::Decoded pooled;
+    auto nextDecoded = [&]() {
+        bool drained = false;
+        while (V4L2Run) {
+            const bool ready = decodePool->take(pooled, stale);
+            for (const DecodePool::Stale& frame : stale) {
+                if (frame.failed) {
+                    std::cout << std::endl << "Error decompressing frame " << frame.buffer->get_sequence() << ", skipping" << std::endl;
+                    decodeErrors++;
+                    if (recorder) {
+                        recorder->event(FlightFormat::Event::DecodeError, static_cast<int64_t>(frame.buffer->get_bytesused()));
+                    }
+                } else {
+                    lateFrames++;
+                    if (recorder) {
+                        recorder->event(FlightFormat::Event::FramesSkipped, 1);
+                    }
+                }
+                v4l2Capture.queueBuffer(*frame.buffer);
+            }
+            stale.clear();
+            if (ready) {
+                return true;
+            }
 
-    // Pick the best available SIMD implementation
-    #ifdef __AVX2__
-    std::function<std::tuple<uint8_t, uint8_t, uint8_t>(const uint8_t*, int, int, int, int, int, int)> colorOfBlock = ::colorOfBlock<AVX2>;
-    #elif __SSE2__
-    std::function<std::tuple<uint8_t, uint8_t, uint8_t>(const uint8_t*, int, int, int, int, int, int)> colorOfBlock = ::colorOfBlock<SSE2>;
-    #else
-    std::function<std::tuple<uint8_t, uint8_t, uint8_t>(const uint8_t*, int, int, int, int, int, int)> colorOfBlock = ::colorOfBlock<void>;
-    #endif
+            const bool accept = sleepNow ? decodePool->empty() : !decodePool->full();
+            if (accept) {
+                // When sleeping in software, everything that arrived during the wait is outdated
+                if (sleepNow && !hardwareSleep && !drained) {
+                    v4l2Capture.drain();
+                    drained = true;
+                }
+                if (const V4L2Buffer* buf = dequeueNext(false)) {
+                    if (!skipProbe(*buf)) {
+                        decodePool->submit(*buf, pipeline.decodesPlanar(), std::chrono::steady_clock::now());
+                    }
+                    continue;
+                }
+            }
+            pollfd fds[2] = {{decodePool->getEventFd(), POLLIN, 0}, {accept ? v4l2Capture.getFd() : -1, POLLIN, 0}};
+            if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+                throw std::runtime_error("Failed to wait for buffer");
+            }
+        }
+        return false;
+    };
 
     while (V4L2Run) {
-        auto start = std::chrono::high_resolution_clock::now();
-
-        // Dequeue buffer
-        const V4L2Buffer& buf = v4l2Capture.dequeueBuffer();
-        auto dqtime = std::chrono::high_resolution_clock::now();
-
-        // Decompress header
-        int width, height, jpegsubsamp, jpegcolorspace;
-        int headerResult = tjDecompressHeader3(tjhandle, static_cast<unsigned char*>(buf.get_ptr()), buf.get_length(), &width, &height, &jpegsubsamp, &jpegcolorspace);
-
-        // If decompression failed, requeue the buffer and start over
-        if(headerResult == -1) {
-            std::cout << "Error decompressing header, fetching new buffer" << std::endl;
-            // Try to requeue a few times
-            int retryCount = 0;
-            while(true) {
-                try {
-                    v4l2Capture.queueBuffer(buf);
-                    break;
+        // Apply config changes between frames, the capture stream keeps running
+        if (std::optional<Config> update = watcher.takeUpdate()) {
+            watcher.applied(pipeline.apply(*update));
+            if (recorder) {
+                recorder->event(FlightFormat::Event::ConfigApplied);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // Dequeue buffer, or with the decode pool the next decoded frame. When sleeping in software, everything that arrived during the wait is outdated.
+        const V4L2Buffer* dequeued = nullptr;
+        Frame frame{};
+        try {
+            if (decodePool) {
+                if (!nextDecoded()) {
+                    continue;
                 }
-                catch(const std::runtime_error& e) {
-                    std::cout << "Error queuing buffer: " << e.what() << ", retrying..." << std::endl;
+                dequeued = pooled.buffer;
+                frame = pooled.frame;
+            }
+            else {
+                if (sleepNow && !hardwareSleep) {
+                    v4l2Capture.drain();
                 }
-                retryCount++;
-                if(retryCount > 10) {
-                    throw std::runtime_error("Failed to queue buffer after 10 retries");
+                dequeued = dequeueNext(true);
+                if (skipProbe(*dequeued)) {
+                    continue;
                 }
             }
+        }
+        catch (const std::runtime_error& e) {
+            recoverCapture(e.what());
             continue;
         }
+        const V4L2Buffer& buf = *dequeued;
+        auto dqtime = std::chrono::steady_clock::now();
+        const size_t frameSize = buf.get_bytesused();
 
-        // First time running, allocate buffer for decoded rgb data. Needs to be done after the first frame is captured, as we don't know the size of the image before the JPEG header is parsed.
-        if (!rgbBuffer) {
-            rgbBuffer = std::make_unique<unsigned char[]>(width * height * 3 + 16); // extra padding needed for SIMD optimizations in colorOfBlock
+        if (decodePool) {
+            // Decoded on the pool already
+        }
+        else if (!compressed) {
+            // Raw frames are processed right in the V4L2 buffer
+            frame = v4l2Capture.frameOf(buf);
+        }
+        else {
+            // Decompress jpeg, to the YCbCr planes if the zones can be averaged on them
+            const bool decoded = decoder.decode(static_cast<const uint8_t*>(buf.get_ptr()), buf.get_bytesused(), pipeline.decodesPlanar(), frame);
+
+            // If decompression failed, requeue the buffer and start over
+            if(!decoded) {
+                std::cout << "Error decompressing frame, fetching new buffer" << std::endl;
+                if (recorder) {
+                    recorder->event(FlightFormat::Event::DecodeError, static_cast<int64_t>(buf.get_bytesused()));
+                }
+                // Try to requeue a few times
+                int retryCount = 0;
+                bool lost = false;
+                while(true) {
+                    try {
+                        v4l2Capture.queueBuffer(buf);
+                        break;
+                    }
+                    catch(const std::runtime_error& e) {
+                        std::cout << "Error queuing buffer: " << e.what() << ", retrying..." << std::endl;
+                    }
+                    retryCount++;
+                    if (recorder) {
+                        recorder->event(retryCount > 10 ? FlightFormat::Event::QueueFailed : FlightFormat::Event::QueueRetry, retryCount);
+                    }
+                    if(retryCount > 10) {
+                        lost = true;
+                        break;
+                    }
+                }
+                if (lost) {
+                    recoverCapture("failed to queue buffer after 10 retries");
+                }
+                continue;
+            }
         }
 
-        // Decompress jpeg
-        tjDecompress2(tjhandle, static_cast<unsigned char*>(buf.get_ptr()), buf.get_length(), rgbBuffer.get(), width, 0, height, TJPF_RGB, 0);
-
-        auto decomptime = std::chrono::high_resolution_clock::now();
+        auto decomptime = std::chrono::steady_clock::now();
 
         // Calculate the colors of the LEDs based on the image
-        ssize_t ledDataIndex = 0;
-        //right column, bottom to top
-        for(int i = vertical_leds - 1; i >= 0; i--) {
-            int blockTop = static_cast<int>(static_cast<float>(i) * column_block_height);
-            int blockLeft = capture_width - border_size;
-            auto color = colorOfBlock(rgbBuffer.get(), width, height, blockLeft, blockTop, border_size, (int)column_block_height);
-            ledData[ledDataIndex++] = std::get<0>(color);
-            ledData[ledDataIndex++] = std::get<1>(color);
-            ledData[ledDataIndex++] = std::get<2>(color);
-        }
-        //top row, right to left
-        for(int i = horizontal_leds - 1; i >= 0; i--) {
-            int blockTop = 0;
-            int blockLeft = static_cast<int>(static_cast<float>(i) * row_block_width);
-            auto color = colorOfBlock(rgbBuffer.get(), width, height, blockLeft, blockTop, (int)row_block_width, border_size);
-            ledData[ledDataIndex++] = std::get<0>(color);
-            ledData[ledDataIndex++] = std::get<1>(color);
-            ledData[ledDataIndex++] = std::get<2>(color);
-        }
-        //left column, top to bottom
-        for(int i = 0; i < vertical_leds; i++) {
-            int blockTop = static_cast<int>(static_cast<float>(i) * column_block_height);
-            int blockLeft = 0;
-            auto color = colorOfBlock(rgbBuffer.get(), width, height, blockLeft, blockTop, border_size, (int)column_block_height);
-            ledData[ledDataIndex++] = std::get<0>(color);
-            ledData[ledDataIndex++] = std::get<1>(color);
-            ledData[ledDataIndex++] = std::get<2>(color);
-        }
-        //bottom row, left to right
-        for(int i = 0; i < horizontal_leds; i++) {
-            int blockTop = capture_height - border_size;
-            int blockLeft = static_cast<int>(static_cast<float>(i) * row_block_width);
-            auto color = colorOfBlock(rgbBuffer.get(), width, height, blockLeft, blockTop, (int)row_block_width, border_size);
-            ledData[ledDataIndex++] = std::get<0>(color);
-            ledData[ledDataIndex++] = std::get<1>(color);
-            ledData[ledDataIndex++] = std::get<2>(color);
-        }
-
-        auto extracttime = std::chrono::high_resolution_clock::now();
-
-        // Do gamma correction
-        for(int i = 0; i < (horizontal_leds + vertical_leds) * 2 * 3; i++) {
-            ledData[i] = gammaCorrection(ledData[i], gamma);
-        }
-
-        ledDataAverager.add(ledData.data());
-
-        // Get averaged data
-        std::vector<uint8_t> ledDataAvg(ledCount);
-        ledDataAverager.getAverage<uint64_t>(ledDataAvg.data()); // Use uint64_t for summing internally to prevent overflow
-
-        // Detect if blank and replace newlines(special delimiter)
+        pipeline.extract(frame);
+
+        auto extracttime = std::chrono::steady_clock::now();
+
+        // Do gamma correction and averaging
+        const std::vector<uint8_t>& ledDataAvg = pipeline.correct();
+
+        // Detect if blank, for sleep detection
         bool blank = true;
-        for(size_t i = 0; i < ledCount; i++) {
-            // \n is special, as it is used for the end of the message. Replace data in LED colors with the closest brightness that is not \n.
-            if(ledDataAvg[i] == '\n') {
-                ledDataAvg[i] -= 1;
-            }
-            // Check if the LEDs are off, for sleep detection
+        for(size_t i = 0; i < ledDataAvg.size(); i++) {
             if(ledDataAvg[i] != 0) {
                 blank = false;
             }
         }
 
-        // Start counting up if LEDs are off, and enter sleep mode if the count is high enough
+        // Start counting up if LEDs are off, and enter sleep mode if the count is high enough. The frame rate is only changed once the buffer is queued again.
+        const int sleep_after = pipeline.getConfig().sleep_after;
+        bool fallAsleep = false;
+        bool wakeUp = false;
         if(blank) {
             blankCount++;
             if(blankCount >= sleep_after) {
                 blankCount = sleep_after; //prevent overflow
-                sleepNow = true;
+                fallAsleep = !sleepNow;
             }
+            sleepFrameSize = compressed ? frameSize : 0;
         }
         else {
             blankCount = 0;
-            sleepNow = false;
+            wakeUp = sleepNow;
         }
 
-        auto proctime = std::chrono::high_resolution_clock::now();
+        auto proctime = std::chrono::steady_clock::now();
 
-        // Send data to MCU
-        mcu.write(reinterpret_cast<const char*>(ledDataAvg.data()), ledCount);
-        mcu.write('\n');
-        mcu.flush();
+        // Send data to the MCUs
+        pipeline.send();
 
-        auto writetime = std::chrono::high_resolution_clock::now();
+        auto writetime = std::chrono::steady_clock::now();
+
+        // The driver timestamps the frame when its capture finished. Without a monotonic timestamp, count from the dequeue.
+        int64_t capturedUs = 0;
+        if ((buf.get_flags() & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+            const timeval& captured = buf.get_timestamp();
+            capturedUs = static_cast<int64_t>(captured.tv_sec) * 1000000 + captured.tv_usec;
+            frameLatency.add(FlightRecorder::micros(writetime) - capturedUs);
+            frameAgeAverager.add(FlightRecorder::micros(decodePool ? pooled.dequeued : dqtime) - capturedUs);
+        }
+        else {
+            frameLatency.add(std::chrono::duration_cast<std::chrono::microseconds>(writetime - (decodePool ? pooled.dequeued : dqtime)).count());
+        }
+        if (recorder) {
+            const FlightFormat::FrameTimes times{capturedUs, FlightRecorder::micros(decodePool ? pooled.dequeued : dqtime),
+                                                 FlightRecorder::micros(decodePool ? pooled.decoded : decomptime), FlightRecorder::micros(extracttime),
+                                                 FlightRecorder::micros(proctime), FlightRecorder::micros(writetime), buf.get_sequence()};
+            recorder->frame(times, ledDataAvg.data(), ledDataAvg.size(), pipeline.getConfig().horizontal_leds, pipeline.getConfig().vertical_leds);
+        }
 
         // Queue buffer
+        if (decodePool) {
+            decodePool->release();
+        }
         int retry_count = 0;
+        bool lost = false;
         while(true) {
             try {
                 v4l2Capture.queueBuffer(buf);
@@ -225,15 +394,75 @@ void V4L2Mode::start(std::map<std::string, std::string> config) {
                 std::cout << "Error queuing buffer: " << e.what() << ", retrying..." << std::endl;
             }
             retry_count++;
+            if (recorder) {
+                recorder->event(retry_count > 10 ? FlightFormat::Event::QueueFailed : FlightFormat::Event::QueueRetry, retry_count);
+            }
             if(retry_count > 10) {
-                throw std::runtime_error("Failed to queue buffer after 10 retries");
+                lost = true;
+                break;
+            }
+        }
+        if (lost) {
+            recoverCapture("failed to queue buffer after 10 retries");
+            continue;
+        }
+
+        // The frame rate can only change while the pool holds no buffers. The frames still decoding are outdated by then.
+        if (decodePool && (fallAsleep || wakeUp)) {
+            try {
+                decodePool->finish(stale);
+                for (const DecodePool::Stale& frame : stale) {
+                    v4l2Capture.queueBuffer(*frame.buffer);
+                }
+                stale.clear();
+            }
+            catch (const std::runtime_error& e) {
+                recoverCapture(e.what());
+                continue;
+            }
+        }
+        if (fallAsleep) {
+            const int sleep_fps = pipeline.getConfig().sleep_fps;
+            double fps = 0;
+            try {
+                fps = v4l2Capture.setFPS(sleep_fps);
+            }
+            catch (const std::runtime_error& e) {
+                std::cout << std::endl << e.what() << std::endl;
+            }
+            // Drivers pick the closest interval they support, which may still be far too fast
+            hardwareSleep = fps > 0 && fps <= sleep_fps * 1.5;
+            std::cout << std::endl << "Input is blank, sleeping at " << sleep_fps << "fps" << (hardwareSleep ? "" : " (the device can't go that slow, waiting between frames)") << std::endl;
+            sleepNow = true;
+            probeSkips = 0;
+            if (recorder) {
+                recorder->event(FlightFormat::Event::Sleep, sleep_fps);
+            }
+        }
+        if (wakeUp) {
+            // Back to full speed right away, and don't process the frames that piled up while slow
+            int dropped = 0;
+            try {
+                v4l2Capture.restoreFPS();
+                dropped = v4l2Capture.drain();
+            }
+            catch (const std::runtime_error& e) {
+                recoverCapture(e.what());
+                continue;
+            }
+            std::cout << std::endl << "Input is back, capturing at " << v4l2Capture.getMode().fps() << "fps, dropped " << dropped << " stale frames" << std::endl;
+            sleepNow = false;
+            hardwareSleep = false;
+            if (recorder) {
+                recorder->event(FlightFormat::Event::Wake, dropped);
             }
         }
 
         // Timing info output
-        auto stop = std::chrono::high_resolution_clock::now();
+        auto stop = std::chrono::steady_clock::now();
         auto dqduration = std::chrono::duration_cast<std::chrono::microseconds>(dqtime - start);
-        auto decompduration = std::chrono::duration_cast<std::chrono::microseconds>(decomptime - dqtime);
+        // With the decode pool, the decoding itself happened on another thread while this one waited
+        auto decompduration = std::chrono::duration_cast<std::chrono::microseconds>(decodePool ? pooled.decoded - pooled.dequeued : decomptime - dqtime);
         auto extractduration = std::chrono::duration_cast<std::chrono::microseconds>(extracttime - decomptime);
         auto procduration = std::chrono::duration_cast<std::chrono::microseconds>(proctime - extracttime);
         auto writeduration = std::chrono::duration_cast<std::chrono::microseconds>(writetime - proctime);
@@ -246,7 +475,22 @@ void V4L2Mode::start(std::map<std::string, std::string> config) {
         writetimeAverager.add(writeduration.count());
         queuedurationAverager.add(queueduration.count());
         totaldurationAverager.add(totalduration.count());
-        std::cout << "\r\033[Kdq: " << dqtimeAverager.getAverage() << "us \t| decomp: " << decomptimeAverager.getAverage() << "us\t | extract: " << extracttimeAverager.getAverage() << "us\t | proc: " << proctimeAverager.getAverage() << "us\t | write: " << writetimeAverager.getAverage() << "us\t | queue: " << queuedurationAverager.getAverage() << "us\t | total: " << totaldurationAverager.getAverage() << "us / " << 1000000 / totaldurationAverager.getAverage() << "fps";
+        std::cout << "\r\033[Kdq: " << dqtimeAverager.getAverage() << "us \t| decomp: " << decomptimeAverager.getAverage() << "us\t | extract: " << extracttimeAverager.getAverage() << "us\t | proc: " << proctimeAverager.getAverage() << "us\t | write: " << writetimeAverager.getAverage() << "us\t | queue: " << queuedurationAverager.getAverage() << "us\t | total: " << totaldurationAverager.getAverage() << "us / " << 1000000 / totaldurationAverager.getAverage() << "fps"
+                  << "\t | latency p50 " << frameLatency.percentile(0.5) << "us p99 " << frameLatency.percentile(0.99) << "us"
+                  << "\t | age " << frameAgeAverager.getAverage() << "us";
+        if (pipeline.getConfig().capture_latest) {
+            std::cout << " skipped " << latestSkipped;
+        }
+        if (decodePool) {
+            std::cout << "\t | decoders " << decodePool->getThreadCount() << ", late " << lateFrames << ", errors " << decodeErrors;
+        }
+        else if (compressed && config.decode_split > 1) {
+            std::cout << "\t | split " << decoder.splitFrames << ", whole " << decoder.wholeFrames;
+        }
+        if (reconnects > 0) {
+            std::cout << "\t | reconnects " << reconnects << " (last " << recoveryMs << "ms)";
+        }
+        std::cout << pipeline.statusLine();
         if(sleepNow) {
             std::cout << "  SLEEPING     ";
         }
@@ -255,11 +499,86 @@ void V4L2Mode::start(std::map<std::string, std::string> config) {
         }
         std::cout.flush();
 
-        // Sleep if needed
-        if(sleepNow) {
-            usleep(1000000); //sleep for 1 second, slowing down to ~1 FPS
+        // Without help from the device, slow down by waiting. The stale frames are drained before the next dequeue.
+        if(sleepNow && !hardwareSleep) {
+            usleep(1000000 / pipeline.getConfig().sleep_fps);
         }
     }
 
     std::cout << "Stopping" << std::endl;
 }
+
+void V4L2Mode::startSources(const Config& config, ConfigWatcher& watcher, const std::vector<CaptureSourceSpec>& specs) {
+    // The LED layout goes around the canvas all sources are placed on
+    const Zone canvas = CaptureSource::canvasOf(specs);
+    LedPipeline pipeline(config, canvas.width, canvas.height);
+    Compositor compositor(specs.size(), static_cast<int64_t>(config.source_timeout) * 1000);
+
+    // Every source captures, decodes and extracts on its own thread
+    const uint32_t format = V4L2Capture::formatFromName(config.capture_format);
+    const CapturePolicy policy{config.capture_width, config.capture_height, config.capture_fps, format, format == 0 && config.zone_mode != "mean"};
+    std::vector<std::unique_ptr<CaptureSource>> sources;
+    for (size_t i = 0; i < specs.size(); i++) {
+        sources.push_back(std::make_unique<CaptureSource>(i, specs[i], policy, config.v4l2_buffer_count, compositor, config.threadSchedule(Config::ThreadRole::Capture)));
+        std::cout << specs[i].device << ": " << sources.back()->getMode().describe() << " at " << specs[i].canvas.x << "," << specs[i].canvas.y << std::endl;
+    }
+    auto assignZones = [&](const Config& current) {
+        const LedLayout layout(current.horizontal_leds, current.vertical_leds, current.border_size);
+        const std::vector<Zone> zones = layout.zones(canvas.x, canvas.y, canvas.width, canvas.height);
+        size_t assigned = 0;
+        for (size_t i = 0; i < sources.size(); i++) {
+            std::vector<size_t> leds = sources[i]->setZones(zones, LedPipeline::zoneModeFromName(current.zone_mode), current.sample_rows, current.sample_cols);
+            sources[i]->setPlanarJpeg(current.jpeg_decode == "yuv");
+            if (V4L2Capture::isRawYuv(sources[i]->getMode().pixelFormat)) {
+                LedPipeline::checkRawYuvZoneMode(current.zone_mode, specs[i].device);
+            }
+            assigned += leds.size();
+            compositor.setLeds(i, std::move(leds));
+        }
+        if (assigned < zones.size()) {
+            std::cout << zones.size() - assigned << " LEDs are outside of every capture source" << std::endl;
+        }
+    };
+    assignZones(config);
+
+    std::unique_ptr<FlightRecorder> recorder = LedPipeline::openRecorder(config);
+    LedPipeline::enterRealtime(config);
+
+    // One LED frame per output tick: whenever a source delivered, or once per frame interval so stale sources still fade out
+    const int64_t tickUs = 1000000 / std::max(config.capture_fps, 1);
+    std::vector<uint8_t> composite(pipeline.ledCount() * 3);
+    uint32_t tick = 0;
+    while (V4L2Run) {
+        if (std::optional<Config> update = watcher.takeUpdate()) {
+            watcher.applied(pipeline.apply(*update));
+            assignZones(pipeline.getConfig());
+            composite.assign(pipeline.ledCount() * 3, 0);
+            if (recorder) {
+                recorder->event(FlightFormat::Event::ConfigApplied);
+            }
+        }
+
+        compositor.wait(tickUs);
+        const auto start = std::chrono::steady_clock::now();
+        compositor.compose(FlightRecorder::micros(start), composite.data(), composite.size());
+        pipeline.setColors(composite.data());
+        const std::vector<uint8_t>& ledDataAvg = pipeline.correct();
+        const auto corrected = std::chrono::steady_clock::now();
+        pipeline.send();
+        const auto sent = std::chrono::steady_clock::now();
+        if (recorder) {
+            const FlightFormat::FrameTimes times{0, FlightRecorder::micros(start), 0, FlightRecorder::micros(start), FlightRecorder::micros(corrected), FlightRecorder::micros(sent), tick};
+            recorder->frame(times, ledDataAvg.data(), ledDataAvg.size(), pipeline.getConfig().horizontal_leds, pipeline.getConfig().vertical_leds);
+        }
+        tick++;
+
+        std::cout << "\r\033[K";
+        const int64_t nowUs = FlightRecorder::micros(sent);
+        for (size_t i = 0; i < sources.size(); i++) {
+            std::cout << sources[i]->statusLine() << (compositor.isStale(i, nowUs) ? " (stale)" : "");
+        }
+        std::cout << pipeline.statusLine();
+        std::cout.flush();
+    }
+    std::cout << std::endl << "Stopping" << std::endl;
+}
@@ -1,14 +1,17 @@
 #pragma once
 #include <string>
 #include <cstdint>
-#include <map>
+#include "Config.h"
+#include "ConfigWatcher.h"
+#include "CaptureSource.h"
 
 class V4L2Mode {
     static bool V4L2Run;
-    static uint8_t gammaCorrection(uint8_t inputBrightness, double gamma);
+    // Several capture devices, each on its own thread, composited into one LED frame
+    static void startSources(const Config& config, ConfigWatcher& watcher, const std::vector<CaptureSourceSpec>& specs);
 public:
     static void V4L2Sighandler(int signum);
-    static void start(std::map<std::string, std::string> config);
+    static void start(const Config& config, ConfigWatcher& watcher);
 };
 
 
@@ -0,0 +1,115 @@
+#include <stdexcept>
+#include "ColorOfBlock.hpp"
+#include "ZoneExtractor.h"
+
+template <typename PixelLayout>
+static void extractPacked(const Frame& frame, const Zone* first, const Zone* last, int bytesPerPixel, ZoneMode mode, int rowStride, int colStride, HistogramBin* bins, uint8_t* ledData) {
+    const int imgwidth = frame.stride / bytesPerPixel;
+    for (const Zone* zone = first; zone != last; zone++) {
+        HistogramBin* zoneBins = bins != nullptr ? bins + (zone - first) * histogramBins : nullptr;
+        std::tuple<uint8_t, uint8_t, uint8_t> color;
+        switch (mode) {
+            case ZoneMode::Dominant:
+                color = colorOfBlockDominant<BestSIMD, PixelLayout>(frame.data, imgwidth, zone->x, zone->y, zone->width, zone->height, zoneBins);
+                break;
+            case ZoneMode::Saturation:
+                color = colorOfBlockSaturation<BestSIMD, PixelLayout>(frame.data, imgwidth, zone->x, zone->y, zone->width, zone->height);
+                break;
+            case ZoneMode::Trimmed:
+                color = colorOfBlockTrimmed<BestSIMD, PixelLayout>(frame.data, imgwidth, zone->x, zone->y, zone->width, zone->height, zoneBins);
+                break;
+            default:
+                color = colorOfBlock<BestSIMD, PixelLayout>(frame.data, imgwidth, frame.height, zone->x, zone->y, zone->width, zone->height, rowStride, colStride);
+                break;
+        }
+        *ledData++ = std::get<0>(color);
+        *ledData++ = std::get<1>(color);
+        *ledData++ = std::get<2>(color);
+    }
+}
+
+static void extractNV12(const Frame& frame, const Zone* first, const Zone* last, int rowStride, int colStride, uint8_t* ledData) {
+    for (const Zone* zone = first; zone != last; zone++) {
+        auto color = colorOfBlockNV12<BestSIMD>(frame.data, frame.stride, frame.chroma, frame.chromaStride, zone->x, zone->y, zone->width, zone->height, rowStride, colStride);
+        *ledData++ = std::get<0>(color);
+        *ledData++ = std::get<1>(color);
+        *ledData++ = std::get<2>(color);
+    }
+}
+
+static void extractYUYV(const Frame& frame, const Zone* first, const Zone* last, int rowStride, int colStride, uint8_t* ledData) {
+    for (const Zone* zone = first; zone != last; zone++) {
+        auto color = colorOfBlockYUYV<BestSIMD>(frame.data, frame.stride, zone->x, zone->y, zone->width, zone->height, rowStride, colStride);
+        *ledData++ = std::get<0>(color);
+        *ledData++ = std::get<1>(color);
+        *ledData++ = std::get<2>(color);
+    }
+}
+
+static void extractYCbCr(const Frame& frame, const Zone* first, const Zone* last, int rowStride, int colStride, uint8_t* ledData) {
+    for (const Zone* zone = first; zone != last; zone++) {
+        auto color = colorOfBlockYCbCr<BestSIMD>(frame.data, frame.stride, frame.chroma, frame.chromaCr, frame.chromaStride, frame.chromaScaleX, frame.chromaScaleY,
+                                                 zone->x, zone->y, zone->width, zone->height, rowStride, colStride);
+        *ledData++ = std::get<0>(color);
+        *ledData++ = std::get<1>(color);
+        *ledData++ = std::get<2>(color);
+    }
+}
+
+ZoneExtractor::ZoneExtractor(std::vector<Zone> zones, ZoneMode mode) : zones(std::move(zones)), mode(ZoneMode::Mean) {
+    setMode(mode);
+}
+
+void ZoneExtractor::setZones(std::vector<Zone> newZones) {
+    zones = std::move(newZones);
+    if (mode == ZoneMode::Dominant || mode == ZoneMode::Trimmed) {
+        histograms.resize(zones.size() * histogramBins);
+    }
+}
+
+void ZoneExtractor::setMode(ZoneMode newMode) {
+    mode = newMode;
+    if (mode == ZoneMode::Dominant || mode == ZoneMode::Trimmed) {
+        histograms.resize(zones.size() * histogramBins);
+    } else {
+        histograms = std::vector<HistogramBin>();
+    }
+}
+
+void ZoneExtractor::setSampling(int newRowStride, int newColStride) {
+    if (newRowStride < 1 || newColStride < 1) {
+        throw std::invalid_argument("Sampling strides must be at least 1");
+    }
+    rowStride = newRowStride;
+    colStride = newColStride;
+}
+
+void ZoneExtractor::extract(const Frame& frame, uint8_t* ledData) const {
+    extract(frame, ledData, 0, zones.size());
+}
+
+void ZoneExtractor::extract(const Frame& frame, uint8_t* ledData, size_t first, size_t last) const {
+    const Zone* firstZone = zones.data() + first;
+    const Zone* lastZone = zones.data() + last;
+    HistogramBin* bins = histograms.empty() ? nullptr : histograms.data() + first * histogramBins;
+    ledData += first * 3;
+    switch (frame.format) {
+        case PixelFormat::RGB24:
+            extractPacked<RGB24>(frame, firstZone, lastZone, 3, mode, rowStride, colStride, bins, ledData);
+            break;
+        case PixelFormat::BGRX32:
+            extractPacked<BGRX32>(frame, firstZone, lastZone, 4, mode, rowStride, colStride, bins, ledData);
+            break;
+        case PixelFormat::NV12:
+            extractNV12(frame, firstZone, lastZone, rowStride, colStride, ledData);
+            break;
+        case PixelFormat::YUYV:
+            extractYUYV(frame, firstZone, lastZone, rowStride, colStride, ledData);
+            break;
+        case PixelFormat::YCbCrPlanar:
+            extractYCbCr(frame, firstZone, lastZone, rowStride, colStride, ledData);
+            break;
+        default:
+            throw std::invalid_argument("Unsupported pixel format");
+    }
+}
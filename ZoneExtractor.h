@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "Frame.h"
+#include "LedLayout.h"
+#include "ColorOfBlock.hpp"
+
+// How the pixels of a zone are reduced to one color
+enum class ZoneMode {
+    Mean,       // Plain average
+    Dominant,   // Most common color, from a quantized histogram
+    Saturation, // Average weighted by saturation, so colored details win over gray backgrounds
+    Trimmed,    // Average without the darkest and brightest 10%
+};
+
+// Calculates the color of every zone of a frame, using the best SIMD kernel available for its pixel format.
+// The histogram modes need packed RGB pixels, YUV formats always use the mean.
+// Sampling strides apply to the mean, of packed RGB pixels and of every YUV format; the other modes read every pixel.
+class ZoneExtractor {
+    std::vector<Zone> zones;
+    ZoneMode mode;
+    int rowStride = 1;
+    int colStride = 1;
+    // Histogram arena, histogramBins bins per zone. Every zone has its own, so concurrent extraction of disjoint zone ranges doesn't need any locking.
+    mutable std::vector<HistogramBin> histograms;
+public:
+    explicit ZoneExtractor(std::vector<Zone> zones, ZoneMode mode = ZoneMode::Mean);
+
+    void setZones(std::vector<Zone> newZones);
+    void setMode(ZoneMode newMode);
+    ZoneMode getMode() const { return mode; }
+    // Read only every rowStride-th row and every colStride-th pair of pixels of a zone, or colStride-th sample of a YUV plane
+    void setSampling(int newRowStride, int newColStride);
+    const std::vector<Zone>& getZones() const { return zones; }
+    // Whether YUV frames give the same result as RGB ones. Only the mean can be taken on YUV, the other modes need RGB pixels.
+    bool acceptsYUV() const { return mode == ZoneMode::Mean; }
+
+    // Writes R,G,B of every zone into ledData, in zone order
+    void extract(const Frame& frame, uint8_t* ledData) const;
+    // Same, for zones [first, last) only. ledData still points at the data of the first zone in the list, so disjoint ranges can be extracted concurrently.
+    void extract(const Frame& frame, uint8_t* ledData, size_t first, size_t last) const;
+};
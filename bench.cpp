@@ -0,0 +1,178 @@
+#include <iostream>
+#include <cstdlib>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include "AlignedBuffer.h"
+#include "ExtractionPool.h"
+
+// Synthetic benchmarks of the extraction pipeline, independent of any capture device.
+// Usage: ambilight_bench [width] [height] [border_size] [max_threads]
+
+static AlignedBuffer randomImage(size_t size) {
+    AlignedBuffer image(size + 16);
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < image.size(); i++) {
+        image.get()[i] = static_cast<uint8_t>(rng());
+    }
+    return image;
+}
+
+// Average time of one call of fn in microseconds
+template <typename Function>
+static double timeIt(Function fn, int iterations = 200) {
+    fn(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(stop - start).count() / iterations;
+}
+
+static void benchThreadScaling(const Frame& frame, const ZoneExtractor& zoneExtractor, int maxThreads) {
+    std::vector<uint8_t> ledData(zoneExtractor.getZones().size() * 3);
+    std::cout << "Extraction thread scaling" << std::endl;
+    double single = 0;
+    for (int threads = 1; threads <= maxThreads; threads++) {
+        ExtractionPool pool(threads);
+        double us = timeIt([&] { pool.extract(zoneExtractor, frame, ledData.data()); });
+        if (threads == 1) single = us;
+        std::cout << "  " << threads << " threads: " << std::fixed << std::setprecision(1) << us << "us, speedup " << std::setprecision(2) << single / us << "x" << std::endl;
+    }
+}
+
+// Time per frame of every zone mode, for both packed pixel layouts
+static void benchZoneModes(const LedLayout& layout, int width, int height) {
+    const std::pair<const char*, ZoneMode> modes[] = {
+        {"mean", ZoneMode::Mean}, {"dominant", ZoneMode::Dominant}, {"saturation", ZoneMode::Saturation}, {"trimmed", ZoneMode::Trimmed},
+    };
+    std::cout << "Zone modes (1 thread)" << std::endl;
+    for (PixelFormat format : {PixelFormat::RGB24, PixelFormat::BGRX32}) {
+        const int bytesPerPixel = format == PixelFormat::RGB24 ? 3 : 4;
+        AlignedBuffer image = randomImage(static_cast<size_t>(width) * height * bytesPerPixel);
+        const Frame frame{format, image.get(), width, height, width * bytesPerPixel};
+        std::vector<uint8_t> ledData(layout.ledCount() * 3);
+        double mean = 0;
+        for (const auto& [name, mode] : modes) {
+            const ZoneExtractor zoneExtractor(layout.zones(0, 0, width, height), mode);
+            double us = timeIt([&] { zoneExtractor.extract(frame, ledData.data()); });
+            if (mode == ZoneMode::Mean) mean = us;
+            std::cout << "  " << (format == PixelFormat::RGB24 ? "rgb24 " : "bgrx32 ") << name << ": " << std::fixed << std::setprecision(1) << us << "us, "
+                      << std::setprecision(2) << us / mean << "x mean" << std::endl;
+        }
+    }
+}
+
+// Image with smooth color gradients plus a little noise, closer to video than randomImage()
+static AlignedBuffer gradientImage(int width, int height) {
+    AlignedBuffer image(static_cast<size_t>(width) * height * 3 + 16); // Padding for the SIMD loads, like randomImage()
+    std::mt19937 rng(7);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* pixel = image.get() + (static_cast<size_t>(y) * width + x) * 3;
+            pixel[0] = static_cast<uint8_t>(x * 239 / width + rng() % 16);
+            pixel[1] = static_cast<uint8_t>(y * 239 / height + rng() % 16);
+            pixel[2] = static_cast<uint8_t>((x + y) * 127 / (width + height) + rng() % 16);
+        }
+    }
+    return image;
+}
+
+// Time and color error of sampling strides, compared to reading every pixel
+static void benchSampling(const LedLayout& layout, int width, int height) {
+    std::cout << "Sampling strides (rows x pairs, 1 thread, error against full sampling)" << std::endl;
+    const std::pair<const char*, AlignedBuffer> images[] = {
+        {"random", randomImage(static_cast<size_t>(width) * height * 3)}, {"gradient", gradientImage(width, height)},
+    };
+    for (const auto& [name, image] : images) {
+        const Frame frame{PixelFormat::RGB24, image.get(), width, height, width * 3};
+        ZoneExtractor zoneExtractor(layout.zones(0, 0, width, height));
+        std::vector<uint8_t> full(layout.ledCount() * 3);
+        std::vector<uint8_t> sampled(layout.ledCount() * 3);
+        zoneExtractor.extract(frame, full.data());
+        const double fullUs = timeIt([&] { zoneExtractor.extract(frame, full.data()); });
+        for (int stride = 1; stride <= 4; stride++) {
+            zoneExtractor.setSampling(stride, stride);
+            const double us = timeIt([&] { zoneExtractor.extract(frame, sampled.data()); });
+            int maxError = 0;
+            double sumError = 0;
+            for (size_t i = 0; i < full.size(); i++) {
+                int error = std::abs(full[i] - sampled[i]);
+                maxError = std::max(maxError, error);
+                sumError += error;
+            }
+            std::cout << "  " << name << " " << stride << "x" << stride << ": " << std::fixed << std::setprecision(1) << us << "us ("
+                      << std::setprecision(2) << fullUs / us << "x faster), max error " << maxError << ", mean error " << sumError / full.size() << std::endl;
+        }
+    }
+}
+
+// Mean of RGB24 against the YCbCr planes a JPEG decodes to (4:2:0 and 4:2:2), with the color error of converting once per zone
+static void benchPlanar(const LedLayout& layout, int width, int height) {
+    std::cout << "Planar YCbCr (1 thread, error against rgb24)" << std::endl;
+    AlignedBuffer image = gradientImage(width, height);
+    const Frame rgbFrame{PixelFormat::RGB24, image.get(), width, height, width * 3};
+    ZoneExtractor zoneExtractor(layout.zones(0, 0, width, height));
+    std::vector<uint8_t> rgb(layout.ledCount() * 3);
+    std::vector<uint8_t> planar(layout.ledCount() * 3);
+    const double rgbUs = timeIt([&] { zoneExtractor.extract(rgbFrame, rgb.data()); });
+    std::cout << "  rgb24: " << std::fixed << std::setprecision(1) << rgbUs << "us" << std::endl;
+
+    for (const auto& [name, scaleY] : {std::pair<const char*, int>{"4:2:0", 2}, {"4:2:2", 1}}) {
+        // Full range BT.601, chroma averaged over each 2x2 or 2x1 block like a JPEG encoder does
+        const int chromaWidth = (width + 1) / 2, chromaHeight = (height + scaleY - 1) / scaleY;
+        AlignedBuffer luma(static_cast<size_t>(width) * height);
+        AlignedBuffer cb(static_cast<size_t>(chromaWidth) * chromaHeight);
+        AlignedBuffer cr(static_cast<size_t>(chromaWidth) * chromaHeight);
+        std::vector<double> cbSum(cb.size()), crSum(cr.size()), count(cb.size());
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const uint8_t* pixel = image.get() + (static_cast<size_t>(y) * width + x) * 3;
+                const double r = pixel[0], g = pixel[1], b = pixel[2];
+                luma.get()[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(std::clamp(0.299 * r + 0.587 * g + 0.114 * b + 0.5, 0.0, 255.0));
+                const size_t c = static_cast<size_t>(y / scaleY) * chromaWidth + x / 2;
+                cbSum[c] += 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+                crSum[c] += 128 + 0.5 * r - 0.418688 * g - 0.081312 * b;
+                count[c]++;
+            }
+        }
+        for (size_t c = 0; c < cb.size(); c++) {
+            cb.get()[c] = static_cast<uint8_t>(std::clamp(cbSum[c] / count[c] + 0.5, 0.0, 255.0));
+            cr.get()[c] = static_cast<uint8_t>(std::clamp(crSum[c] / count[c] + 0.5, 0.0, 255.0));
+        }
+        Frame frame{PixelFormat::YCbCrPlanar, luma.get(), width, height, width, cb.get(), chromaWidth};
+        frame.chromaCr = cr.get();
+        frame.chromaScaleX = 2;
+        frame.chromaScaleY = scaleY;
+
+        const double us = timeIt([&] { zoneExtractor.extract(frame, planar.data()); });
+        int maxError = 0;
+        for (size_t i = 0; i < rgb.size(); i++) {
+            maxError = std::max(maxError, std::abs(rgb[i] - planar[i]));
+        }
+        std::cout << "  " << name << ": " << std::fixed << std::setprecision(1) << us << "us (" << std::setprecision(2) << rgbUs / us
+                  << "x faster), max error " << maxError << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int width = argc > 1 ? std::stoi(argv[1]) : 3840;
+    const int height = argc > 2 ? std::stoi(argv[2]) : 2160;
+    const int border_size = argc > 3 ? std::stoi(argv[3]) : 200;
+    const int maxThreads = argc > 4 ? std::stoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << width << "x" << height << ", border_size " << border_size << std::endl;
+    AlignedBuffer image = randomImage(static_cast<size_t>(width) * height * 3);
+    const Frame frame{PixelFormat::RGB24, image.get(), width, height, width * 3};
+    const LedLayout layout(41, 23, border_size);
+    const ZoneExtractor zoneExtractor(layout.zones(0, 0, width, height));
+
+    benchThreadScaling(frame, zoneExtractor, maxThreads);
+    benchZoneModes(layout, width, height);
+    benchSampling(layout, width, height);
+    benchPlanar(layout, width, height);
+}
@@ -1,12 +1,19 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
 #include <cstring>
 #include <csignal>
-#include <complex>
+#include <vector>
 #include "simpleConfigParser.h"
+#include "LedLayout.h"
+#include "ZoneExtractor.h"
+#include "ColorCorrection.h"
+#include "LedFraming.h"
 #include <arpa/inet.h>
 
 bool run = true;
@@ -16,51 +23,49 @@ void signalHandler(int signum) {
     run = false;
 }
 
-uint8_t gammaCorrection(uint8_t inputBrightness, double gamma) {
-    double adjustedBrightness = 255 * std::pow((inputBrightness / 255.0), gamma);
-    adjustedBrightness = std::max(0.0, std::min(adjustedBrightness, 255.0));
-    return static_cast<uint8_t>(adjustedBrightness);
-}
-
-uint8_t* colorOfBlock(const uint8_t* img, int imgwidth, int imgheight, int x, int y, int width, int height) {
-    uint32_t* color = new uint32_t[3];
-    color[0] = 0;
-    color[1] = 0;
-    color[2] = 0;
-
-    for (int xpos = x; xpos < x + width; xpos++) {
-        for (int ypos = y; ypos < y + height; ypos++) {
-            for (int i = 0; i < 3; i++) {
-                int index = (ypos * imgwidth + xpos) * 3 + i;
-                color[i] += img[index];
-            }
-        }
+// One edge of the screen, captured into a persistent MIT-SHM segment
+struct BorderStrip {
+    Edge edge;
+    int x, y, width, height; // Position and size on the screen
+    XImage* image = nullptr;
+    XShmSegmentInfo shminfo{};
+    ZoneExtractor zoneExtractor{{}}; // Zones of this edge, relative to the strip
+};
+
+void createStrip(Display* display, BorderStrip& strip) {
+    int screen = DefaultScreen(display);
+    strip.image = XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen), ZPixmap, nullptr, &strip.shminfo, strip.width, strip.height);
+    if (!strip.image) {
+        fprintf(stderr, "Failed to create shared memory image\n");
+        exit(1);
+    }
+    // Only the native 32-bit little endian BGRX layout is supported, so no per-pixel conversion is needed
+    if (strip.image->bits_per_pixel != 32 || strip.image->red_mask != 0xff0000 || strip.image->green_mask != 0xff00 || strip.image->blue_mask != 0xff) {
+        fprintf(stderr, "Unsupported X visual, 32-bit BGRX is required\n");
+        exit(1);
     }
 
-    uint8_t* color_byte = new uint8_t[3];
-
-    for (int i = 0; i < 3; i++) {
-        color_byte[i] = color[i] / (width * height);
+    strip.shminfo.shmid = shmget(IPC_PRIVATE, strip.image->bytes_per_line * strip.image->height, IPC_CREAT | 0600);
+    if (strip.shminfo.shmid == -1) {
+        perror("shmget failed");
+        exit(1);
+    }
+    strip.shminfo.shmaddr = strip.image->data = static_cast<char*>(shmat(strip.shminfo.shmid, nullptr, 0));
+    strip.shminfo.readOnly = False;
+    if (!XShmAttach(display, &strip.shminfo)) {
+        fprintf(stderr, "XShmAttach failed\n");
+        exit(1);
     }
+    XSync(display, False);
 
-    delete[] color;
-    return color_byte;
+    // Mark the segment for removal now, so it's freed even if the process is killed. It stays valid until both sides detach.
+    shmctl(strip.shminfo.shmid, IPC_RMID, nullptr);
 }
 
-void xImageToRGBArray(XImage *xImage, unsigned char *rgbArray) {
-    for (int y = 0; y < xImage->height; y++) {
-        for (int x = 0; x < xImage->width; x++) {
-            unsigned long pixel = XGetPixel(xImage, x, y);
-            unsigned char red = (pixel & xImage->red_mask) >> 16;
-            unsigned char green = (pixel & xImage->green_mask) >> 8;
-            unsigned char blue = pixel & xImage->blue_mask;
-
-            int index = (y * xImage->width + x) * 3;
-            rgbArray[index] = red;
-            rgbArray[index + 1] = green;
-            rgbArray[index + 2] = blue;
-        }
-    }
+void destroyStrip(Display* display, BorderStrip& strip) {
+    XShmDetach(display, &strip.shminfo);
+    XDestroyImage(strip.image);
+    shmdt(strip.shminfo.shmaddr);
 }
 
 int main(int argc, char **argv) {
@@ -105,92 +110,67 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
+    if (!XShmQueryExtension(display)) {
+        fprintf(stderr, "X server does not support the MIT-SHM extension\n");
+        exit(1);
+    }
+
     Window root = DefaultRootWindow(display);
     XWindowAttributes windowAttributes;
     XGetWindowAttributes(display, root, &windowAttributes);
     int width = windowAttributes.width;
     int height = windowAttributes.height;
     std::cout << "width: " << width << " height: " << height << std::endl;
-    float column_block_height = (float)height / (float)vertical_leds;
-    float row_block_width = (float)width / (float)horizontal_leds;
 
-    uint8_t* leddata = new uint8_t[(horizontal_leds + vertical_leds) * 2 * 3 + 1];
-
-    while(true) {
-        XImage *image = XGetImage(display, root, 0, 0, width, height, AllPlanes, ZPixmap);
+    const LedLayout layout(horizontal_leds, vertical_leds, border_size);
+    const ColorCorrection colorCorrection(gamma_correction);
+
+    // Only the four edges of the screen are captured, everything else would be thrown away anyway
+    BorderStrip right{Edge::Right, width - border_size, 0, border_size, height};
+    BorderStrip top{Edge::Top, 0, 0, width, border_size};
+    BorderStrip left{Edge::Left, 0, 0, border_size, height};
+    BorderStrip bottom{Edge::Bottom, 0, height - border_size, width, border_size};
+    BorderStrip* strips[] = {&right, &top, &left, &bottom};
+    for (BorderStrip* strip : strips) {
+        createStrip(display, *strip);
+        std::vector<Zone> zones = layout.edgeZones(strip->edge, -strip->x, -strip->y, width, height);
+        strip->zoneExtractor.setZones(std::move(zones));
+    }
 
+    const size_t ledDataSize = layout.ledCount() * 3;
+    std::vector<uint8_t> leddata(ledDataSize + 1);
 
-        if (!image) {
-            fprintf(stderr, "Failed to get image from X server\n");
-            exit(1);
+    while(run) {
+        for (BorderStrip* strip : strips) {
+            if (!XShmGetImage(display, root, strip->image, strip->x, strip->y, AllPlanes)) {
+                fprintf(stderr, "Failed to get image from X server\n");
+                exit(1);
+            }
         }
 
-        unsigned char* rgbArray = new unsigned char[width * height * 3];
-        xImageToRGBArray(image, rgbArray);
-
         //"extract" the colors of the LEDs from the image
-        ssize_t leddata_index = 0;
-        //right column, bottom to top
-        for(int i = vertical_leds - 1; i >= 0; i--) {
-            int block_top = i * column_block_height;
-            int block_left = width - border_size;
-            uint8_t* color = colorOfBlock(rgbArray, width, height, block_left, block_top, border_size, (int)column_block_height);
-            leddata[leddata_index++] = color[0];
-            leddata[leddata_index++] = color[1];
-            leddata[leddata_index++] = color[2];
-            delete[] color;
-        }
-        //top row, right to left
-        for(int i = horizontal_leds - 1; i >= 0; i--) {
-            int block_top = 0;
-            int block_left = i * row_block_width;
-            uint8_t* color = colorOfBlock(rgbArray, width, height, block_left, block_top, (int)row_block_width, border_size);
-            leddata[leddata_index++] = color[0];
-            leddata[leddata_index++] = color[1];
-            leddata[leddata_index++] = color[2];
-            delete[] color;
-        }
-        //left column, top to bottom
-        for(int i = 0; i < vertical_leds; i++) {
-            int block_top = i * column_block_height;
-            int block_left = 0;
-            uint8_t* color = colorOfBlock(rgbArray, width, height, block_left, block_top, border_size, (int)column_block_height);
-            leddata[leddata_index++] = color[0];
-            leddata[leddata_index++] = color[1];
-            leddata[leddata_index++] = color[2];
-            delete[] color;
-        }
-        //bottom row, left to right
-        for(int i = 0; i < horizontal_leds; i++) {
-            int block_top = height - border_size;
-            int block_left = i * row_block_width;
-            uint8_t* color = colorOfBlock(rgbArray, width, height, block_left, block_top, (int)row_block_width, border_size);
-            leddata[leddata_index++] = color[0];
-            leddata[leddata_index++] = color[1];
-            leddata[leddata_index++] = color[2];
-            delete[] color;
+        for (BorderStrip* strip : strips) {
+            Frame frame{PixelFormat::BGRX32, reinterpret_cast<const uint8_t*>(strip->image->data), strip->width, strip->height, strip->image->bytes_per_line};
+            strip->zoneExtractor.extract(frame, &leddata[layout.edgeOffset(strip->edge) * 3]);
         }
 
         // \n is special, as it is used for the end of the message. Replace data in LED colors with the closest brightness that is not \n. Also perform gamma correction.
-        for(int i = 0; i < (horizontal_leds + vertical_leds) * 2 * 3; i++) {
-            leddata[i] = gammaCorrection(leddata[i], gamma_correction);
-            if(leddata[i] == '\n') {
-                leddata[i] -= 1;
-            }
-        }
+        colorCorrection.apply(leddata.data(), ledDataSize);
+        LedFraming::escape(leddata.data(), ledDataSize);
 
-        leddata[(horizontal_leds + vertical_leds) * 2 * 3] = '\n';
+        leddata[ledDataSize] = LedFraming::delimiter;
 
         //send data to server
-        if (send(client_socket, leddata, (horizontal_leds + vertical_leds) * 2 * 3 + 1, 0) == -1) {
+        if (send(client_socket, leddata.data(), leddata.size(), 0) == -1) {
             std::cout << "Failed to send data to server" << std::endl;
         }
-
-        XDestroyImage(image);
     }
 
-
+    for (BorderStrip* strip : strips) {
+        destroyStrip(display, *strip);
+    }
     XCloseDisplay(display);
+    close(client_socket);
 
     return 0;
 }
@@ -0,0 +1,147 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <ctime>
+#include "FlightRecorder.h"
+
+// Converts a flight recording to CSV on stdout: one line per frame with its stage timestamps, and one per event.
+// Usage: ambilight_dump recording_file [image_dir]
+// With an image_dir, every frame is also written as image_dir/frame_<record>.ppm, showing the LED colors around a rectangle
+// in the order of the strip. Frames stored as deltas can only be drawn from the first complete frame in the recording on.
+
+static constexpr int cellSize = 8; // Pixels per LED in the images
+
+// Draws the LEDs along the edges in strip order: right edge bottom to top, top right to left, left top to bottom, bottom left to right.
+// Without a layout that matches the colors, they are drawn as a single row.
+static void writeImage(const std::string& path, const std::vector<uint8_t>& leds, int horizontalLeds, int verticalLeds) {
+    const size_t ledCount = leds.size() / 3;
+    const bool border = horizontalLeds > 0 && verticalLeds > 0 && static_cast<size_t>(horizontalLeds + verticalLeds) * 2 == ledCount;
+    const int columns = border ? horizontalLeds + 2 : static_cast<int>(ledCount);
+    const int rows = border ? verticalLeds + 2 : 1;
+    std::vector<uint8_t> pixels(static_cast<size_t>(columns) * rows * 3, 0);
+    auto cell = [&](int column, int row, size_t led) {
+        std::memcpy(&pixels[(static_cast<size_t>(row) * columns + column) * 3], &leds[led * 3], 3);
+    };
+    if (border) {
+        size_t led = 0;
+        for (int i = verticalLeds - 1; i >= 0; i--) cell(columns - 1, i + 1, led++);
+        for (int i = horizontalLeds - 1; i >= 0; i--) cell(i + 1, 0, led++);
+        for (int i = 0; i < verticalLeds; i++) cell(0, i + 1, led++);
+        for (int i = 0; i < horizontalLeds; i++) cell(i + 1, rows - 1, led++);
+    }
+    else {
+        for (size_t led = 0; led < ledCount; led++) cell(static_cast<int>(led), 0, led);
+    }
+
+    std::ofstream image(path, std::ios::binary);
+    image << "P6\n" << columns * cellSize << " " << rows * cellSize << "\n255\n";
+    std::vector<uint8_t> line(static_cast<size_t>(columns) * cellSize * 3);
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            for (int x = 0; x < cellSize; x++) {
+                std::memcpy(&line[(static_cast<size_t>(column) * cellSize + x) * 3], &pixels[(static_cast<size_t>(row) * columns + column) * 3], 3);
+            }
+        }
+        for (int y = 0; y < cellSize; y++) {
+            image.write(reinterpret_cast<const char*>(line.data()), static_cast<std::streamsize>(line.size()));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " recording_file [image_dir]" << std::endl;
+        return 1;
+    }
+    const std::string imageDir = argc > 2 ? argv[2] : "";
+
+    std::ifstream file(argv[1], std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    FlightFormat::Header header{};
+    if (data.size() < sizeof(header)) {
+        std::cerr << "Can't read " << argv[1] << std::endl;
+        return 1;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, FlightFormat::magic, sizeof(header.magic)) != 0 || header.version != FlightFormat::version ||
+        data.size() < header.headerSize + header.dataSize) {
+        std::cerr << argv[1] << " is not a flight recording of this version" << std::endl;
+        return 1;
+    }
+    const uint8_t* ring = data.data() + header.headerSize;
+
+    std::cout << "record,type,time_us,sequence,capture_us,dequeue_us,decoded_us,extracted_us,corrected_us,sent_us,latency_us,led_bytes,stored_bytes,event,value" << std::endl;
+    std::vector<uint8_t> leds;
+    bool haveColors = false; // If leds holds a complete frame that deltas can be applied to
+    size_t frames = 0, events = 0, images = 0;
+    int64_t firstUs = 0, lastUs = 0;
+    uint64_t expected = 0;
+    bool first = true;
+    for (uint64_t pos = header.tail; pos < header.head;) {
+        const size_t offset = pos % header.dataSize;
+        if (header.dataSize - offset < sizeof(FlightFormat::Record)) {
+            pos += header.dataSize - offset;
+            continue;
+        }
+        FlightFormat::Record record{};
+        std::memcpy(&record, ring + offset, sizeof(record));
+        // A recording copied while it was written can end in records that were being overwritten
+        if (record.size < sizeof(record) || record.size % 8 != 0 || record.size > header.dataSize - offset || (!first && record.number != expected)) {
+            std::cerr << "Recording is inconsistent at record " << expected << ", stopping there" << std::endl;
+            break;
+        }
+        first = false;
+        expected = record.number + 1;
+        pos += record.size;
+        const uint8_t* body = ring + offset + sizeof(record);
+
+        if (record.type == FlightFormat::RecordType::Frame) {
+            FlightFormat::FrameBody frame{};
+            std::memcpy(&frame, body, sizeof(frame));
+            if (sizeof(record) + sizeof(frame) + frame.payloadSize > record.size) {
+                std::cerr << "Frame record " << record.number << " is truncated" << std::endl;
+                break;
+            }
+            const uint8_t* payload = body + sizeof(frame);
+            if (record.flags & FlightFormat::flagDelta) {
+                haveColors = haveColors && leds.size() == frame.ledBytes && FlightFormat::applyDelta(payload, frame.payloadSize, leds.data(), leds.size());
+            }
+            else {
+                leds.assign(payload, payload + frame.payloadSize);
+                haveColors = frame.payloadSize == frame.ledBytes;
+            }
+
+            const FlightFormat::FrameTimes& t = frame.times;
+            const int64_t latency = t.sentUs - (t.captureUs != 0 ? t.captureUs : t.dequeueUs);
+            std::cout << record.number << ",frame," << t.sentUs << "," << t.sequence << "," << t.captureUs << "," << t.dequeueUs << "," << t.decodedUs << "," << t.extractedUs << ","
+                      << t.correctedUs << "," << t.sentUs << "," << latency << "," << frame.ledBytes << "," << frame.payloadSize << ",," << std::endl;
+            if (!imageDir.empty() && haveColors) {
+                writeImage(imageDir + "/frame_" + std::to_string(record.number) + ".ppm", leds, frame.horizontalLeds, frame.verticalLeds);
+                images++;
+            }
+            firstUs = firstUs == 0 ? t.dequeueUs : firstUs;
+            lastUs = t.sentUs;
+            frames++;
+        }
+        else if (record.type == FlightFormat::RecordType::Event) {
+            FlightFormat::EventBody event{};
+            std::memcpy(&event, body, sizeof(event));
+            std::cout << record.number << ",event," << event.timeUs << ",,,,,,,,,,," << FlightFormat::eventName(event.event) << "," << event.value << std::endl;
+            firstUs = firstUs == 0 ? event.timeUs : firstUs;
+            lastUs = event.timeUs;
+            events++;
+        }
+    }
+
+    const time_t started = static_cast<time_t>((firstUs + header.realtimeOffsetUs) / 1000000);
+    std::cerr << frames << " frames and " << events << " events over " << std::fixed << std::setprecision(1) << static_cast<double>(lastUs - firstUs) / 1e6
+              << "s, starting " << std::put_time(std::localtime(&started), "%Y-%m-%d %H:%M:%S") << ", " << header.records << " records written in total";
+    if (!imageDir.empty()) {
+        std::cerr << ", " << images << " images";
+    }
+    std::cerr << std::endl;
+    return 0;
+}
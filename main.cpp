@@ -2,8 +2,10 @@
 #include <variant>
 #include <optional>
 #include "ConfigParser.h"
+#include "ConfigWatcher.h"
 #include "V4L2Mode.hpp"
 #include "NetworkMode.hpp"
+#include "PipeMode.hpp"
 
 int main(int argc, char** argv) {
     // Check arguments
@@ -13,7 +15,7 @@ int main(int argc, char** argv) {
     }
 
     // Parse config
-    std::map<std::string, std::string> config;
+    Config config;
     try {
         config = ConfigParser::parse(argv[1]);
     }
@@ -22,13 +24,15 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    // Start in the correct mode
-    if (config["mode"] == "v4l2") {
-        V4L2Mode::start(config);
-    } else if (config["mode"] == "network") {
+    // Start in the correct mode. The capture modes pick up config changes while running.
+    if (config.mode == "network") {
         NetworkMode::start(config);
-    } else {
-        std::cout << "Invalid mode: " << config["mode"] << std::endl;
-        return -1;
+        return 0;
+    }
+    ConfigWatcher watcher(argv[1], config);
+    if (config.mode == "v4l2") {
+        V4L2Mode::start(config, watcher);
+    } else if (config.mode == "pipe") {
+        PipeMode::start(config, watcher);
     }
-}
\ No newline at end of file
+}
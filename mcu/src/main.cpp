@@ -1,48 +1,79 @@
-#include <Arduino.h>
-#include <Adafruit_NeoPixel.h>
-
-#define LED_COUNT 128
-#define RECV_BUF_SIZE (LED_COUNT * 2)
-
-Adafruit_NeoPixel pixels(LED_COUNT, 21, NEO_GRB + NEO_KHZ800);
-
-int serPos = 0;
-char receiveBuffer[RECV_BUF_SIZE];
-
-void setup() {
-  pixels.begin();
-  pixels.show();
-  pixels.setBrightness(255);
-
-  //Baud rate is critical - 115200 is just barely fast enough for about 100 LEDs. (115200/8/(100*3+1)) = 47.8 FPS max. 921600 should be able to do 921600/8/(100*3+1) = 382.7 FPS max.
-  Serial.begin(921600);
-}
-
-void lineReceived(uint len) {
-  //Only accept LED_COUNT*3 (R,G,B) bytes, otherwise ignore as input malformed
-  if(len == LED_COUNT * 3) {
-    for(int i = 0; i < 128; i++) {
-      pixels.setPixelColor(i, pixels.Color(receiveBuffer[i*3], receiveBuffer[i*3+1], receiveBuffer[i*3+2]));
-    }
-    pixels.show();
-  }
-}
-
-void loop() {
-  while(Serial.available()) {
-    //Essentially just read into a rolling buffer continously, call lineReceived when we get a newline, and then reset to pos=0
-    char recv = Serial.read();
-    if(recv == '\n') {
-      lineReceived(serPos);
-      serPos = 0;
-    }
-    else {
-      //roll over at the end of the buffer
-      if(serPos >= RECV_BUF_SIZE - 1) {
-        serPos = 0;
-      }
-      receiveBuffer[serPos] = recv;
-      serPos++;
-    }
-  }
-}
+#include <Arduino.h>
+#include <Adafruit_NeoPixel.h>
+
+#define LED_COUNT 128
+#define RECV_BUF_SIZE (LED_COUNT * 3 + 16)
+#define PROTOCOL_VERSION 1
+#define STATS_INTERVAL_MS 1000
+
+Adafruit_NeoPixel pixels(LED_COUNT, 21, NEO_GRB + NEO_KHZ800);
+
+int serPos = 0;
+char receiveBuffer[RECV_BUF_SIZE];
+
+// Frame counters and show() timing, reported to the host
+unsigned long acceptedFrames = 0;
+unsigned long rejectedFrames = 0;
+unsigned long showMicros = 0;
+unsigned long lastStatsMillis = 0;
+bool hostConnected = false; // Only send stats to hosts that did the handshake, older hosts never read them
+
+void showPixels() {
+  unsigned long start = micros();
+  pixels.show();
+  showMicros = micros() - start;
+}
+
+void setup() {
+  pixels.begin();
+  pixels.setBrightness(255);
+  showPixels();
+
+  //Baud rate is critical - 115200 is just barely fast enough for about 100 LEDs. (115200/8/(100*3+1)) = 47.8 FPS max. 921600 should be able to do 921600/8/(100*3+1) = 382.7 FPS max.
+  Serial.begin(921600);
+}
+
+void lineReceived(uint len) {
+  //Capability handshake, the host sizes its frames and caps its frame rate based on the reply
+  if(len == 5 && memcmp(receiveBuffer, "AMBI?", 5) == 0) {
+    hostConnected = true;
+    Serial.printf("AMBI proto=%d leds=%d buf=%d show_us=%lu\n", PROTOCOL_VERSION, LED_COUNT, RECV_BUF_SIZE, showMicros);
+    return;
+  }
+
+  //Only accept LED_COUNT*3 (R,G,B) bytes, otherwise ignore as input malformed
+  if(len == LED_COUNT * 3) {
+    for(int i = 0; i < LED_COUNT; i++) {
+      pixels.setPixelColor(i, pixels.Color(receiveBuffer[i*3], receiveBuffer[i*3+1], receiveBuffer[i*3+2]));
+    }
+    showPixels();
+    acceptedFrames++;
+  }
+  else if(len > 0) { //empty lines are just the host resynchronizing
+    rejectedFrames++;
+  }
+}
+
+void loop() {
+  while(Serial.available()) {
+    //Essentially just read into a rolling buffer continously, call lineReceived when we get a newline, and then reset to pos=0
+    char recv = Serial.read();
+    if(recv == '\n') {
+      lineReceived(serPos);
+      serPos = 0;
+    }
+    else {
+      //roll over at the end of the buffer
+      if(serPos >= RECV_BUF_SIZE - 1) {
+        serPos = 0;
+      }
+      receiveBuffer[serPos] = recv;
+      serPos++;
+    }
+  }
+
+  if(hostConnected && millis() - lastStatsMillis >= STATS_INTERVAL_MS) {
+    lastStatsMillis = millis();
+    Serial.printf("STAT accepted=%lu rejected=%lu show_us=%lu\n", acceptedFrames, rejectedFrames, showMicros);
+  }
+}
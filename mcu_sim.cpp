@@ -0,0 +1,174 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+// Emulates the MCU firmware on a pseudo-terminal, so the serial path can be benchmarked without hardware.
+// Usage: ambilight_mcu_sim [led_count] [baud] [show_us] [log_file]
+// Point serial_port at the printed device path. The receive and frame acceptance logic matches mcu/src/main.cpp.
+
+static bool run = true;
+
+static void signalHandler(int signum __attribute__((unused))) {
+    run = false;
+}
+
+static int64_t monotonicUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+    const int ledCount = argc > 1 ? std::stoi(argv[1]) : 128;
+    const int baudrate = argc > 2 ? std::stoi(argv[2]) : 921600;
+    const int64_t showUs = argc > 3 ? std::stoll(argv[3]) : 30 * ledCount + 50; // WS2812B: 30us per LED plus the latch
+    const std::string logPath = argc > 4 ? argv[4] : "";
+    const size_t receiveBufferSize = ledCount * 3 + 16;
+    const int protocolVersion = 1;
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master == -1 || grantpt(master) == -1 || unlockpt(master) == -1) {
+        perror("Failed to create pseudo-terminal");
+        return 1;
+    }
+    struct termios tty;
+    tcgetattr(master, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(master, TCSANOW, &tty);
+
+    // Keep the slave side open, so the pty doesn't hang up between host connections
+    const char* slaveName = ptsname(master);
+    int slave = open(slaveName, O_RDWR | O_NOCTTY);
+    std::cout << "Simulated MCU on " << slaveName << " (" << ledCount << " LEDs, " << baudrate << " baud, show() " << showUs << "us)" << std::endl;
+
+    FILE* log = nullptr;
+    if (!logPath.empty()) {
+        log = fopen(logPath.c_str(), "w");
+        if (!log) {
+            perror("Failed to open log file");
+            return 1;
+        }
+        fprintf(log, "frame,first_byte_us,received_us,shown_us,latency_us\n");
+    }
+
+    std::vector<char> receiveBuffer(receiveBufferSize);
+    size_t serPos = 0;
+    uint64_t acceptedFrames = 0, rejectedFrames = 0, truncatedFrames = 0;
+    bool hostConnected = false;
+
+    int64_t lineStartUs = 0;   // Arrival of the first byte of the current line
+    int64_t linkFreeUs = 0;    // When the simulated UART has finished delivering the bytes received so far
+    int64_t lastStatsUs = monotonicUs();
+    uint64_t statsAccepted = 0;
+    int64_t statsLatencySum = 0;
+
+    char chunk[256];
+    while (run) {
+        // Don't take more bytes off the pty than the simulated wire has delivered, so the host sees the simulated rate as back pressure
+        if (linkFreeUs > monotonicUs()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(linkFreeUs - monotonicUs()));
+        }
+
+        struct pollfd pfd{master, POLLIN, 0};
+        int ready = poll(&pfd, 1, 100);
+        int64_t now = monotonicUs();
+
+        if (ready > 0 && (pfd.revents & POLLIN)) {
+            ssize_t len = read(master, chunk, sizeof(chunk));
+            if (len <= 0) {
+                continue;
+            }
+            for (ssize_t i = 0; i < len; i++) {
+                // Each byte takes 10 bit times on the simulated wire
+                linkFreeUs = std::max(linkFreeUs, now) + 10 * 1000000LL / baudrate;
+                if (serPos == 0) {
+                    lineStartUs = std::max(lineStartUs, now);
+                }
+
+                char recv = chunk[i];
+                if (recv != '\n') {
+                    // Roll over at the end of the buffer, like the firmware
+                    if (serPos >= receiveBufferSize - 1) {
+                        serPos = 0;
+                        truncatedFrames++;
+                    }
+                    receiveBuffer[serPos++] = recv;
+                    continue;
+                }
+                if (serPos == 0) {
+                    continue; // Empty lines are just the host resynchronizing
+                }
+
+                // Wait until the line has fully arrived at the simulated baud rate
+                int64_t receivedUs = linkFreeUs;
+                if (receivedUs > monotonicUs()) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(receivedUs - monotonicUs()));
+                }
+
+                if (serPos == 5 && memcmp(receiveBuffer.data(), "AMBI?", 5) == 0) {
+                    hostConnected = true;
+                    char reply[128];
+                    int replyLen = snprintf(reply, sizeof(reply), "AMBI proto=%d leds=%d buf=%zu show_us=%lld\n", protocolVersion, ledCount, receiveBufferSize, (long long)showUs);
+                    if (write(master, reply, replyLen) == -1) {
+                        perror("Failed to write to pseudo-terminal");
+                    }
+                }
+                else if (serPos == static_cast<size_t>(ledCount) * 3) {
+                    // show() blocks the firmware, bytes arriving meanwhile wait in the USB/UART buffer
+                    std::this_thread::sleep_for(std::chrono::microseconds(showUs));
+                    int64_t shownUs = monotonicUs();
+                    acceptedFrames++;
+                    statsAccepted++;
+                    statsLatencySum += shownUs - lineStartUs;
+                    if (log) {
+                        fprintf(log, "%llu,%lld,%lld,%lld,%lld\n", (unsigned long long)acceptedFrames, (long long)lineStartUs, (long long)receivedUs, (long long)shownUs, (long long)(shownUs - lineStartUs));
+                    }
+                    linkFreeUs = std::max(linkFreeUs, shownUs);
+                }
+                else {
+                    rejectedFrames++;
+                }
+                serPos = 0;
+                lineStartUs = 0;
+            }
+            now = monotonicUs();
+        }
+
+        if (now - lastStatsUs >= 1000000) {
+            double seconds = (now - lastStatsUs) / 1e6;
+            std::cout << "\r\033[Kfps: " << std::fixed << std::setprecision(1) << statsAccepted / seconds
+                      << " | accepted: " << acceptedFrames << " | rejected: " << rejectedFrames << " | truncated: " << truncatedFrames
+                      << " | latency: " << (statsAccepted ? statsLatencySum / static_cast<int64_t>(statsAccepted) : 0) << "us";
+            std::cout.flush();
+            if (hostConnected) {
+                char stats[128];
+                int statsLen = snprintf(stats, sizeof(stats), "STAT accepted=%llu rejected=%llu show_us=%lld\n", (unsigned long long)acceptedFrames, (unsigned long long)rejectedFrames, (long long)showUs);
+                if (write(master, stats, statsLen) == -1) {
+                    perror("Failed to write to pseudo-terminal");
+                }
+            }
+            lastStatsUs = now;
+            statsAccepted = 0;
+            statsLatencySum = 0;
+        }
+    }
+
+    std::cout << std::endl << "accepted: " << acceptedFrames << " rejected: " << rejectedFrames << " truncated: " << truncatedFrames << std::endl;
+    if (log) {
+        fclose(log);
+    }
+    close(slave);
+    close(master);
+}
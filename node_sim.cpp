@@ -0,0 +1,162 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Emulates a network LED node, like WLED, so the DDP and E1.31 outputs can be checked without hardware.
+// Usage: ambilight_node_sim [ddp|e131] [port] [led_count] [first_universe]
+// Point an outputs entry at 127.0.0.1:port. Once a second it prints the frame rate, packets per frame, incomplete frames,
+// sequence gaps and the mean color of the last frame.
+
+static bool run = true;
+
+static void signalHandler(int signum __attribute__((unused))) {
+    run = false;
+}
+
+static int64_t monotonicUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t get16(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) << 8 | p[1];
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return get16(p) << 16 | get16(p + 2);
+}
+
+int main(int argc, char** argv) {
+    const std::string protocol = argc > 1 ? argv[1] : "ddp";
+    const bool ddp = protocol == "ddp";
+    if (!ddp && protocol != "e131") {
+        std::cout << "Usage: " << argv[0] << " [ddp|e131] [port] [led_count] [first_universe]" << std::endl;
+        return 1;
+    }
+    const int port = argc > 2 ? std::stoi(argv[2]) : (ddp ? 4048 : 5568);
+    const size_t ledCount = argc > 3 ? std::stoul(argv[3]) : 128;
+    const uint32_t firstUniverse = argc > 4 ? std::stoul(argv[4]) : 1;
+    const uint32_t universes = static_cast<uint32_t>((ledCount + 169) / 170);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (fd == -1 || bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        perror("Failed to bind UDP socket");
+        return 1;
+    }
+    std::cout << "Simulated " << protocol << " node on port " << port << " (" << ledCount << " LEDs";
+    if (!ddp) {
+        std::cout << ", universes " << firstUniverse << "-" << firstUniverse + universes - 1;
+    }
+    std::cout << ")" << std::endl;
+
+    // Packets are taken off the socket in batches, like the host sends them
+    constexpr size_t batch = 64;
+    std::vector<std::vector<uint8_t>> buffers(batch, std::vector<uint8_t>(1500));
+    std::vector<iovec> vectors(batch);
+    std::vector<mmsghdr> messages(batch);
+    for (size_t i = 0; i < batch; i++) {
+        vectors[i] = {buffers[i].data(), buffers[i].size()};
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    std::vector<uint8_t> leds(ledCount * 3);
+    uint64_t frames = 0, packets = 0, incomplete = 0, gaps = 0, malformed = 0;
+    size_t frameBytes = 0;          // Bytes received since the last complete frame
+    int lastSequence = -1;
+    uint64_t lastFrames = 0, lastPackets = 0;
+    int64_t lastStatsUs = monotonicUs();
+
+    while (run) {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        const int count = recvmmsg(fd, messages.data(), batch, MSG_DONTWAIT, nullptr);
+        for (int i = 0; i < count; i++) {
+            const uint8_t* p = buffers[i].data();
+            const size_t length = messages[i].msg_len;
+            packets++;
+
+            if (ddp) {
+                // 10 byte header: flags, sequence, type, id, offset, length
+                if (length < 10 || (p[0] & 0xC0) != 0x40 || get16(p + 8) != length - 10 || get32(p + 4) + length - 10 > leds.size()) {
+                    malformed++;
+                    continue;
+                }
+                const int sequence = p[1] & 0x0F;
+                if (sequence != 0 && lastSequence > 0 && sequence != lastSequence && sequence != lastSequence % 15 + 1) {
+                    gaps++;
+                }
+                lastSequence = sequence;
+                std::memcpy(leds.data() + get32(p + 4), p + 10, length - 10);
+                frameBytes += length - 10;
+                if (p[0] & 0x01) { // Push
+                    frames++;
+                    incomplete += frameBytes != leds.size();
+                    frameBytes = 0;
+                }
+                continue;
+            }
+
+            // E1.31: ACN packet identifier, data vectors, universe, then the DMX start code and the channels
+            if (length < 126 || std::memcmp(p + 4, "ASC-E1.17", 9) != 0 || get32(p + 18) != 4 || get32(p + 40) != 2 || p[117] != 2 || p[125] != 0 ||
+                get16(p + 123) != length - 125) {
+                malformed++;
+                continue;
+            }
+            const uint32_t universe = get16(p + 113);
+            if (universe < firstUniverse || universe >= firstUniverse + universes) {
+                continue; // Another node's
+            }
+            const int sequence = p[111];
+            if (sequence != lastSequence) {
+                // A new frame starts. The previous one should have brought every universe.
+                if (lastSequence >= 0) {
+                    frames++;
+                    incomplete += frameBytes != leds.size();
+                    gaps += sequence != (lastSequence + 1) % 256;
+                }
+                frameBytes = 0;
+                lastSequence = sequence;
+            }
+            const size_t offset = (universe - firstUniverse) * 510;
+            const size_t channels = std::min<size_t>(length - 126, leds.size() - offset);
+            std::memcpy(leds.data() + offset, p + 126, channels);
+            frameBytes += channels;
+        }
+
+        const int64_t now = monotonicUs();
+        if (now - lastStatsUs >= 1000000) {
+            const double seconds = (now - lastStatsUs) / 1e6;
+            uint64_t sum[3] = {0, 0, 0};
+            for (size_t i = 0; i < leds.size(); i++) {
+                sum[i % 3] += leds[i];
+            }
+            const uint64_t newFrames = frames - lastFrames;
+            std::cout << static_cast<int>(newFrames / seconds) << "fps, "
+                      << (newFrames > 0 ? static_cast<double>(packets - lastPackets) / newFrames : 0) << " packets/frame, "
+                      << incomplete << " incomplete, " << gaps << " sequence gaps, " << malformed << " malformed, mean color "
+                      << sum[0] / ledCount << "," << sum[1] / ledCount << "," << sum[2] / ledCount << std::endl;
+            lastStatsUs = now;
+            lastFrames = frames;
+            lastPackets = packets;
+        }
+    }
+    close(fd);
+}